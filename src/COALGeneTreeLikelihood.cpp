@@ -41,6 +41,7 @@
 
 #include "COALGeneTreeLikelihood.h"
 #include "GenericTreeExplorationAlgorithms.h"
+#include "Profiler.h"
 
 #include <iostream>
 
@@ -151,11 +152,10 @@ COALGeneTreeLikelihood::COALGeneTreeLikelihood(
   const SiteContainer & data,
   SubstitutionModel * model,
   DiscreteDistribution * rDist,
-  TreeTemplate<Node> & spTree,  
+  SpeciesTreeSnapshot & spSnapshot,
   TreeTemplate<Node> & rootedTree,  
   TreeTemplate<Node> & geneTreeWithSpNames,
   const std::map <std::string, std::string> seqSp,
-  std::map <std::string,int> spId,
   std::vector < std::vector < std::vector < std::vector < unsigned int > > > > coalCounts,
   std::vector < double > coalBl,
   int speciesIdLimitForRootPosition,  
@@ -171,11 +171,10 @@ GeneTreeLikelihood(tree,
                    data,
                    model,
                    rDist,
-                   spTree,  
+                   spSnapshot,
                    rootedTree, 
                    geneTreeWithSpNames,
                    seqSp,
-                   spId,
                    speciesIdLimitForRootPosition,
                    MLindex, 
                    params,
@@ -230,7 +229,6 @@ COALGeneTreeLikelihood & COALGeneTreeLikelihood::operator=(const COALGeneTreeLik
 COALGeneTreeLikelihood::~COALGeneTreeLikelihood()
 {
   if (levaluator_) delete levaluator_;
-  if (spTree_) delete spTree_;
   if (rootedTree_) delete rootedTree_;
   if (geneTreeWithSpNames_) delete geneTreeWithSpNames_;
 }
@@ -253,7 +251,7 @@ void COALGeneTreeLikelihood::initParameters()
   }
   }*/
     scenarioLikelihood_ = findMLCoalReconciliationDR (spTree_, rootedTree_, 
-                                                      seqSp_, spId_, 
+                                                      seqSp_, *spId_, 
                                                       coalBl_, 
                                                       MLindex_, 
                                                       coalCounts_, 
@@ -346,7 +344,7 @@ void COALGeneTreeLikelihood::computeReconciliationLikelihood()
 
     //Compute the COAL likelihood
     scenarioLikelihood_ = findMLCoalReconciliationDR (spTree_, rootedTree_, 
-                                                      seqSp_, spId_, 
+                                                      seqSp_, *spId_, 
                                                       coalBl_, 
                                                       tentativeMLindex_, 
                                                       tentativeCoalCounts_, 
@@ -433,7 +431,7 @@ double COALGeneTreeLikelihood::testNNI(int nodeId) const throw (NodeException)
     
     //Compute the COAL likelihood
     candidateScenarioLk =  findMLCoalReconciliationDR (spTree_, treeForNNI, 
-                                                       seqSp_, spId_, 
+                                                       seqSp_, *spId_, 
                                                        coalBl_, 
                                                        tentativeMLindex_, 
                                                        tentativeCoalCounts_, 
@@ -660,6 +658,9 @@ void COALGeneTreeLikelihood::refineGeneTreeSPRsFast (map<string, string> params)
   
   bool computeSequenceLikelihoodForSPR = ApplicationTools::getBooleanParameter("compute.sequence.likelihood.in.sprs", params, true, "", false, false);
   
+  //Postorder counts of rootedTree_, from which those of the SPR candidates are updated.
+  CoalPostorderCounts currentCounts;
+  computeCoalPostorderCounts(*spTree_, *rootedTree_, seqSp_, *spId_, currentCounts);
   
   while (numIterationsWithoutImprovement < rootedTree_->getNumberOfNodes() - 2)
   {
@@ -667,7 +668,7 @@ void COALGeneTreeLikelihood::refineGeneTreeSPRsFast (map<string, string> params)
     annotateGeneTreeWithDuplicationEvents (*spTree_, 
                                            *rootedTree_, 
                                            rootedTree_->getRootNode(), 
-                                           seqSp_, spId_); 
+                                           seqSp_, *spId_); 
     
     for (int nodeForSPR=rootedTree_->getNumberOfNodes()-1 ; nodeForSPR >0; nodeForSPR--) 
     {
@@ -679,6 +680,11 @@ void COALGeneTreeLikelihood::refineGeneTreeSPRsFast (map<string, string> params)
         
         buildVectorOfRegraftingNodesCoalGeneTree(*spTree_, *rootedTree_, nodeForSPR, sprLimitGeneTree_, nodeIdsToRegraft);
         
+        //SPRs of a son of the root reroot the tree, and are recomputed entirely.
+        Node * oldFather = n->getFather();
+        bool incrementalCounts = oldFather->hasFather();
+        int brotherId = (oldFather->getSon(0) == n) ? oldFather->getSon(1)->getId() : oldFather->getSon(0)->getId();
+        
         betterTree = false;
         for (unsigned int i =0 ; i<nodeIdsToRegraft.size() ; i++) 
         {
@@ -688,16 +694,30 @@ void COALGeneTreeLikelihood::refineGeneTreeSPRsFast (map<string, string> params)
             treeForSPR = 0;
           }
           treeForSPR = rootedTree_->clone();
+          Profiler::count(PROFILE_TREE_CLONE);
+          Profiler::count(PROFILE_GENE_SPR_TRIED);
           
           nodesToUpdate = makeSPR(*treeForSPR, nodeForSPR, nodeIdsToRegraft[i], false, true);
           
           //Compute the COAL likelihood
-          candidateScenarioLk =  findMLCoalReconciliationDR (spTree_, treeForSPR, 
-                                                             seqSp_, spId_, 
-                                                             coalBl_, 
-                                                             tentativeMLindex_, 
-                                                             tentativeCoalCounts_, 
-                                                             tentativeNodesToTryInNNISearch_, false); 
+          if (incrementalCounts) {
+            std::vector<bool> countsToUpdate = getNodesToUpdateAfterSPR(*treeForSPR, nodeForSPR, brotherId);
+            candidateScenarioLk =  findMLCoalReconciliationDR (spTree_, treeForSPR, 
+                                                               seqSp_, *spId_, 
+                                                               coalBl_, 
+                                                               tentativeMLindex_, 
+                                                               tentativeCoalCounts_, 
+                                                               tentativeNodesToTryInNNISearch_, false, 
+                                                               &currentCounts, &countsToUpdate); 
+          }
+          else {
+            candidateScenarioLk =  findMLCoalReconciliationDR (spTree_, treeForSPR, 
+                                                               seqSp_, *spId_, 
+                                                               coalBl_, 
+                                                               tentativeMLindex_, 
+                                                               tentativeCoalCounts_, 
+                                                               tentativeNodesToTryInNNISearch_, false); 
+          }
           
           if (candidateScenarioLk > bestScenarioLk)// - 0.1) //We investigate the sequence likelihood if the scenario likelihood is not bad
           {
@@ -717,7 +737,8 @@ void COALGeneTreeLikelihood::refineGeneTreeSPRsFast (map<string, string> params)
           if (logL - 0.01 > bestlogL) 
           {
             levaluator_->acceptAlternativeTree();
-            std::cout << "Better tree overall: "<<logL << " compared to "<<bestlogL<<std::endl;
+            Profiler::count(PROFILE_GENE_SPR_ACCEPTED);
+            DEBUG_LOG("Better tree overall: "<<logL << " compared to "<<bestlogL);
             betterTree = true;
             bestlogL = logL;
             bestScenarioLk = candidateScenarioLk;
@@ -767,6 +788,7 @@ void COALGeneTreeLikelihood::refineGeneTreeSPRsFast (map<string, string> params)
           }
           rootedTree_ = bestTree->clone();
           breadthFirstreNumberAndResetProperties (*rootedTree_);
+          computeCoalPostorderCounts(*spTree_, *rootedTree_, seqSp_, *spId_, currentCounts);
           
           if (bestTree) {
             delete bestTree;
@@ -802,9 +824,8 @@ void COALGeneTreeLikelihood::refineGeneTreeSPRsFast (map<string, string> params)
   annotateGeneTreeWithDuplicationEvents (*spTree_, 
                                          *rootedTree_, 
                                          rootedTree_->getRootNode(), 
-                                         seqSp_, spId_); 
-  cout << "Reconciled tree: "<<endl;
-  nhx->write(*rootedTree_, cout);
+                                         seqSp_, *spId_); 
+  DEBUG_LOG("Reconciled tree: " << std::endl << nhx->treeToParenthesis(*rootedTree_));
   
   if (bestTree) {
     delete bestTree;
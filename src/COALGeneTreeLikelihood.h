@@ -145,10 +145,9 @@ using namespace bpp;
          * @param data Sequences to use.
          * @param model The substitution model to use.
          * @param rDist The rate across sites distribution to use.
-         * @param spTree The species tree
+         * @param spSnapshot The species tree and the link between species name and species ID, shared with the caller
          * @param rootedTree rooted version of the gene tree
          * @param seqSp link between sequence and species names
-         * @param spId link between species name and species ID
          * @param coalCounts vector to store coalescent numbers per branch
          * @param coalBl vector to give number of coalescent units per branch of the species tree
          * @param speciesIdLimitForRootPosition limit for gene tree rooting heuristics
@@ -163,11 +162,10 @@ using namespace bpp;
                                const SiteContainer & data,
                                SubstitutionModel * model,
                                DiscreteDistribution * rDist,
-                               TreeTemplate<Node> & spTree,
+                               SpeciesTreeSnapshot & spSnapshot,
                                TreeTemplate<Node> & rootedTree,
                                TreeTemplate<Node> & geneTreeWithSpNames,
                                const std::map <std::string, std::string> seqSp,
-                               std::map <std::string,int> spId,
                                std::vector < std::vector < std::vector < std::vector <unsigned int> > > > coalCounts,
                                std::vector < double > coalBl,
                                int speciesIdLimitForRootPosition,
@@ -230,10 +228,6 @@ using namespace bpp;
 
         double getScenarioLikelihood() const throw (Exception) { return scenarioLikelihood_; }
 
-        void setSpTree(TreeTemplate<Node> & spTree) { if (spTree_) delete spTree_; spTree_ = spTree.clone(); }
-
-        void setSpId(std::map <std::string, int> & spId) {spId_ = spId;}
-
         double testNNI(int nodeId) const throw (NodeException);
 
         void doNNI(int nodeId) throw (NodeException);
@@ -39,7 +39,12 @@ The fact that you are presently reading this means that you have had
 knowledge of the CeCILL license and that you accept its terms.
 */
 #include <iostream>
+#include <map>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 #include "COALTools.h"
+#include "Profiler.h"
 
 
 
@@ -484,78 +489,161 @@ double computeCoalLikelihood (std::vector < std::vector<unsigned int> > vec, std
     return logLk;
 }
 
-double computeCoalLikelihood ( std::vector<unsigned int>  vec, double CoalBl ) 
+/*****************************************************************************
+ * The single branch version is called for every branch of every family at
+ * every candidate tree, so its terms are built from a table of log-factorials,
+ * and its results are kept in a memo shared by all families of a client.
+ * The memo is emptied when it gets too large, as optimized branch lengths
+ * take many values.
+ ****************************************************************************/
+
+static std::vector<double> coalLogFactorials (1, 0.0);
+
+static std::map< std::pair< std::pair<unsigned int, unsigned int>, double >, double > coalLogLikelihoods;
+
+static const size_t COAL_MEMO_MAX_SIZE = 1000000;
+
+static double logFactorial (size_t n)
 {
-    
-    double logLk = 0;
-    double prod;
-    int kminus1;
+    while (coalLogFactorials.size() <= n) {
+        coalLogFactorials.push_back(coalLogFactorials.back() + log((double)coalLogFactorials.size()));
+    }
+    return coalLogFactorials[n];
+}
 
-    double v = (double) vec[0];
-    double u = (double) vec[1];
+/*****************************************************************************
+ * Probability that u lineages coalesce into v lineages along a branch of
+ * length CoalBl, as the uniformized pure death process: all terms are positive,
+ * so that it is used when the alternating series loses its precision.
+ ****************************************************************************/
 
-//	std::cout << " v and u:"<< v <<" "<< u <<std::endl;
-	
-    /*
-    for (unsigned int k = vec[0] ; k <= vec[1] ; k++ ) 
-    {
-        prod = 1.0;
-        kminus1 = k-1;
-        double dy;
-        for (unsigned int y = 0 ; y <= kminus1 ; y++ ) {
-            dy = double(y);
-            prod *= (v + dy) * (u - dy) / ( u + dy ) ;
-        }
-        if (prod == 0) {
-            prod = 1;
+static double computeCoalLikelihoodByUniformization (unsigned int v, unsigned int u, double CoalBl)
+{
+    //Coalescence rate with j lineages is j(j-1)/2, the largest being with u lineages.
+    double maxRate = (double)u * ((double)u - 1.0) / 2.0;
+    double lambda = maxRate * CoalBl;
+    if (lambda <= 0) {
+        return (u == v) ? 0.0 : log(NumConstants::VERY_TINY());
+    }
+    //p[i] is the probability of having v + i lineages after n events of the uniformized process.
+    std::vector<double> p (u - v + 1, 0.0);
+    p[u - v] = 1.0;
+    double logLambda = log(lambda);
+    double lk = exp(-lambda) * p[0];
+    //At least u - v events are needed to reach v lineages.
+    size_t maxEvents = (size_t)((double)(u - v) + lambda + 10.0 * sqrt(lambda) + 30.0);
+    for (size_t n = 1 ; n <= maxEvents ; n++) {
+        for (size_t i = 0 ; i < p.size() ; i++) {
+            double j = (double)(v + i);
+            double stay = 1.0 - j * (j - 1.0) / 2.0 / maxRate;
+            p[i] *= stay;
+            if (i + 1 < p.size()) {
+                double j1 = j + 1.0;
+                p[i] += p[i + 1] * j1 * (j1 - 1.0) / 2.0 / maxRate;
+            }
         }
+        lk += exp(-lambda + (double)n * logLambda - logFactorial(n)) * p[0];
+    }
+    if (lk <= 0) {
+        return log(NumConstants::VERY_TINY());
+    }
+    return log(lk);
+}
+
+/*****************************************************************************
+ * vec[0] is the number of outgoing lineages v, vec[1] the number of incoming lineages u.
+ * Each term of the series is computed as its logarithm, with
+ * prod_{y=0}^{k-1} (v+y)(u-y)/(u+y) = (v+k-1)!/(v-1)! * u!/(u-k)! * (u-1)!/(u+k-1)!,
+ * and the terms are summed relative to the largest one.
+ ****************************************************************************/
+
+double computeCoalLikelihood ( std::vector<unsigned int>  vec, double CoalBl ) 
+{
+    unsigned int v = vec[0];
+    unsigned int u = vec[1];
+
+    if (v == 0 || v > u) {
+        //No lineage or more lineages out than in: only possible for an empty branch.
+        return (u == 0 && v == 0) ? 0.0 : log(NumConstants::VERY_TINY());
+    }
+
+    std::pair< std::pair<unsigned int, unsigned int>, double > key (std::make_pair(v, u), CoalBl);
+    std::map< std::pair< std::pair<unsigned int, unsigned int>, double >, double >::const_iterator it = coalLogLikelihoods.find(key);
+    if (it != coalLogLikelihoods.end()) {
+        return it->second;
+    }
+
+    double dv = (double)v;
+    double first = CoalBl/2.0  * (-dv*dv + dv);
+    double constant = logFactorial(u) + logFactorial(u - 1) - logFactorial(v - 1) - logFactorial(v);
+
+    std::vector<double> logTerms (u - v + 1);
+    double maxLogTerm = -std::numeric_limits<double>::infinity();
+    for (unsigned int k = v ; k <= u ; k++ ) {
         double dk = (double)k;
-        double dkminus1 = (double)kminus1;
-        double dkminusv = dk - v ;
-       std::cout << "CoalBl "<<CoalBl<<std::endl;
-        std::cout << "prod "<< prod <<std::endl;
-        std::cout <<"fact "<<NumTools::fact(vec[0])<<std::endl;
-        std::cout <<"fact2 "<<NumTools::fact(k - vec[0])<<std::endl;
-        std::cout <<"exp (-k * (k-1) * CoalBl/2 ) "<<exp (-(double)k * ((double)k-1.0) * CoalBl/2.0  )<<std::endl;
-        std::cout <<"(2*k -1) "<<(2.0*(double)k -1)<<std::endl;
-        std::cout <<"( (-1)^(k-vec[0]) ) "<<( pow(-1.0, ( (double)k-(double)vec[0]) ) )<<std::endl;
-        std::cout <<"( NumTools::fact(vec[0]) * NumTools::fact(k - vec[0]) * (vec[0] + kminus1 ) ) "<<( (double)NumTools::fact(vec[0]) * (double)NumTools::fact(k - vec[0]) * ((double)vec[0] + kminus1 ) )<<std::endl;
-        logLk += ( exp (-dk * dkminus1 * CoalBl/2.0 ) ) * (2.0*dk -1.0) * ( pow(-1.0, dkminusv ) ) / ( NumTools::fact(v) * NumTools::fact(dkminusv) * (v + dkminus1 ) ) * prod;
-        //std::cout << "logLk: " << logLk<<std::endl;
+        double dkminusv = dk - dv;
+        logTerms[k - v] = constant - dkminusv * (dk + dv - 1.0) * CoalBl/2.0 + log(2.0*dk - 1.0)
+            + logFactorial(v + k - 1) - logFactorial(u - k) - logFactorial(u + k - 1)
+            - logFactorial(k - v) - log(dv + dk - 1.0);
+        maxLogTerm = std::max(maxLogTerm, logTerms[k - v]);
     }
-	if (logLk <= 0) {
-		logLk = NumConstants::VERY_TINY * NumConstants::VERY_TINY;
-	}
-	 return log(logLk);
-	 */
-	
-	double first = CoalBl/2.0  * (-v*v + v);
-	
-	for (size_t k = (size_t)v ; k <= (size_t)u ; k++ ) 
-	{
-		prod = 1.0;
-		kminus1 = k-1;
-		double dy;
-		for (int y = 0 ; y <= kminus1 ; y++ ) {
-			dy = double(y);
-			prod *= (v + dy) * (u - dy) / ( u + dy ) ;
-		}
-		if (prod == 0) {
-			prod = 1;
-		}		
-		double dk = (double)k;
-		double dkminus1 = (double)kminus1;
-		double dkminusv = dk - v ;
-		logLk += ( exp (dkminusv * (1- 2*v - dkminusv) * CoalBl/2.0 ) ) * (2.0*dk -1.0) * ( pow(-1.0, dkminusv ) ) / ( NumTools::fact(v) * NumTools::fact(dkminusv) * (v + dkminus1 ) ) * prod;
-	}
-	
-	if (logLk < 0) {
-		std::cout <<"WARNING: correction"<<std::endl;
-		logLk = NumConstants::VERY_TINY();
-	}
-	
-	logLk = log(logLk) + first;
+    //Terms of even rank are positive, terms of odd rank negative.
+    double positive = 0.0;
+    double negative = 0.0;
+    for (unsigned int i = 0 ; i < logTerms.size() ; i++ ) {
+        if (i % 2 == 0)
+            positive += exp(logTerms[i] - maxLogTerm);
+        else
+            negative += exp(logTerms[i] - maxLogTerm);
+    }
+
+    double logLk;
+    if (positive - negative > 1e-8 * positive) {
+        logLk = log(positive - negative) + maxLogTerm + first;
+    }
+    else {
+        logLk = computeCoalLikelihoodByUniformization(v, u, CoalBl);
+    }
+
+    if (coalLogLikelihoods.size() >= COAL_MEMO_MAX_SIZE) {
+        coalLogLikelihoods.clear();
+    }
+    coalLogLikelihoods[key] = logLk;
+    return logLk;
+}
+
+/*****************************************************************************
+ * Same as computeCoalLikelihood for one gene family, but only the species
+ * branches whose counts differ from the previous call are re-evaluated:
+ * successive rootings, and successive SPR candidates, share most of their counts.
+ ****************************************************************************/
 
+static std::vector < std::vector<unsigned int> > lastCoalCounts;
+static std::vector < double > lastCoalBls;
+static std::vector < double > lastBranchLogLikelihoods;
+
+static double computeCoalLikelihoodOfChangedBranches (const std::vector < std::vector<unsigned int> > & vec, const std::vector < double > & CoalBl )
+{
+    if (lastBranchLogLikelihoods.size() != vec.size() || lastCoalBls != CoalBl) {
+        lastCoalCounts = vec;
+        lastCoalBls = CoalBl;
+        lastBranchLogLikelihoods.resize(vec.size());
+        for (unsigned int i = 0 ; i < vec.size() ; i++ ) {
+            lastBranchLogLikelihoods[i] = computeCoalLikelihood (vec[i], CoalBl[i]);
+        }
+    }
+    else {
+        for (unsigned int i = 0 ; i < vec.size() ; i++ ) {
+            if (vec[i] != lastCoalCounts[i]) {
+                lastCoalCounts[i] = vec[i];
+                lastBranchLogLikelihoods[i] = computeCoalLikelihood (vec[i], CoalBl[i]);
+            }
+        }
+    }
+    double logLk = 0;
+    for (unsigned int i = 0 ; i < vec.size() ; i++ ) {
+        logLk += lastBranchLogLikelihoods[i];
+    }
     return logLk;
 }
 
@@ -738,7 +826,7 @@ void computeRootingCoalCounts(TreeTemplate<Node> & spTree,
 	}*/
 
     //What to put?
-    rootLikelihood = computeCoalLikelihood ( rootCounts, bls ) ;
+    rootLikelihood = computeCoalLikelihoodOfChangedBranches ( rootCounts, bls ) ;
 	
  /*   
     computeConditionalLikelihoodAndAssignSpId(spTree, sons, 
@@ -887,6 +975,76 @@ void printCoalCounts (std::vector < std::vector < std::vector < std::vector<unsi
 
 
 
+/*****************************************************************************
+ * Postorder counts kept for SPR candidates.
+ ****************************************************************************/
+
+void computeCoalPostorderCounts(TreeTemplate<Node> & spTree, 
+                                TreeTemplate<Node> & geneTree, 
+                                std::map<std::string, std::string > seqSp, 
+                                std::map<std::string, int > spID, 
+                                CoalPostorderCounts & counts)
+{
+    std::vector< std::vector<unsigned int> > countVector (spTree.getNumberOfNodes(), std::vector<unsigned int> (2, 0));
+    std::vector< std::vector< std::vector< std::vector<unsigned int> > > > coalCounts (geneTree.getNumberOfNodes(), std::vector< std::vector< std::vector<unsigned int> > > (3, countVector));
+    std::vector <std::vector<unsigned int> > speciesIDs (geneTree.getNumberOfNodes(), std::vector<unsigned int> (3, 0));
+    computeSubtreeCoalCountsPostorder(spTree, geneTree, geneTree.getRootNode(), 
+                                      seqSp, spID, coalCounts, speciesIDs);
+    counts.coalCounts.resize(coalCounts.size());
+    counts.speciesIDs.resize(coalCounts.size());
+    for (unsigned int i = 0 ; i < coalCounts.size() ; i++) {
+        counts.coalCounts[i] = coalCounts[i][0];
+        counts.speciesIDs[i] = speciesIDs[i][0];
+    }
+}
+
+std::vector<bool> getNodesToUpdateAfterSPR(TreeTemplate<Node> & geneTree, int cutNodeId, int brotherId)
+{
+    std::vector<bool> nodesToUpdate (geneTree.getNumberOfNodes(), false);
+    std::vector <Node *> starts;
+    starts.push_back(geneTree.getNode(cutNodeId)->getFather());
+    starts.push_back(geneTree.getNode(brotherId)->getFather());
+    for (unsigned int i = 0 ; i < starts.size() ; i++) {
+        for (Node * node = starts[i] ; node ; node = node->hasFather() ? node->getFather() : 0) {
+            nodesToUpdate[node->getId()] = true;
+        }
+    }
+    return nodesToUpdate;
+}
+
+/*****************************************************************************
+ * Postorder traversal limited to the nodes flagged in nodesToUpdate,
+ * the counts of the other nodes being already filled.
+ ****************************************************************************/
+
+static void computeSubtreeCoalCountsPostorderOfChangedNodes(TreeTemplate<Node> & spTree, 
+                                                            Node * node, 
+                                                            std::vector < std::vector< std::vector< std::vector< unsigned int > > > > & coalCounts,
+                                                            std::vector <std::vector<unsigned int> > & speciesIDs, 
+                                                            const std::vector<bool> & nodesToUpdate)
+{
+    int id = node->getId();
+    if (! nodesToUpdate[id] || node->isLeaf()) {
+        return;
+    }
+    std::vector <Node *> sons = node->getSons();
+    for (unsigned int i = 0; i< sons.size(); i++){
+        computeSubtreeCoalCountsPostorderOfChangedNodes(spTree, sons[i], coalCounts, speciesIDs, nodesToUpdate);
+    }
+    int idSon0 = sons[0]->getId();
+    int idSon1 = sons[1]->getId();
+    computeCoalCountsFromSons (spTree, sons, 
+                               speciesIDs[id][0], 
+                               speciesIDs[idSon0][0], 
+                               speciesIDs[idSon1][0],
+                               coalCounts[id][0],
+                               coalCounts[idSon0][0], 
+                               coalCounts[idSon1][0]
+                               );
+}
+
+
+
 /*****************************************************************************
  * This function aims at finding the most likely coalescent reconciliation, 
  * using a double recursive tree traversal. 
@@ -911,8 +1069,11 @@ double findMLCoalReconciliationDR (TreeTemplate<Node> * spTree,
                                int & MLindex, 
                                std::vector < std::vector < std::vector<std::vector<unsigned int> > > > &coalCounts,
                                std::set <int> &nodesToTryInNNISearch, 
-                               bool fillTables)
+                               bool fillTables,
+                               const CoalPostorderCounts * reference,
+                               const std::vector<bool> * nodesToUpdate)
 {
+    ScopedTimer timer (PROFILE_COAL_RECONCILIATION);
 	if (!geneTree->isRooted()) {
 		std::cout << TreeTemplateTools::treeToParenthesis (*geneTree, true)<<std::endl;
 		std::cout <<"!!!!!!gene tree is not rooted in findMLCoalReconciliationDR !!!!!!"<<std::endl;
@@ -935,8 +1096,19 @@ double findMLCoalReconciliationDR (TreeTemplate<Node> * spTree,
 	//speciesIDs[i][2]: conditional species index, seen from the son 1
     std::vector <std::vector< unsigned int> > speciesIDs(geneTree->getNumberOfNodes(), nodeSpId);
 
-	//Also, reinitialize the coalCounts
-	resetCoalCounts(coalCounts);
+	if (reference && nodesToUpdate) {
+		//Unchanged subtrees have the postorder counts of the tree the SPR was made on.
+		for (unsigned int i = 0 ; i < coalCounts.size() ; i++) {
+			if (! (*nodesToUpdate)[i]) {
+				coalCounts[i][0] = reference->coalCounts[i];
+				speciesIDs[i][0] = speciesIDs[i][1] = speciesIDs[i][2] = reference->speciesIDs[i];
+			}
+		}
+	}
+	else {
+		//Also, reinitialize the coalCounts
+		resetCoalCounts(coalCounts);
+	}
 
 	/*
 	std::string gStr = "(((((taxon26:0.08316,(taxon30:0.01004,taxon3:0.01004):0.073115):0.090045,taxon2:0.173205):0.172685,taxon15:0.34589):0.15941,(((taxon29:0.23656,(taxon7:0.064225,taxon9:0.064225):0.17233):0.044465,(taxon13:0.09682,taxon33:0.09682):0.1842):0.140795,(((((taxon1:0.183495,((taxon22:0.12459,(taxon21:0.025215,taxon20:0.02522):0.09937):0.01579,taxon24:0.140375):0.04311):0.104935,(taxon16:0.21073,taxon12:0.21073):0.077695):0.01399,((taxon34:0.06071,taxon8:0.06071):0.206685,(taxon36:0.252725,((taxon11:0.0872,(taxon27:0.008555,taxon5:0.008555):0.078645):0.10741,taxon17:0.19461):0.058115):0.014665):0.03502):0.003255,((taxon35:0.18384,(taxon18:0.009025,taxon6:0.009025):0.174815):0.049945,(taxon28:0.174385,taxon23:0.174395):0.0594):0.07188):0.075495,(((taxon19:0.20129,taxon14:0.20129):0.093865,(((taxon25:0.076435,taxon4:0.076435):0.06435,(taxon38:0.118835,taxon32:0.118835):0.02195):0.08733,taxon10:0.22812):0.067035):0.04378,(taxon40:0.30888,(taxon39:0.075125,taxon37:0.075125):0.233765):0.03005):0.
@@ -947,6 +1119,14 @@ double findMLCoalReconciliationDR (TreeTemplate<Node> * spTree,
 	
 	
 	//breadthFirstreNumber (*spTree);
+	if (reference && nodesToUpdate) {
+		computeSubtreeCoalCountsPostorderOfChangedNodes(*spTree, 
+		                                                geneTree->getRootNode(), 
+		                                                coalCounts,
+		                                                speciesIDs, 
+		                                                *nodesToUpdate);
+	}
+	else {
     computeSubtreeCoalCountsPostorder(*spTree, 
                                       *geneTree, 
                                       geneTree->getRootNode(), 
@@ -954,6 +1134,7 @@ double findMLCoalReconciliationDR (TreeTemplate<Node> * spTree,
                                       spID, 
                                       coalCounts,
                                       speciesIDs);
+	}
 
     //Add the starting lineage at the root
     for (unsigned int i = 0 ; i < spTree->getNumberOfNodes() ; i++ ) {
@@ -990,7 +1171,7 @@ double findMLCoalReconciliationDR (TreeTemplate<Node> * spTree,
 	VectorTools::print (coalCounts[geneTree->getRootNode()->getId()][0][0]);
 	std::cout << "Out"<<std::endl;
 	VectorTools::print (coalCounts[geneTree->getRootNode()->getId()][0][1]);*/
-    double initialLikelihood = computeCoalLikelihood ( coalCounts[geneTree->getRootNode()->getId()][0], coalBl ) ;
+    double initialLikelihood = computeCoalLikelihoodOfChangedBranches ( coalCounts[geneTree->getRootNode()->getId()][0], coalBl ) ;
     
  //   std::cout << "Initial Likelihood: "<< initialLikelihood <<std::endl;
    
@@ -204,6 +204,35 @@ void resetCoalCounts (std::vector < std::vector < std::vector < std::vector<unsi
 void printCoalCounts (std::vector < std::vector < std::vector < std::vector<unsigned int> > > > &coalCounts) ;
 
 
+/*****************************************************************************
+ * Postorder counts of a rooted gene tree, seen from the father of each node:
+ * coalCounts[i] and speciesIDs[i] are coalCounts[i][0] and speciesIDs[i][0]
+ * of computeSubtreeCoalCountsPostorder for the node with id i.
+ * They are kept for the current tree of an SPR search, so that the postorder
+ * traversal of each SPR candidate only recomputes the nodes whose subtree changed.
+ ****************************************************************************/
+
+struct CoalPostorderCounts {
+    std::vector < std::vector< std::vector<unsigned int> > > coalCounts;
+    std::vector <unsigned int> speciesIDs;
+};
+
+void computeCoalPostorderCounts(TreeTemplate<Node> & spTree, 
+                                TreeTemplate<Node> & geneTree, 
+                                std::map<std::string, std::string > seqSp, 
+                                std::map<std::string, int > spID, 
+                                CoalPostorderCounts & counts);
+
+/*****************************************************************************
+ * After makeSPR moved node cutNodeId away from its brother brotherId, without
+ * moving the root, only the new father of cutNodeId, the new father of brotherId
+ * and their ancestors have a different subtree.
+ * Returns a vector telling, for each node id of geneTree, if it is one of them.
+ ****************************************************************************/
+
+std::vector<bool> getNodesToUpdateAfterSPR(TreeTemplate<Node> & geneTree, int cutNodeId, int brotherId);
+
+
 /*****************************************************************************
  * This function aims at finding the most likely coalescent reconciliation, 
  * using a double recursive tree traversal. 
@@ -218,6 +247,9 @@ void printCoalCounts (std::vector < std::vector < std::vector < std::vector<unsi
  * having its root in subtree opposite neighbour j of node i.
  * Node species IDs are also recorded in a (number of nodes)*3 cells table.
  * The boolean "fillTables" is here to tell whether we want to update the vectors num*lineages.
+ * If reference and nodesToUpdate are given, geneTree has been obtained by an SPR
+ * on the tree whose postorder counts are in reference, and only the nodes flagged
+ * in nodesToUpdate are recomputed in the postorder traversal.
  ****************************************************************************/
 
 double findMLCoalReconciliationDR (TreeTemplate<Node> * spTree, 
@@ -228,7 +260,9 @@ double findMLCoalReconciliationDR (TreeTemplate<Node> * spTree,
                                    int & MLindex, 
                                    std::vector < std::vector < std::vector < std::vector<unsigned int> > > > &coalCounts,
                                    std::set <int> &nodesToTryInNNISearch, 
-                                   bool fillTables = true);
+                                   bool fillTables = true,
+                                   const CoalPostorderCounts * reference = 0,
+                                   const std::vector<bool> * nodesToUpdate = 0);
 
 
 /*****************************************************************************
@@ -5,9 +5,13 @@
 
 #include "Constants.h"
 #include "ClientComputingGeneLikelihoods.h"
+#include "Profiler.h"
 
 namespace mpi = boost::mpi;
 
+//Largest exhaustive.topologies.max.leaves: there are (2n-5)!! topologies of n sequences, 10395 for 8.
+static const unsigned int MAX_EXHAUSTIVE_LEAVES = 8;
+
 
 /*
  *
@@ -93,11 +97,10 @@ void ClientComputingGeneLikelihoods::parseOptions()  {
    *****************************************************************************/
 
   //First we read the species tree from the char[] sent by the server
-  spTree_=TreeTemplateTools::parenthesisToTree(currentSpeciesTree_, false, "", true);
+  //(this also makes the correspondance between species name and id)
+  updateSpeciesTreeSnapshot();
 
   resetLossesAndDuplications(*spTree_, lossExpectedNumbers_, duplicationExpectedNumbers_);
-  //To make the correspondance between species name and id:
-  spId_ = computeSpeciesNamesToIdsMap(*spTree_);
 
   /****************************************************************************
    * Gene family parsing and first likelihood computation.
@@ -109,12 +112,37 @@ void ClientComputingGeneLikelihoods::parseOptions()  {
   }
   std::cout << toPrint <<std::endl;
   //Gets gene family-specific options, builds the GeneTreeLikelihood objects, and computes the likelihood
-  parseAssignedGeneFamilies();
-  std::vector <std::string> t;
+  reconciliationOnly_ = ApplicationTools::getBooleanParameter("reconciliation.only", params_, false, "", true, false);
+  memoryBudget_ = ApplicationTools::getDoubleParameter("client.memory.budget", params_, 0.0, "", true, false) * 1024.0 * 1024.0;
+  if (reconciliationOnly_)
+    parseAssignedGeneTreeCollections();
+  else
+    parseAssignedGeneFamilies();
   allParamsBackup_ = allParams_;
+  if (ApplicationTools::getIntParameter("exhaustive.topologies.max.leaves", params_, 0, "", true, false) > static_cast<int>(MAX_EXHAUSTIVE_LEAVES))
+  {
+    std::cerr <<"Error: exhaustive.topologies.max.leaves cannot be larger than "<< MAX_EXHAUSTIVE_LEAVES <<", as the number of topologies grows as (2n-5)!!."<<std::endl;
+    MPI::COMM_WORLD.Abort(1);
+    exit(-1);
+  }
+  roundTimeBudget_ = ApplicationTools::getDoubleParameter("round.time.budget", params_, 0.0, "", true, false);
+  searchRates_.assign(numberOfGeneFamilies_, -1.0);
   resetGeneTrees_ = ApplicationTools::getBooleanParameter("reset.gene.trees",params_,true );
+  alrtComputation_ = ApplicationTools::getStringParameter("compute.alrt", params_, "nni", "", true, false);
   currentStep_ = ApplicationTools::getIntParameter("current.step",params_,0);
+  initializeSearch();
+}
 
+
+/******************************************************************************/
+// Prepares the families for a species tree search, and receives
+// the starting species tree and parameters from the server.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::initializeSearch()  {
+  std::vector <std::string> t;
+  reconciledTrees_.clear();
+  duplicationTrees_.clear();
+  lossTrees_.clear();
   for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++)
   {
 
@@ -125,15 +153,17 @@ void ClientComputingGeneLikelihoods::parseOptions()  {
     //if we optimize the species tree topology.
     if (optimizeSpeciesTreeTopology_ && currentStep_ < 3)
     {
-      if (ApplicationTools::getBooleanParameter("optimization.topology", allParams_[i], false, "", true, false))
+      std::map<std::string, std::string> & familyParams = getFamilyParams(i);
+      if (ApplicationTools::getBooleanParameter("optimization.topology", familyParams, false, "", true, false))
       {
         allParams_[i][ std::string("optimization.topology")] = "false";
       }
       allParams_[i][ std::string("optimization")] = "None"; //Quite extreme, but the sequence likelihood has no impact on the reconciliation !
       treeLikelihoods_[i]->OptimizeSequenceLikelihood(false);
     }
-     treeLikelihoods_[i]->unload();
+    releaseFamily(i);
   }
+  releaseFamilyParams();
 
   //  bool firstTimeImprovingGeneTrees = false; //When for the first time we optimize gene trees, we set it at true
   if (optimizeSpeciesTreeTopology_ && currentStep_ < 3)
@@ -155,29 +185,92 @@ void ClientComputingGeneLikelihoods::parseOptions()  {
                                   currentStep_,
                                   reconciliationModel_
   );
-  if ( numberOfGeneFamilies_ > 0)
+  if ( numberOfGeneFamilies_ > 0 || !geneTreeCollections_.empty() )
   {
-    if (spTree_) delete spTree_;
-    spTree_=TreeTemplateTools::parenthesisToTree(currentSpeciesTree_, false, "", true);
-    spId_ = computeSpeciesNamesToIdsMap(*spTree_);
+    updateSpeciesTreeSnapshot();
   }
   startRecordingTreesFrom_ = 1;
   for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++)
   {
 
-    treeLikelihoods_[i]->setSpTree(*spTree_);
-    treeLikelihoods_[i]->setSpId(spId_);
+    treeLikelihoods_[i]->setSpeciesTreeSnapshot(spSnapshot_);
     if (reconciliationModel_ == "DL") {
       dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i])->setExpectedNumbers(duplicationExpectedNumbers_, lossExpectedNumbers_);
     }
     else if (reconciliationModel_ == "COAL") {
       dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->setCoalBranchLengths(coalBls_);
     }
-     treeLikelihoods_[i]->unload();
+    releaseFamily(i);
+  }
+}
+
+
+
+/******************************************************************************/
+// Builds the species tree snapshot shared by all families from currentSpeciesTree_,
+// and releases the previous one.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::updateSpeciesTreeSnapshot()
+{
+  TreeTemplate<Node> * tree = TreeTemplateTools::parenthesisToTree(currentSpeciesTree_, false, "", true);
+  unsigned int version = spSnapshot_ ? spSnapshot_->getVersion() + 1 : 0;
+  SpeciesTreeSnapshot * snapshot = SpeciesTreeSnapshot::acquire(new SpeciesTreeSnapshot(*tree, version));
+  delete tree;
+  SpeciesTreeSnapshot::release(spSnapshot_);
+  spSnapshot_ = snapshot;
+  spTree_ = &(spSnapshot_->getTree());
+  spId_ = spSnapshot_->getSpId();
+  if (dtlModel_)
+    dtlModel_->setSpeciesTree(*spTree_);
+}
+
+
+/******************************************************************************/
+// Returns the options of params whose values are absent from or different in defaults.
+/******************************************************************************/
+static std::map<std::string, std::string> getParamsDifferences(const std::map<std::string, std::string> & params,
+                                                               const std::map<std::string, std::string> & defaults)
+{
+  std::map<std::string, std::string> differences;
+  for (std::map<std::string, std::string>::const_iterator it = params.begin(); it != params.end(); ++it)
+  {
+    std::map<std::string, std::string>::const_iterator def = defaults.find(it->first);
+    if (def == defaults.end() || def->second != it->second)
+      differences.insert(*it);
+  }
+  return differences;
+}
+
+
+/******************************************************************************/
+// Gets all the options of family i, from the shared options
+// and the options specific to this family. Only one family is merged
+// at a time, in a scratch map that is rebuilt when another family,
+// or other options of the same family, are asked for.
+/******************************************************************************/
+std::map<std::string, std::string> & ClientComputingGeneLikelihoods::getFamilyParams(size_t i)
+{
+  if (familyParams_.empty() || familyParamsIndex_ != i || familyParamsSource_ != allParams_[i])
+  {
+    familyParams_ = defaultParams_;
+    for (std::map<std::string, std::string>::const_iterator it = allParams_[i].begin(); it != allParams_[i].end(); ++it)
+      familyParams_[it->first] = it->second;
+    familyParamsIndex_ = i;
+    familyParamsSource_ = allParams_[i];
   }
+  return familyParams_;
 }
 
 
+/******************************************************************************/
+// Frees the options merged by getFamilyParams, once a loop over families is over.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::releaseFamilyParams()
+{
+  std::map<std::string, std::string>().swap(familyParams_);
+  std::map<std::string, std::string>().swap(familyParamsSource_);
+}
+
 
 /******************************************************************************/
 // This function parses a vector of gene family files,
@@ -190,36 +283,82 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
   bool avoidFamily;
   std::string initTree;
   std::map<std::string, std::string> famSpecificParams;
+  std::map<std::string, std::string> familyParams;
+
+  //Families may be records of a manifest rather than option files.
+  FamilyManifest* manifest = 0;
+  if (assignedFilenames_.size() > 0 && FamilyManifest::isManifestEntry(assignedFilenames_[0]))
+  {
+    std::string listGeneFile = ApplicationTools::getStringParameter("genelist.file", params_, "none");
+    try {
+      manifest = new FamilyManifest(listGeneFile);
+    }
+    catch (exception& e)
+    {
+      std::cerr << "Error: could not read the gene family manifest "<< listGeneFile <<": "<< e.what() << std::endl;
+      fflush(0);
+      MPI::COMM_WORLD.Abort(1);
+      exit(-1);
+    }
+    AttributesTools::actualizeAttributesMap( params_, manifest->getDefaults() );
+  }
+  defaultParams_ = params_;
 
   std::vector< unsigned int > avoidedFamilyIds;
   //Here we are going to get all necessary information regarding all gene families the client is in charge of.
   for (unsigned int i = 0 ; i< assignedFilenames_.size() ; i++)
   { //For each file
     double startingFamilyTime = ApplicationTools::getTime();
+    double startingFamilyHeap = Profiler::getHeapBytes();
+    famSpecificParams.clear();
+    if (manifest)
+    {
+      try {
+        assignedFilenames_[i] = manifest->readRecord(assignedFilenames_[i], famSpecificParams);
+      }
+      catch (exception& e)
+      {
+        std::cerr << "Error: "<< e.what() << std::endl;
+        fflush(0);
+        MPI::COMM_WORLD.Abort(1);
+        exit(-1);
+      }
+    }
     std::cout <<"Examining family "<<assignedFilenames_[i]<<std::endl;
     avoidFamily = false;
     std::string familySpecificOptionsFile = assignedFilenames_[i];
-    if(!FileTools::fileExists(familySpecificOptionsFile))
+    if (manifest)
     {
-      std::cerr << "Error: Parameter file "<< familySpecificOptionsFile <<" not found." << std::endl;
-      fflush(0);
-      MPI::COMM_WORLD.Abort(1);
-      exit(-1);
+      //Each family starts from the shared options, so that options do not leak from one family to the next.
+      familyParams = defaultParams_;
+      AttributesTools::actualizeAttributesMap( familyParams, famSpecificParams);
+      AttributesTools::resolveVariables(familyParams);
     }
     else
     {
-      famSpecificParams = AttributesTools::getAttributesMapFromFile(familySpecificOptionsFile, "=");
-      AttributesTools::resolveVariables(famSpecificParams);
-    }
+      if(!FileTools::fileExists(familySpecificOptionsFile))
+      {
+        std::cerr << "Error: Parameter file "<< familySpecificOptionsFile <<" not found." << std::endl;
+        fflush(0);
+        MPI::COMM_WORLD.Abort(1);
+        exit(-1);
+      }
+      else
+      {
+        famSpecificParams = AttributesTools::getAttributesMapFromFile(familySpecificOptionsFile, "=");
+        AttributesTools::resolveVariables(famSpecificParams);
+      }
 
-    AttributesTools::actualizeAttributesMap( params_, famSpecificParams);
+      AttributesTools::actualizeAttributesMap( params_, famSpecificParams);
+      familyParams = params_;
+    }
     //COAL or DL?
-    reconciliationModel_ = ApplicationTools::getStringParameter("reconciliation.model", params_, "DL", "", true, false);
+    reconciliationModel_ = ApplicationTools::getStringParameter("reconciliation.model", familyParams, "DL", "", true, false);
     GeneTreeLikelihood *tl = 0;
     if (reconciliationModel_ == "DL")
     {
       try {
-        tl = new DLGeneTreeLikelihood(familySpecificOptionsFile, params_, *spTree_);
+        tl = new DLGeneTreeLikelihood(familySpecificOptionsFile, familyParams, *spTree_);
       }
       catch (exception& e)
       {
@@ -232,7 +371,7 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
     else if (reconciliationModel_ == "COAL")
     {
       try {
-        tl = new COALGeneTreeLikelihood( familySpecificOptionsFile, params_, *spTree_ );
+        tl = new COALGeneTreeLikelihood( familySpecificOptionsFile, familyParams, *spTree_ );
       }
       catch (exception& e)
       {
@@ -241,6 +380,12 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
         numDeletedFamilies_ = numDeletedFamilies_ +1;
       }
     }
+    else if (reconciliationModel_ == "DTL")
+    {
+      std::cerr <<"Error: reconciliation.model=DTL is only available with reconciliation.only=yes."<<std::endl;
+      MPI::COMM_WORLD.Abort(1);
+      exit(-1);
+    }
     else {
       std::cerr <<"Unknown reconciliation model: "<< reconciliationModel_ <<std::endl;
       exit(-1);
@@ -249,12 +394,14 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
 
     double familyTime = ApplicationTools::getTime() - startingFamilyTime ;
     std::cout <<"Examined family "<<assignedFilenames_[i] << " in "<<familyTime<<" s."<<std::endl;
+    if (!avoidFamily)
+      Profiler::addFamilyTime(assignedFilenames_[i], familyTime);
 
     if (!avoidFamily) {
       // We need to fill these vectors so that we can quickly re-create *GeneTreeLikelihood objects
       // in the course of the algorithm.
       treeLikelihoods_.push_back(tl);
-      allParams_.push_back( params_ );
+      allParams_.push_back( getParamsDifferences(familyParams, defaultParams_) );
       allDatasets_.push_back(tl->getSequenceLikelihoodObject()->getSites()->clone());
       allModels_.push_back(tl->getSequenceLikelihoodObject()->getSubstitutionModel ());
       allDistributions_.push_back(tl->getSequenceLikelihoodObject()->getRateDistribution ());
@@ -262,6 +409,9 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
       allUnrootedGeneTrees_.push_back(new TreeTemplate<Node>(*(tl->getSequenceLikelihoodObject()->getTree())) );
       allSeqSps_.push_back( tl->getSeqSp() );
       allSprLimitGeneTree_.push_back(tl->getSprLimitGeneTree() );
+      //The family is still loaded: its loaded memory is subtracted once measured
+      residentMemory_.push_back(std::max(0.0, Profiler::getHeapBytes() - startingFamilyHeap));
+      loadedMemory_.push_back(0.0);
 
       /****************************************************************************
        *          //Then we initialize the losses and duplication numbers on this tree for this family.
@@ -296,7 +446,11 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
 
 
   }//End for each file
-
+  if (manifest)
+  {
+    delete manifest;
+    manifest = 0;
+  }
 
   if (numDeletedFamilies_ == assignedFilenames_.size())
   {
@@ -318,29 +472,29 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
                                                   params_, "user",
                                                   "", false, false);
   if (initTree == "mrp") {
-    //Build a string containing all trees with one gene per species
-    string trees1PerSpecies = "";
-    vector<string> allTrees1PerSpecies;
-    stringstream ss (stringstream::in | stringstream::out);
+    //Build the split-frequency table of all trees with one gene per species
+    std::map<std::string, size_t> leafIndices = computeLeafIndices(*spTree_);
+    SplitFrequencies frequencies;
     for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++)
     {
       if (reconciliationModel_ == "DL")
       {
         if ( ( dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i]) )->isSingleCopy() ) {
-          ss << TreeTemplateTools::treeToParenthesis((dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i]) )->getGeneTreeWithSpNames(), false);
+          addSplitFrequencies((dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i]) )->getGeneTreeWithSpNames(), leafIndices, frequencies);
         }
       }
       else {
         if ((dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i]) )->isSingleCopy() ) {
-          ss << TreeTemplateTools::treeToParenthesis((dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i]) )->getGeneTreeWithSpNames(), false);
+          addSplitFrequencies((dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i]) )->getGeneTreeWithSpNames(), leafIndices, frequencies);
         }
 
       }
     }
-    trees1PerSpecies = ss.str() ;
+    std::vector<unsigned long> splitFrequencies = encodeSplitFrequencies(frequencies);
+    std::vector< std::vector<unsigned long> > allSplitFrequencies;
     mrpCommunicationsServerClient (world_, server_,
-                                   rank_, trees1PerSpecies,
-                                   allTrees1PerSpecies);
+                                   rank_, splitFrequencies,
+                                   allSplitFrequencies);
 
   }
   vector<unsigned int> numbersOfGeneFamilies;
@@ -351,19 +505,13 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
                                     lossExpectedNumbers_, duplicationExpectedNumbers_, coalBls_,
                                     currentSpeciesTree_);
 
-  delete spTree_;
-
-  spTree_=TreeTemplateTools::parenthesisToTree(currentSpeciesTree_, false, "", true);
-
-  spId_ = computeSpeciesNamesToIdsMap(*spTree_);
+  updateSpeciesTreeSnapshot();
 
   //std::cout << "THET "<< assignedFilenames_.size() << " and "<< numDeletedFamilies_ << " anana " << reconciliationModel_ <<std::endl;
 
   for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++)
   {
-    treeLikelihoods_[i]->setSpTree(*spTree_);
-
-    treeLikelihoods_[i]->setSpId(spId_);
+    treeLikelihoods_[i]->setSpeciesTreeSnapshot(spSnapshot_);
     //GeneTreeLikelihood* tl ;
     if (reconciliationModel_ == "DL")
     {
@@ -400,7 +548,7 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
         MPI::COMM_WORLD.Abort(1);
         exit(-1);
       }
-      tl->unload();
+      releaseFamily(i);
     }
     else if (reconciliationModel_ == "COAL") {
       COALGeneTreeLikelihood* tl = dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i] );
@@ -436,15 +584,123 @@ void ClientComputingGeneLikelihoods::parseAssignedGeneFamilies()
         MPI::COMM_WORLD.Abort(1);
         exit(-1);
       }
-      tl->unload();
+      releaseFamily(i);
     }
-
+    residentMemory_[i] = std::max(0.0, residentMemory_[i] - loadedMemory_[i]);
   }
+  planFamilyMemory();
 
   return;
 }
 
 
+/******************************************************************************/
+// With reconciliation.only=yes, each file of the gene list contains fixed gene trees.
+// This function reads them, and sends their numbers to the server.
+// No alignment is read, and no gene tree is rearranged.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::parseAssignedGeneTreeCollections()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  reconciliationModel_ = ApplicationTools::getStringParameter("reconciliation.model", params_, "DL", "", true, false);
+  if (reconciliationModel_ != "DL" && reconciliationModel_ != "COAL" && reconciliationModel_ != "DTL")
+  {
+    std::cerr <<"Unknown reconciliation model: "<< reconciliationModel_ <<std::endl;
+    MPI::COMM_WORLD.Abort(1);
+    exit(-1);
+  }
+  if (reconciliationModel_ == "DTL")
+  {
+    //Rates are relative to the speciation rate, and are not optimized.
+    double duplicationRate = ApplicationTools::getDoubleParameter("dtl.duplication.rate", params_, 0.01, "", true, false);
+    double transferRate = ApplicationTools::getDoubleParameter("dtl.transfer.rate", params_, 0.01, "", true, false);
+    double lossRate = ApplicationTools::getDoubleParameter("dtl.loss.rate", params_, 0.01, "", true, false);
+    dtlModel_ = new DTLReconciliationModel(duplicationRate, transferRate, lossRate);
+  }
+  if (ApplicationTools::getStringParameter("init.species.tree", params_, "user", "", false, false) == "mrp")
+  {
+    std::cerr << "Error: init.species.tree=mrp cannot be used with reconciliation.only=yes." << std::endl;
+    MPI::COMM_WORLD.Abort(1);
+    exit(-1);
+  }
+  //Without taxaseq.file, leaves are named after species.
+  std::map <std::string, std::string> seqSp;
+  if (ApplicationTools::getStringParameter("taxaseq.file", params_, "none", "", true, false) != "none")
+  {
+    bool cont = true;
+    std::map <std::string, std::deque<std::string> > spSeq;
+    getCorrespondanceSequenceSpeciesFromOptions(params_, cont, seqSp, spSeq);
+    if (!cont)
+    {
+      MPI::COMM_WORLD.Abort(1);
+      exit(-1);
+    }
+  }
+  unsigned int numberOfTrees = 0;
+  for (unsigned int i = 0 ; i< assignedFilenames_.size() ; i++)
+  {
+    double startingFamilyTime = ApplicationTools::getTime();
+    if(!FileTools::fileExists(assignedFilenames_[i]))
+    {
+      std::cerr << "Error: Gene tree file "<< assignedFilenames_[i] <<" not found." << std::endl;
+      fflush(0);
+      MPI::COMM_WORLD.Abort(1);
+      exit(-1);
+    }
+    GeneTreeCollection * collection = new GeneTreeCollection(assignedFilenames_[i], seqSp, *spTree_);
+    numberOfTrees += collection->getNumberOfTrees();
+    std::cout <<"Read "<< collection->getNumberOfTrees() <<" gene trees from "<< assignedFilenames_[i]
+              <<" ("<< collection->getNumberOfDiscardedTrees() <<" discarded) in "
+              << ApplicationTools::getTime() - startingFamilyTime <<" s."<<std::endl;
+    Profiler::addFamilyTime(assignedFilenames_[i], ApplicationTools::getTime() - startingFamilyTime);
+    geneTreeCollections_.push_back(collection);
+  }
+  if (numberOfTrees == 0)
+  {
+    std::cout<<"WARNING: A client with rank "<< rank_ << " is in charge of 0 gene tree after gene tree filtering!"<<std::endl;
+  }
+  //The server counts gene trees as gene families.
+  numberOfFilteredFamiliesCommunicationsServerClient (world_, server_,
+                                                      rank_, numberOfTrees);
+  vector<unsigned int> numbersOfGeneFamilies;
+  secondCommunicationsServerClient (world_ , server_,
+                                    rank_, numberOfTrees,
+                                    numbersOfGeneFamilies,
+                                    lossExpectedNumbers_, duplicationExpectedNumbers_, coalBls_,
+                                    currentSpeciesTree_);
+  updateSpeciesTreeSnapshot();
+  return;
+}
+
+
+/******************************************************************************/
+// This function computes the likelihood of all gene tree collections given spSnapshot_.
+// Their numbers of lineages are added to num*Lineages_.
+/******************************************************************************/
+double ClientComputingGeneLikelihoods::computeLogLkOfGeneTreeCollections()
+{
+  double logL = 0.0;
+  for (unsigned int i = 0 ; i< geneTreeCollections_.size() ; i++)
+  {
+    double familyStartingTime = Profiler::getWallTime();
+    if (reconciliationModel_ == "DL") {
+      logL += geneTreeCollections_[i]->computeDLLogLikelihood(*spTree_, spId_,
+                                                             lossExpectedNumbers_, duplicationExpectedNumbers_,
+                                                             num0Lineages_, num1Lineages_, num2Lineages_);
+    }
+    else if (reconciliationModel_ == "COAL") {
+      logL += geneTreeCollections_[i]->computeCOALLogLikelihood(*spTree_, spId_, coalBls_,
+                                                               num12Lineages_, num22Lineages_);
+    }
+    else if (reconciliationModel_ == "DTL") {
+      logL += geneTreeCollections_[i]->computeDTLLogLikelihood(*dtlModel_, spId_);
+    }
+    Profiler::addFamilyTime(geneTreeCollections_[i]->getFile(), Profiler::getWallTime() - familyStartingTime);
+  }
+  return logL;
+}
+
+
 /****************************************************************************
  * ***************************************************************************
  * Main loop: iterative likelihood computations
@@ -457,6 +713,7 @@ void ClientComputingGeneLikelihoods::MLSearch() {
   string rearrangementType;
   bool timing = true;
   double startingTime, totalTime;
+  unsigned int bestIndex = 0;
   while (!stop_)
   {
     logL_=0.0;
@@ -465,8 +722,12 @@ void ClientComputingGeneLikelihoods::MLSearch() {
     resetVector(num2Lineages_);
     resetVector(num12Lineages_);
     resetVector(num22Lineages_);
+    double roundStartingTime = ApplicationTools::getTime();
+    unsigned int scheduledFamilies = 0;
+    unsigned int convergedFamilies = 0;
     for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++)
     {
+      double familyStartingTime = Profiler::getWallTime();
 
       if (rearrange_) //(firstTimeImprovingGeneTrees)
       {
@@ -478,9 +739,38 @@ void ClientComputingGeneLikelihoods::MLSearch() {
         allParams_[i][ std::string("optimization.topology")] = "false";
       }
       // std::cout <<  TreeTemplateTools::treeToParenthesis(*geneTree_, true)<<std::endl;
-
-      rearrangementType = ApplicationTools::getStringParameter("rearrangement.gene.tree", allParams_[i], "spr", "", true, false);
-      if (rearrangementType == "nni" || currentStep_ !=4 ) {
+      std::map<std::string, std::string> & familyParams = getFamilyParams(i);
+
+      rearrangementType = ApplicationTools::getStringParameter("rearrangement.gene.tree", familyParams, "spr", "", true, false);
+      //Family-specific values are capped as the global one.
+      int exhaustiveMaxLeaves = std::min(ApplicationTools::getIntParameter("exhaustive.topologies.max.leaves", familyParams, 0, "", true, false), static_cast<int>(MAX_EXHAUSTIVE_LEAVES));
+      bool exhaustive = (reconciliationModel_ == "DL" && static_cast<int>(treeLikelihoods_[i]->getRootedTree().getNumberOfLeaves()) <= exhaustiveMaxLeaves);
+      //Within a round time budget, the NNI and SPR searches of family i stop at its share of the remaining time
+      bool scheduled = (roundTimeBudget_ > 0.0 && rearrange_ && reconciliationModel_ == "DL" && !exhaustive);
+      double searchStartingTime = ApplicationTools::getTime();
+      double searchDeadline = 0.0;
+      if (scheduled) {
+        double allotted = allotSearchTime(i, roundTimeBudget_ - (searchStartingTime - roundStartingTime));
+        searchDeadline = searchStartingTime + allotted;
+        treeLikelihoods_[i]->setRoundDeadline(searchDeadline);
+        treeLikelihoods_[i]->resetSearchGain();
+        scheduledFamilies++;
+        if (searchRates_[i] == 0.0)
+          convergedFamilies++;
+        DEBUG_LOG("Family " << assignedFilenames_[i] << ": " << allotted << " s of search allotted.");
+      }
+      if (exhaustive) {
+        //Small family: all topologies are reconciled instead of searching.
+        if (timing)
+          startingTime = ApplicationTools::getTime();
+        dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeExhaustively(familyParams);
+        if (timing && rearrange_)
+        {
+          totalTime = ApplicationTools::getTime() - startingTime;
+          std::cout << "Family "<< assignedFilenames_[i] <<"; Time for exhaustive exploration: "<<  totalTime << " s." <<std::endl;
+        }
+      }
+      else if (rearrangementType == "nni" || currentStep_ !=4 ) {
         //PhylogeneticsApplicationTools::optimizeParameters(treeLikelihoods_[i], treeLikelihoods_[i]->getParameters(), allParams_[i], "", true, false);
         NNIRearrange(timing, i, startingTime, totalTime);
       }
@@ -489,9 +779,9 @@ void ClientComputingGeneLikelihoods::MLSearch() {
           startingTime = ApplicationTools::getTime();
         //SPR optimization:
         //std::cout <<"Before optimization: "<<TreeTemplateTools::treeToParenthesis(treeLikelihoods_[i]->getRootedTree(), true)<<std::endl;
-        std::string SPRalgorithm = ApplicationTools::getStringParameter("spr.gene.tree.algorithm", allParams_[i], "normal", "", true, false);
-        std::cout << "rearrangementType "<< rearrangementType << std::endl;
-        std::cout << "SPRalgorithm "<< SPRalgorithm << std::endl;
+        std::string SPRalgorithm = ApplicationTools::getStringParameter("spr.gene.tree.algorithm", familyParams, "normal", "", true, false);
+        DEBUG_LOG("rearrangementType "<< rearrangementType);
+        DEBUG_LOG("SPRalgorithm "<< SPRalgorithm);
 
         if (reconciliationModel_ == "DL") {
           WHEREAMI( __FILE__ , __LINE__ );
@@ -516,7 +806,7 @@ void ClientComputingGeneLikelihoods::MLSearch() {
             }
             WHEREAMI( __FILE__ , __LINE__ );
 
-            dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeSPRsFast2(allParams_[i]);
+            dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeSPRsFast2(familyParams);
 
           }
           WHEREAMI( __FILE__ , __LINE__ );
@@ -529,7 +819,7 @@ void ClientComputingGeneLikelihoods::MLSearch() {
             NNIRearrange(timing, i, startingTime, totalTime);
           }
           else {
-            dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeSPRsFast(allParams_[i]);
+            dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeSPRsFast(familyParams);
           }
         }
         //   treeLikelihoods_[i]->refineGeneTreeSPRs(allParams_[i]);
@@ -540,6 +830,10 @@ void ClientComputingGeneLikelihoods::MLSearch() {
           std::cout << "Family "<< assignedFilenames_[i] <<"; Time for SPR exploration: "<<  totalTime << " s." <<std::endl;
         }
       }
+      if (scheduled) {
+        treeLikelihoods_[i]->setRoundDeadline(0);
+        recordSearchRate(i, ApplicationTools::getTime() - searchStartingTime, searchDeadline);
+      }
       if (geneTree_) {
         delete geneTree_;
         geneTree_ = 0;
@@ -567,7 +861,7 @@ void ClientComputingGeneLikelihoods::MLSearch() {
         allLogLs_[i] = dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->getValue();
       }
       logL_ = logL_ + allLogLs_[i];
-      std::cout<<"Gene Family: " << assignedFilenames_[i] << " total logLk: "<< - allLogLs_[i]<< " ; scenario loglk: "<< treeLikelihoods_[i]->getScenarioLikelihood() <<std::endl;
+      INFO_LOG("Gene Family: " << assignedFilenames_[i] << " total logLk: "<< - allLogLs_[i]<< " ; scenario loglk: "<< treeLikelihoods_[i]->getScenarioLikelihood());
 
       if (std::isnan(allLogLs_[i]))
       {
@@ -589,7 +883,18 @@ void ClientComputingGeneLikelihoods::MLSearch() {
         delete geneTree_;
         geneTree_ = 0;
       }
+      Profiler::addFamilyTime(assignedFilenames_[i], Profiler::getWallTime() - familyStartingTime);
+      //Within a memory budget, families are unloaded as soon as they are done
+      if (memoryBudget_ > 0.0)
+        releaseFamily(i);
     }//end for each filename
+    releaseFamilyParams();
+    if (scheduledFamilies > 0)
+      INFO_LOG("Client " << rank_ << ": round searched in " << ApplicationTools::getTime() - roundStartingTime << " s of a " << roundTimeBudget_ << " s budget; " << convergedFamilies << " of " << scheduledFamilies << " families had converged.");
+    if (!geneTreeCollections_.empty())
+    {
+      logL_ = logL_ + computeLogLkOfGeneTreeCollections();
+    }
     if (!recordGeneTrees_)
     {
       startRecordingTreesFrom_++;
@@ -617,7 +922,10 @@ void ClientComputingGeneLikelihoods::MLSearch() {
     }
 
     //Should the computations stop? The server tells us.
-    broadcast(world_, stop_, server_);
+    {
+      ScopedTimer timer(PROFILE_MPI_BROADCAST);
+      broadcast(world_, stop_, server_);
+    }
     if (!stop_)
     { // we continue the loop
       //We get the new values from the server
@@ -639,11 +947,9 @@ void ClientComputingGeneLikelihoods::MLSearch() {
         startingTime = ApplicationTools::getTime();
       }
 
-      if ( numberOfGeneFamilies_ > 0)
+      if ( numberOfGeneFamilies_ > 0 || !geneTreeCollections_.empty() )
       {
-        if (spTree_) delete spTree_;
-        spTree_=TreeTemplateTools::parenthesisToTree(currentSpeciesTree_, false, "", true);
-        spId_ = computeSpeciesNamesToIdsMap(*spTree_);
+        updateSpeciesTreeSnapshot();
       }
       //if we reset the gene trees by resetting treeLikelihoods_:
       //we always start from ML trees according to sequences only
@@ -652,102 +958,7 @@ void ClientComputingGeneLikelihoods::MLSearch() {
       //lk and the second one; in this case we set rearrange to false.
       //Then there is no need to reset the gene tree!
       if (resetGeneTrees_ && currentStep_ !=4 && rearrange_ == true) {
-        if (reconciliationModel_ == "DL")
-        {
-          for (unsigned int i=0 ; i<allDatasets_.size() ; i++)
-          {
-
-            string methodString =  treeLikelihoods_[i]->getLikelihoodMethod () ;
-            if (methodString == "PLL") {
-              treeLikelihoods_[i]->setGeneTree( allUnrootedGeneTrees_[i], allGeneTrees_[i] );
-            }
-            else {
-              /*  for (unsigned int i=0 ; i<allDatasets_.size() ; i++)
-               *                 {*/
-              std::map <std::string, std::string > params = treeLikelihoods_[i]->getParams();
-              if    (treeLikelihoods_[i])
-                delete treeLikelihoods_[i];
-              TreeTemplate<Node> * treeWithSpNames = allUnrootedGeneTrees_[i]->clone();
-              std::vector <Node*> leaves = treeWithSpNames->getLeaves();
-              for (unsigned int j =0; j<leaves.size() ; j++)
-              {
-                leaves[j]->setName(allSeqSps_[i][leaves[j]->getName()]);
-              }
-              treeLikelihoods_[i] =  new DLGeneTreeLikelihood(*(allUnrootedGeneTrees_[i]),                              *(allDatasets_[i]),
-                                                              allModels_[i], allDistributions_[i], *spTree_,
-                                                              *allGeneTrees_[i], *treeWithSpNames, allSeqSps_[i], spId_,
-                                                              lossExpectedNumbers_,
-                                                              duplicationExpectedNumbers_,
-                                                              allNum0Lineages_[i],
-                                                              allNum1Lineages_[i],
-                                                              allNum2Lineages_[i],
-                                                              speciesIdLimitForRootPosition_,
-                                                              MLindex_, params,
-                                                              true, true, true, true, false, allSprLimitGeneTree_[i]) ;
-                                                              /*                          treeLikelihoods_.push_back( new DLGeneTreeLikelihood(*(allUnrootedGeneTrees_[i]), *(allDatasets_[i]),
-                                                               *                                                       allModels_[i], allDistributions_[i], *spTree_,
-                                                               *allGeneTrees_[i], *treeWithSpNames, allSeqSps_[i], spId_,
-                                                               *                                                       lossExpectedNumbers_,
-                                                               *                                                       duplicationExpectedNumbers_,
-                                                               *                                                       allNum0Lineages_[i],
-                                                               *                                                       allNum1Lineages_[i],
-                                                               *                                                       allNum2Lineages_[i],
-                                                               *                                                       speciesIdLimitForRootPosition_,
-                                                               *                                                        MLindex_, params,
-                                                               *                                                       true, true, true, true, false, allSprLimitGeneTree_[i]) );*/
-
-
-
-                                                              delete treeWithSpNames;
-            }
-            treeLikelihoods_[i]->unload();
-          }
-        }
-        else if (reconciliationModel_ == "COAL")
-        {
-          for (unsigned int i =0 ; i<treeLikelihoods_.size() ; i++) {
-
-            std::map <std::string, std::string > params = treeLikelihoods_[i]->getParams();
-            if    (treeLikelihoods_[i])
-              delete treeLikelihoods_[i];
-            //}
-            //  treeLikelihoods_.clear();
-            /*   for (unsigned int i=0 ; i<allDatasets_.size() ; i++)
-             *               {*/
-            //coalCounts: vector of genetreenbnodes vectors of 3 (3 directions) vectors of sptreenbnodes vectors of 2 ints
-            std::vector< std::vector< std::vector< unsigned int > > > coalCounts2;
-            std::vector< std::vector<unsigned int> > coalCounts3;
-            std::vector< unsigned int > coalCounts4;
-            for (unsigned int j = 0 ; j < 2 ; j++ ) {
-              coalCounts4.push_back(0);
-            }
-            for (unsigned int j = 0 ; j < spTree_->getNumberOfNodes() ; j++ ) {
-              coalCounts3.push_back(coalCounts4);
-            }
-            for (unsigned int j = 0 ; j < 3 ; j++ ) {
-              coalCounts2.push_back(coalCounts3);
-            }
-            for (unsigned int j = 0 ; j < geneTree_->getNumberOfNodes() ; j++ ) {
-              coalCounts_.push_back(coalCounts2);
-            }
-            TreeTemplate<Node> * treeWithSpNames = allUnrootedGeneTrees_[i]->clone();
-            std::vector <Node*> leaves = treeWithSpNames->getLeaves();
-            for (unsigned int j =0; j<leaves.size() ; j++)
-            {
-              leaves[j]->setName(allSeqSps_[i][leaves[j]->getName()]);
-            }
-
-            treeLikelihoods_.push_back( new COALGeneTreeLikelihood(*allUnrootedGeneTrees_[i], *allDatasets_[i],
-                                                                   allModels_[i], allDistributions_[i], *spTree_,
-                                                                   *allGeneTrees_[i], *treeWithSpNames, allSeqSps_[i], spId_,
-                                                                   coalCounts_, coalBls_,
-                                                                   speciesIdLimitForRootPosition_,
-                                                                   MLindex_, params,
-                                                                   true, true, true, true, allSprLimitGeneTree_[i]) );
-            delete treeWithSpNames;
-            treeLikelihoods_[i]->unload();
-          }
-        }
+        resetGeneTreeLikelihoods();
       }
       if (currentStep_>=3)// rearrange_) //?
       {
@@ -760,8 +971,7 @@ void ClientComputingGeneLikelihoods::MLSearch() {
       for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++)
       {
 
-        treeLikelihoods_[i]->setSpTree(*spTree_);
-        treeLikelihoods_[i]->setSpId(spId_);
+        treeLikelihoods_[i]->setSpeciesTreeSnapshot(spSnapshot_);
         if (reconciliationModel_ == "DL") {
           dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i])->setExpectedNumbers(duplicationExpectedNumbers_, lossExpectedNumbers_);
           //If not using the backuplks
@@ -780,8 +990,9 @@ void ClientComputingGeneLikelihoods::MLSearch() {
           //                 dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->optimizeNumericalParameters(params_); //Initial optimization of all numerical parameters
           dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->initParameters();
         }
-        treeLikelihoods_[i]->unload();
+        releaseFamily(i);
       }
+      planFamilyMemory();
       if (timing && resetGeneTrees_)
       {
         totalTime = ApplicationTools::getTime() - startingTime;
@@ -793,17 +1004,211 @@ void ClientComputingGeneLikelihoods::MLSearch() {
       /****************************************************************************
        * The end, outputting the results.
        *****************************************************************************/
-      if (recordGeneTrees_)
-      {
-        unsigned int bestIndex;
-        broadcast(world_, bestIndex, server_);
-        // std::cout << "bestIndex: "<<bestIndex<<" startRecordingTreesFrom: "<<startRecordingTreesFrom_<<std::endl;
-        outputGeneTrees( bestIndex );
-      }
+      //The server always sends bestIndex, even if we have not recorded gene trees yet.
+      broadcast(world_, bestIndex, server_);
       break;
     }
   }//End while, END OF MAIN LOOP
   delete nhx;
+  //The server tells us whether the results of this search are kept,
+  //i.e. whether it is the best of the searches done so far.
+  bool keepResults;
+  broadcast(world_, keepResults, server_);
+  if (keepResults)
+  {
+    if (recordGeneTrees_)
+    {
+      // std::cout << "bestIndex: "<<bestIndex<<" startRecordingTreesFrom: "<<startRecordingTreesFrom_<<std::endl;
+      outputGeneTrees( bestIndex );
+    }
+    if (alrtComputation_ == "batch")
+    {
+      computeALRTsInBatches();
+    }
+  }
+}
+
+
+/******************************************************************************/
+// When several species tree searches are run (multistart.number), the families
+// loaded for the first search are reused by the next ones.
+// Returns false once the server has no more search to run.
+/******************************************************************************/
+bool ClientComputingGeneLikelihoods::startNextSearch()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  bool anotherSearch;
+  broadcast(world_, anotherSearch, server_);
+  if (!anotherSearch)
+    return false;
+  stop_ = false;
+  currentStep_ = 0;
+  allParams_ = allParamsBackup_;
+  if (resetGeneTrees_)
+  {
+    resetGeneTreeLikelihoods();
+  }
+  //Families converged in the previous search start again from new trees
+  searchRates_.assign(numberOfGeneFamilies_, -1.0);
+  initializeSearch();
+  return true;
+}
+
+
+/******************************************************************************/
+// Sends the measured cost of each family (setup and all rounds of all
+// searches, in seconds) to the server, which balances the next runs with it.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::sendFamilyCosts()
+{
+  std::map<std::string, size_t> familyIndices;
+  for (size_t i = 0 ; i < numberOfGeneFamilies_ ; i++)
+    familyIndices[assignedFilenames_[i]] = i;
+  std::vector<std::string> families;
+  std::vector<double> costs;
+  const std::map<std::string, double> & familyTimes = Profiler::getFamilyTimes();
+  for (std::map<std::string, double>::const_iterator it = familyTimes.begin(); it != familyTimes.end(); ++it)
+  {
+    families.push_back(it->first);
+    costs.push_back(it->second);
+    double resident = 0.0;
+    double loaded = 0.0;
+    std::map<std::string, size_t>::const_iterator index = familyIndices.find(it->first);
+    if (index != familyIndices.end())
+    {
+      estimateFamilyMemory(index->second, resident, loaded);
+      if (residentMemory_[index->second] > 0.0)
+        resident = residentMemory_[index->second];
+      if (loadedMemory_[index->second] > 0.0)
+        loaded = loadedMemory_[index->second];
+    }
+    costs.push_back(resident);
+    costs.push_back(loaded);
+  }
+  std::vector< std::vector<std::string> > allFamilies;
+  std::vector< std::vector<double> > allCosts;
+  gathersFamilyCostsFromClients(world_, server_, rank_, families, costs, allFamilies, allCosts);
+}
+
+
+/******************************************************************************/
+// Memory of the families. Estimates count the alignments, the copies of the
+// gene tree, the reconciliation tables and, when the family is loaded, the
+// conditional likelihood vectors; measures come from the heap of the process.
+/******************************************************************************/
+//Approximate size of a Bio++ node with its properties, in bytes
+static const double NODE_BYTES = 256.0;
+
+void ClientComputingGeneLikelihoods::estimateFamilyMemory(size_t i, double & resident, double & loaded) const
+{
+  double sequences = allDatasets_[i]->getNumberOfSequences();
+  double sites = allDatasets_[i]->getNumberOfSites();
+  double states = allDatasets_[i]->getAlphabet()->getSize();
+  double categories = allDistributions_[i]->getNumberOfCategories();
+  double geneNodes = 2.0 * sequences - 1.0;
+  double speciesNodes = spTree_->getNumberOfNodes();
+  //Two alignments (ours and the one of the likelihood object), four gene trees,
+  //reconciliation tables for the three directions of each gene node, lineage counts
+  resident = 2.0 * sequences * sites * sizeof(int)
+           + 4.0 * geneNodes * NODE_BYTES
+           + 3.0 * geneNodes * (sizeof(double) + 2.0 * sizeof(int))
+           + 5.0 * speciesNodes * sizeof(int);
+  //PLL keeps one vector per inner node, Bio++ one per branch and direction
+  double vectors = (treeLikelihoods_[i]->getLikelihoodMethod() == "PLL") ? sequences - 2.0 : 3.0 * (2.0 * sequences - 3.0);
+  loaded = std::max(vectors, 1.0) * sites * states * categories * sizeof(double)
+         + sequences * sites * sizeof(double);
+}
+
+
+void ClientComputingGeneLikelihoods::planFamilyMemory()
+{
+  keepLoaded_.assign(numberOfGeneFamilies_, false);
+  double resident = 0.0;
+  double maxLoaded = 0.0;
+  std::vector< std::pair<double, size_t> > loadedSizes;
+  for (size_t i = 0 ; i < numberOfGeneFamilies_ ; i++)
+  {
+    double estimatedResident, estimatedLoaded;
+    estimateFamilyMemory(i, estimatedResident, estimatedLoaded);
+    Profiler::setFamilyMemory(assignedFilenames_[i],
+                              std::pair<double, double> (estimatedResident, residentMemory_[i]),
+                              std::pair<double, double> (estimatedLoaded, loadedMemory_[i]));
+    //Measures are preferred, if the allocator could be queried
+    double loaded = (loadedMemory_[i] > 0.0) ? loadedMemory_[i] : estimatedLoaded;
+    resident += (residentMemory_[i] > 0.0) ? residentMemory_[i] : estimatedResident;
+    maxLoaded = std::max(maxLoaded, loaded);
+    loadedSizes.push_back(std::pair<double, size_t> (loaded, i));
+  }
+  if (memoryBudget_ <= 0.0)
+    return;
+  //The largest family must fit to be computed; the smallest ones then stay loaded.
+  double used = resident + maxLoaded;
+  if (used > memoryBudget_)
+    WARNING_LOG("Client " << rank_ << " needs about " << used / (1024.0 * 1024.0) << " MB, more than client.memory.budget.");
+  sort(loadedSizes.begin(), loadedSizes.end());
+  size_t kept = 0;
+  for ( ; kept < loadedSizes.size() && used + loadedSizes[kept].first <= memoryBudget_ ; kept++)
+  {
+    keepLoaded_[loadedSizes[kept].second] = true;
+    used += loadedSizes[kept].first;
+  }
+  DEBUG_LOG("Client " << rank_ << ": " << kept << " of " << numberOfGeneFamilies_ << " families stay loaded, about " << used / (1024.0 * 1024.0) << " MB.");
+}
+
+
+double ClientComputingGeneLikelihoods::allotSearchTime(size_t i, double remainingTime) const
+{
+  if (remainingTime <= 0.0)
+    return 0.0;
+  //Families not searched yet are expected to improve like the average family
+  double knownRates = 0.0;
+  unsigned int known = 0;
+  for (size_t j = 0 ; j < searchRates_.size() ; j++)
+  {
+    if (searchRates_[j] > 0.0)
+    {
+      knownRates += searchRates_[j];
+      known++;
+    }
+  }
+  double defaultRate = (known > 0) ? knownRates / known : 1.0;
+  //Family i gets its share of the time left to it and to the families after it
+  double weights = 0.0;
+  for (size_t j = i ; j < numberOfGeneFamilies_ ; j++)
+    weights += (searchRates_[j] < 0.0) ? defaultRate : searchRates_[j];
+  if (weights <= 0.0)
+    return 0.0;
+  double weight = (searchRates_[i] < 0.0) ? defaultRate : searchRates_[i];
+  return remainingTime * weight / weights;
+}
+
+
+void ClientComputingGeneLikelihoods::recordSearchRate(size_t i, double searchTime, double deadline)
+{
+  //Same tolerance as the acceptance of SPR moves: a family that gains less while its search
+  //stops on its own has converged, and only gets a single pass in the next round.
+  //A family stopped by its deadline may just have lacked time: it counts as an average family.
+  double gain = treeLikelihoods_[i]->getSearchGain();
+  bool stoppedByDeadline = (ApplicationTools::getTime() >= deadline);
+  if (gain >= 0.01)
+    searchRates_[i] = gain / std::max(searchTime, 1e-3);
+  else if (stoppedByDeadline)
+    searchRates_[i] = -1.0;
+  else
+    searchRates_[i] = 0.0;
+  DEBUG_LOG("Family " << assignedFilenames_[i] << ": log-likelihood gain " << gain << " in " << searchTime << " s.");
+}
+
+
+void ClientComputingGeneLikelihoods::releaseFamily(size_t i)
+{
+  if (i < keepLoaded_.size() && keepLoaded_[i])
+    return;
+  if (!treeLikelihoods_[i]->isInitialized())
+    return;
+  double loadedHeap = Profiler::getHeapBytes();
+  treeLikelihoods_[i]->unload();
+  loadedMemory_[i] = std::max(loadedMemory_[i], loadedHeap - Profiler::getHeapBytes());
 }
 
 
@@ -812,6 +1217,113 @@ void ClientComputingGeneLikelihoods::MLSearch() {
 
 
 
+/******************************************************************************/
+// This function rebuilds the likelihood objects of all families
+// from their starting gene trees.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::resetGeneTreeLikelihoods()
+{
+  if (reconciliationModel_ == "DL")
+  {
+    for (unsigned int i=0 ; i<allDatasets_.size() ; i++)
+    {
+
+      string methodString =  treeLikelihoods_[i]->getLikelihoodMethod () ;
+      if (methodString == "PLL") {
+        treeLikelihoods_[i]->setGeneTree( allUnrootedGeneTrees_[i], allGeneTrees_[i] );
+      }
+      else {
+        /*  for (unsigned int i=0 ; i<allDatasets_.size() ; i++)
+         *                 {*/
+        std::map <std::string, std::string > params = treeLikelihoods_[i]->getParams();
+        std::map <std::string, std::vector <std::string> > collapsedSequences = treeLikelihoods_[i]->getCollapsedSequences();
+        if    (treeLikelihoods_[i])
+          delete treeLikelihoods_[i];
+        TreeTemplate<Node> * treeWithSpNames = allUnrootedGeneTrees_[i]->clone();
+        std::vector <Node*> leaves = treeWithSpNames->getLeaves();
+        for (unsigned int j =0; j<leaves.size() ; j++)
+        {
+          leaves[j]->setName(allSeqSps_[i][leaves[j]->getName()]);
+        }
+        treeLikelihoods_[i] =  new DLGeneTreeLikelihood(*(allUnrootedGeneTrees_[i]),                              *(allDatasets_[i]),
+                                                        allModels_[i], allDistributions_[i], *spSnapshot_,
+                                                        *allGeneTrees_[i], *treeWithSpNames, allSeqSps_[i],
+                                                        lossExpectedNumbers_,
+                                                        duplicationExpectedNumbers_,
+                                                        allNum0Lineages_[i],
+                                                        allNum1Lineages_[i],
+                                                        allNum2Lineages_[i],
+                                                        speciesIdLimitForRootPosition_,
+                                                        MLindex_, params,
+                                                        true, true, true, true, false, allSprLimitGeneTree_[i]) ;
+                                                        /*                          treeLikelihoods_.push_back( new DLGeneTreeLikelihood(*(allUnrootedGeneTrees_[i]), *(allDatasets_[i]),
+                                                         *                                                       allModels_[i], allDistributions_[i], *spTree_,
+                                                         *allGeneTrees_[i], *treeWithSpNames, allSeqSps_[i], spId_,
+                                                         *                                                       lossExpectedNumbers_,
+                                                         *                                                       duplicationExpectedNumbers_,
+                                                         *                                                       allNum0Lineages_[i],
+                                                         *                                                       allNum1Lineages_[i],
+                                                         *                                                       allNum2Lineages_[i],
+                                                         *                                                       speciesIdLimitForRootPosition_,
+                                                         *                                                        MLindex_, params,
+                                                         *                                                       true, true, true, true, false, allSprLimitGeneTree_[i]) );*/
+
+
+
+                                                        delete treeWithSpNames;
+        treeLikelihoods_[i]->setCollapsedSequences(collapsedSequences);
+      }
+      treeLikelihoods_[i]->unload();
+    }
+  }
+  else if (reconciliationModel_ == "COAL")
+  {
+    for (unsigned int i =0 ; i<allDatasets_.size() ; i++) {
+
+      std::map <std::string, std::string > params = treeLikelihoods_[i]->getParams();
+      std::map <std::string, std::vector <std::string> > collapsedSequences = treeLikelihoods_[i]->getCollapsedSequences();
+      if    (treeLikelihoods_[i])
+        delete treeLikelihoods_[i];
+      //}
+      //  treeLikelihoods_.clear();
+      /*   for (unsigned int i=0 ; i<allDatasets_.size() ; i++)
+       *               {*/
+      //coalCounts: vector of genetreenbnodes vectors of 3 (3 directions) vectors of sptreenbnodes vectors of 2 ints
+      std::vector< std::vector< std::vector< unsigned int > > > coalCounts2;
+      std::vector< std::vector<unsigned int> > coalCounts3;
+      std::vector< unsigned int > coalCounts4;
+      for (unsigned int j = 0 ; j < 2 ; j++ ) {
+        coalCounts4.push_back(0);
+      }
+      for (unsigned int j = 0 ; j < spTree_->getNumberOfNodes() ; j++ ) {
+        coalCounts3.push_back(coalCounts4);
+      }
+      for (unsigned int j = 0 ; j < 3 ; j++ ) {
+        coalCounts2.push_back(coalCounts3);
+      }
+      coalCounts_.assign(allGeneTrees_[i]->getNumberOfNodes(), coalCounts2);
+      TreeTemplate<Node> * treeWithSpNames = allUnrootedGeneTrees_[i]->clone();
+      std::vector <Node*> leaves = treeWithSpNames->getLeaves();
+      for (unsigned int j =0; j<leaves.size() ; j++)
+      {
+        leaves[j]->setName(allSeqSps_[i][leaves[j]->getName()]);
+      }
+
+      treeLikelihoods_[i] = new COALGeneTreeLikelihood(*allUnrootedGeneTrees_[i], *allDatasets_[i],
+                                                             allModels_[i], allDistributions_[i], *spSnapshot_,
+                                                             *allGeneTrees_[i], *treeWithSpNames, allSeqSps_[i],
+                                                             coalCounts_, coalBls_,
+                                                             speciesIdLimitForRootPosition_,
+                                                             MLindex_, params,
+                                                             true, true, true, true, allSprLimitGeneTree_[i]);
+      delete treeWithSpNames;
+      treeLikelihoods_[i]->setCollapsedSequences(collapsedSequences);
+      treeLikelihoods_[i]->unload();
+    }
+  }
+}
+
+
 /******************************************************************************/
 // This function outputs gene trees from the clients.
 /******************************************************************************/
@@ -828,8 +1340,13 @@ void ClientComputingGeneLikelihoods::outputGeneTrees ( unsigned int & bestIndex
   {
     Nhx *nhx = new Nhx();
     if (reconciliationModel_ == "DL") {
-      writeReconciledGeneTree ( allParams_[i], treeLikelihoods_[i]->getRootedTree().clone(), spTree_, treeLikelihoods_[i]->getSeqSp(), false ) ;
-      outputNumbersOfEventsPerFamilyPerSpecies( allParams_[i], treeLikelihoods_[i]->getRootedTree().clone(), spTree_, treeLikelihoods_[i]->getSeqSp(), assignedFilenames_[i], false );
+      std::map<std::string, std::string> & familyParams = getFamilyParams(i);
+      //Collapsed sequences are put back as recent duplications.
+      TreeTemplate<Node> * reconciledTree = treeLikelihoods_[i]->getRootedTree().clone();
+      expandCollapsedSequences ( *reconciledTree, treeLikelihoods_[i]->getCollapsedSequences() );
+      writeReconciledGeneTree ( familyParams, reconciledTree->clone(), spTree_, treeLikelihoods_[i]->getSeqSp(), false ) ;
+      outputNumbersOfEventsPerFamilyPerSpecies( familyParams, reconciledTree->clone(), spTree_, treeLikelihoods_[i]->getSeqSp(), assignedFilenames_[i], false );
+      delete reconciledTree;
       /*
        *
        *       TreeTemplate<Node> * geneTree=nhx->parenthesisToTree(temp);
@@ -852,6 +1369,7 @@ void ClientComputingGeneLikelihoods::outputGeneTrees ( unsigned int & bestIndex
     else if (reconciliationModel_ == "COAL") {
       string temp = reconciledTrees_[i][rightIndex];
       TreeTemplate<Node> * geneTree=TreeTemplateTools::parenthesisToTree(temp);
+      expandCollapsedSequences ( *geneTree, treeLikelihoods_[i]->getCollapsedSequences() );
       out.open (reconcTree.c_str(), std::ios::out);
       nhx->write(*geneTree, out);
       out.close();
@@ -863,20 +1381,130 @@ void ClientComputingGeneLikelihoods::outputGeneTrees ( unsigned int & bestIndex
     delete nhx;
 
   }
+  releaseFamilyParams();
   return;
 }
 
 
+/******************************************************************************/
+// This function evaluates the species trees of the aLRT stage, batch after batch.
+// Gene trees are those found for the best species tree, and are not rearranged.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::computeALRTsInBatches()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  bool computeALRTs;
+  {
+    ScopedTimer timer(PROFILE_MPI_BROADCAST);
+    broadcast(world_, computeALRTs, server_);
+  }
+  if (!computeALRTs)
+    return;
+  broadcastsAllInformationButStop(world_, server_, rearrange_,
+                                  lossExpectedNumbers_,
+                                  duplicationExpectedNumbers_,
+                                  coalBls_,
+                                  currentSpeciesTree_,
+                                  currentStep_,
+                                  reconciliationModel_);
+  std::vector<std::string> batch;
+  while (broadcastsALRTBatch(world_, server_, batch))
+  {
+    std::vector<double> logLs (batch.size(), 0.0);
+    //Sequence likelihoods do not depend on the species tree: each family is
+    //loaded once, and reconciled with all the trees of the batch.
+    std::vector<SpeciesTreeSnapshot *> snapshots;
+    for (unsigned int k = 0 ; k < batch.size() ; k++)
+    {
+      currentSpeciesTree_ = batch[k];
+      if ( numberOfGeneFamilies_ > 0 || !geneTreeCollections_.empty() )
+      {
+        updateSpeciesTreeSnapshot();
+        snapshots.push_back(SpeciesTreeSnapshot::acquire(spSnapshot_));
+      }
+      if (!geneTreeCollections_.empty())
+      {
+        logLs[k] += computeLogLkOfGeneTreeCollections();
+      }
+    }
+    for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++)
+    {
+      computeLogLksWithFixedGeneTree(i, snapshots, logLs);
+    }
+    releaseFamilyParams();
+    for (unsigned int k = 0 ; k < snapshots.size() ; k++)
+    {
+      SpeciesTreeSnapshot::release(snapshots[k]);
+    }
+    gathersALRTBatchLikelihoods(world_, server_, rank_, logLs);
+  }
+  return;
+}
+
+
+/******************************************************************************/
+// This function adds to logLs the likelihood of family i given each species
+// tree of snapshots, only rerooting its current gene tree. The family is
+// loaded for the first tree, and only reconciled again for the next ones.
+/******************************************************************************/
+void ClientComputingGeneLikelihoods::computeLogLksWithFixedGeneTree(size_t i,
+                                                                     const std::vector <SpeciesTreeSnapshot *> & snapshots,
+                                                                     std::vector <double> & logLs)
+{
+  if (snapshots.empty())
+    return;
+  //The topology option of the family is restored afterwards
+  std::map<std::string, std::string>::iterator previous = allParams_[i].find("optimization.topology");
+  bool hadTopologyOption = (previous != allParams_[i].end());
+  std::string topologyOption = hadTopologyOption ? previous->second : "";
+  allParams_[i][ std::string("optimization.topology")] = "false";
+  std::map<std::string, std::string> & familyParams = getFamilyParams(i);
+  treeLikelihoods_[i]->OptimizeSequenceLikelihood(false);
+  treeLikelihoods_[i]->setSpeciesTreeSnapshot(snapshots[0]);
+  if (reconciliationModel_ == "DL") {
+    DLGeneTreeLikelihood * dl = dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i]);
+    dl->setExpectedNumbers(duplicationExpectedNumbers_, lossExpectedNumbers_);
+    if (! dl->isInitialized() ) {
+      dl->initialize();
+    }
+    dl->initParameters();
+    for (size_t k = 0 ; k < snapshots.size() ; k++)
+    {
+      dl->setSpeciesTreeSnapshot(snapshots[k]);
+      dl->refineGeneTreeNNIs(familyParams);
+      logLs[k] += dl->getValue();
+    }
+  }
+  else if (reconciliationModel_ == "COAL") {
+    COALGeneTreeLikelihood * coal = dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i]);
+    coal->setCoalBranchLengths(coalBls_);
+    coal->initialize();
+    coal->initParameters();
+    for (size_t k = 0 ; k < snapshots.size() ; k++)
+    {
+      coal->setSpeciesTreeSnapshot(snapshots[k]);
+      coal->refineGeneTreeNNIs(familyParams);
+      logLs[k] += coal->getValue();
+    }
+  }
+  if (hadTopologyOption)
+    allParams_[i][ std::string("optimization.topology")] = topologyOption;
+  else
+    allParams_[i].erase("optimization.topology");
+  releaseFamily(i);
+}
+
+
 void ClientComputingGeneLikelihoods::NNIRearrange (bool timing, size_t i, double& startingTime, double& totalTime) {
 
   if (timing && rearrange_)
     startingTime = ApplicationTools::getTime();
   // NNI optimization:
   if (reconciliationModel_ == "DL") {
-    dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeNNIs(allParams_[i]);
+    dynamic_cast<DLGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeNNIs(getFamilyParams(i));
   }
   else if (reconciliationModel_ == "COAL") {
-    dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeNNIs(allParams_[i]);
+    dynamic_cast<COALGeneTreeLikelihood*> (treeLikelihoods_[i])->refineGeneTreeNNIs(getFamilyParams(i));
   }
   if (timing && rearrange_)
   {
@@ -81,6 +81,8 @@ knowledge of the CeCILL license and that you accept its terms.
 //#include "GeneTreeLikelihood.h"
 #include "DLGeneTreeLikelihood.h"
 #include "COALGeneTreeLikelihood.h"
+#include "FamilyManifest.h"
+#include "GeneTreeCollection.h"
 
 
 
@@ -98,10 +100,14 @@ namespace bpp
     unsigned int  server_; 
     unsigned int  rank_;
     std::map<std::string, std::string>  params_; 
+    //Options shared by all families: allParams_ only stores the options of each family that differ from these.
+    std::map<std::string, std::string>  defaultParams_; 
     std::vector<std::string>  assignedFilenames_; 
     unsigned int  numDeletedFamilies_; 
     unsigned int numberOfGeneFamilies_;
     TreeTemplate<Node> * geneTree_; 
+    //Species tree shared by all families, spTree_ being its tree.
+    SpeciesTreeSnapshot* spSnapshot_;
     TreeTemplate<Node>* spTree_; 
     std::vector <int> num0Lineages_;
     std::vector <int>  num1Lineages_; 
@@ -120,6 +126,8 @@ namespace bpp
     std::map <std::string, int>  spId_; 
     bool rearrange_;
     bool resetGeneTrees_;
+    //"batch" if the server runs the aLRT stage at the end of the search
+    std::string alrtComputation_;
     bool optimizeSpeciesTreeTopology_;
     bool recordGeneTrees_;
     bool stop_;
@@ -145,6 +153,26 @@ namespace bpp
     std::vector <std::vector <std::string> > lossTrees_;
     string reconciliationModel_;
     string currentSpeciesTree_;
+    //true if families are files of fixed gene trees, scored by reconciliation only
+    bool reconciliationOnly_;
+    std::vector <GeneTreeCollection *> geneTreeCollections_;
+    //DTL model of gene tree collections, 0 for other models
+    DTLReconciliationModel * dtlModel_;
+    //Memory budget of this client in bytes (client.memory.budget), 0 for none
+    double memoryBudget_;
+    //Measured memory of each family in bytes: kept between rounds, and freed by unload()
+    std::vector <double> residentMemory_;
+    std::vector <double> loadedMemory_;
+    //Families that stay loaded between rounds, within the memory budget
+    std::vector <bool> keepLoaded_;
+    //Search time of a whole round in seconds (round.time.budget), 0 for none
+    double roundTimeBudget_;
+    //Log-likelihood gained per second by each family in its last search, 0 once converged, -1 before any
+    std::vector <double> searchRates_;
+    //Scratch map of getFamilyParams: all options of one family at a time, the family, and the allParams_ entry they were built from
+    std::map<std::string, std::string> familyParams_;
+    size_t familyParamsIndex_;
+    std::map<std::string, std::string> familyParamsSource_;
     
   public:   
 //Simple constructor
@@ -153,11 +181,12 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     unsigned int & rank,
     std::map<std::string, std::string> & params) :
     world_(world), server_(server), 
-    rank_(rank), params_(params),
+    rank_(rank), params_(params), defaultParams_(),
     assignedFilenames_(), 
     numDeletedFamilies_ (0), 
     numberOfGeneFamilies_(0),
     geneTree_(0),
+    spSnapshot_ (0),
     spTree_ (0),
     num0Lineages_(), 
     num1Lineages_(), 
@@ -176,6 +205,7 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     spId_(),
     rearrange_(false),
     resetGeneTrees_(false),
+    alrtComputation_("nni"),
     optimizeSpeciesTreeTopology_(false),
     recordGeneTrees_(false),
     stop_(false),
@@ -200,7 +230,19 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     duplicationTrees_(),
     lossTrees_(),
     reconciliationModel_("DL"), 
-    currentSpeciesTree_("")
+    currentSpeciesTree_(""),
+    reconciliationOnly_(false),
+    geneTreeCollections_(),
+    dtlModel_(0),
+    memoryBudget_(0),
+    residentMemory_(),
+    loadedMemory_(),
+    keepLoaded_(),
+    roundTimeBudget_(0),
+    searchRates_(),
+    familyParams_(),
+    familyParamsIndex_(0),
+    familyParamsSource_()
     {
       parseOptions();
       
@@ -209,11 +251,12 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     //Copy constructor
     ClientComputingGeneLikelihoods(const ClientComputingGeneLikelihoods& c) :
     world_(c.world_), server_(c.server_), 
-    rank_(c.rank_), params_(c.params_),
+    rank_(c.rank_), params_(c.params_), defaultParams_(c.defaultParams_),
     assignedFilenames_(c.assignedFilenames_), 
     numDeletedFamilies_ (c.numDeletedFamilies_), 
     numberOfGeneFamilies_ (c.numberOfGeneFamilies_),
     geneTree_(c.geneTree_),
+    spSnapshot_(SpeciesTreeSnapshot::acquire(c.spSnapshot_)),
     spTree_(c.spTree_),
     num0Lineages_(c.num0Lineages_), 
     num1Lineages_(c.num1Lineages_), 
@@ -231,6 +274,7 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     spId_(c.spId_),
     rearrange_(c.rearrange_),
     resetGeneTrees_(c.resetGeneTrees_),
+    alrtComputation_(c.alrtComputation_),
     optimizeSpeciesTreeTopology_(c.optimizeSpeciesTreeTopology_),
     recordGeneTrees_(c.recordGeneTrees_),
     stop_(c.stop_),
@@ -255,7 +299,19 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     duplicationTrees_(c.duplicationTrees_),
     lossTrees_(c.lossTrees_),
     reconciliationModel_(c.reconciliationModel_),
-    currentSpeciesTree_(c.currentSpeciesTree_)
+    currentSpeciesTree_(c.currentSpeciesTree_),
+    reconciliationOnly_(c.reconciliationOnly_),
+    geneTreeCollections_(c.geneTreeCollections_),
+    dtlModel_(c.dtlModel_),
+    memoryBudget_(c.memoryBudget_),
+    residentMemory_(c.residentMemory_),
+    loadedMemory_(c.loadedMemory_),
+    keepLoaded_(c.keepLoaded_),
+    roundTimeBudget_(c.roundTimeBudget_),
+    searchRates_(c.searchRates_),
+    familyParams_(c.familyParams_),
+    familyParamsIndex_(c.familyParamsIndex_),
+    familyParamsSource_(c.familyParamsSource_)
     {}
     
     //= operator
@@ -265,10 +321,14 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
       server_ = c.server_; 
       rank_ = c.rank_; 
       params_ = c.params_;
+      defaultParams_ = c.defaultParams_;
       assignedFilenames_ = c.assignedFilenames_; 
       numDeletedFamilies_  = c.numDeletedFamilies_; 
       numberOfGeneFamilies_ = c.numberOfGeneFamilies_;
       geneTree_ = c.geneTree_;
+      SpeciesTreeSnapshot::acquire(c.spSnapshot_);
+      SpeciesTreeSnapshot::release(spSnapshot_);
+      spSnapshot_ = c.spSnapshot_;
       spTree_ = c.spTree_;
       num0Lineages_ = c.num0Lineages_; 
       num1Lineages_ = c.num1Lineages_; 
@@ -286,6 +346,7 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
       spId_ = c.spId_;
       rearrange_ = c.rearrange_;
       resetGeneTrees_ = c.resetGeneTrees_;
+      alrtComputation_ = c.alrtComputation_;
       optimizeSpeciesTreeTopology_ = c.optimizeSpeciesTreeTopology_;
       recordGeneTrees_ = c.recordGeneTrees_;
       stop_ = c.stop_;
@@ -311,6 +372,18 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
       lossTrees_ = c.lossTrees_;
       reconciliationModel_ = c.reconciliationModel_;
       currentSpeciesTree_ = c.currentSpeciesTree_;
+      reconciliationOnly_ = c.reconciliationOnly_;
+      geneTreeCollections_ = c.geneTreeCollections_;
+      dtlModel_ = c.dtlModel_;
+      memoryBudget_ = c.memoryBudget_;
+      residentMemory_ = c.residentMemory_;
+      loadedMemory_ = c.loadedMemory_;
+      keepLoaded_ = c.keepLoaded_;
+      roundTimeBudget_ = c.roundTimeBudget_;
+      searchRates_ = c.searchRates_;
+      familyParams_ = c.familyParams_;
+      familyParamsIndex_ = c.familyParamsIndex_;
+      familyParamsSource_ = c.familyParamsSource_;
       return *this;
     }
     
@@ -318,7 +391,7 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     virtual ~ClientComputingGeneLikelihoods() 
     {			
       if (geneTree_) delete geneTree_;
-      if (spTree_) delete spTree_;
+      SpeciesTreeSnapshot::release(spSnapshot_);
       for (unsigned int i = 0 ; i< numberOfGeneFamilies_ ; i++) 
       {       
         /*if (allAlphabets_[i])
@@ -336,6 +409,10 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
         if (allUnrootedGeneTrees_[i])
           delete allUnrootedGeneTrees_[i];  
       }
+      for (unsigned int i = 0 ; i< geneTreeCollections_.size() ; i++) 
+        delete geneTreeCollections_[i];
+      if (dtlModel_)
+        delete dtlModel_;
     }
     
     //Clone function
@@ -346,10 +423,60 @@ ClientComputingGeneLikelihoods(const mpi::communicator& world,
     
     void parseAssignedGeneFamilies() ;
     
+    //Reads the gene tree collections assigned to the client (reconciliation.only=yes)
+    void parseAssignedGeneTreeCollections() ;
+    
+    //Computes the likelihood of all gene tree collections given spSnapshot_, and adds their lineage numbers to num*Lineages_
+    double computeLogLkOfGeneTreeCollections();
+    
+    //Prepares the families for a new species tree search, and gets its starting species tree
+    void initializeSearch() ;
+    
+    //Rebuilds the likelihood objects of all families from their starting gene trees
+    void resetGeneTreeLikelihoods() ;
+    
+    //Builds the species tree snapshot shared by all families from currentSpeciesTree_
+    void updateSpeciesTreeSnapshot();
+    
+    //Gets all options of family i, i.e. defaultParams_ updated with allParams_[i], in a scratch map
+    //that is only valid until options of another family are asked for
+    std::map<std::string, std::string> & getFamilyParams(size_t i);
+    
+    //Frees the scratch map of getFamilyParams
+    void releaseFamilyParams();
+    
     void MLSearch();
     
+    //Gets ready for the next species tree search, if the server runs one
+    bool startNextSearch();
+    
+    //Sends the measured cost of each family to the server, at the end of the run
+    void sendFamilyCosts();
+    
+    //Estimates the memory of family i in bytes, kept between rounds (resident) and freed by unload() (loaded)
+    void estimateFamilyMemory(size_t i, double & resident, double & loaded) const;
+    
+    //Chooses the families that stay loaded between rounds within memoryBudget_, and records their memory in the profile
+    void planFamilyMemory();
+    
+    //Unloads family i, unless it stays loaded, and measures the memory freed
+    void releaseFamily(size_t i);
+    
+    //Share of the round's remaining search time given to family i, in proportion to its recent improvement rate
+    double allotSearchTime(size_t i, double remainingTime) const;
+    
+    //Updates the improvement rate of family i after a search of the given duration, which had to stop at deadline
+    void recordSearchRate(size_t i, double searchTime, double deadline);
+    
     void outputGeneTrees ( unsigned int & bestIndex );
     
+    //Computes the likelihoods of the species trees sent by the server in the aLRT stage
+    void computeALRTsInBatches();
+    
+    //Adds to logLs the likelihood of family i given each species tree, without rearranging its gene tree.
+    //The family is loaded once for all the trees.
+    void computeLogLksWithFixedGeneTree(size_t i, const std::vector <SpeciesTreeSnapshot *> & snapshots, std::vector <double> & logLs);
+    
     //Get the logL of the species tree according to the gene families handled by the client
     double getValue() const throw (Exception) { return logL_; }
     
@@ -5,12 +5,14 @@
 
 #include <Bpp/Text/TextTools.h>
 
+#include "Logger.h"
+
 
 //Defining a DEBUG macro to print debug messages.
+//It goes through the logger at the trace level: it is compiled out with NDEBUG,
+//and otherwise only prints with log.level=trace.
 #ifndef NDEBUG
-    #define WHEREAMI(x,y) (  std::cout <<"DEBUG: "<< x << " : "<< TextTools::toString<int>(y) << std::endl )
-    //std::cerr << "PASSED: "<< x << " : "<< TextTools::toString<int>(y)<< std::endl; ; std::cerr.flush() ; std::cout.flush(); 
-  //  #define D(x) ( std::cerr << "PASSED: "<< x << std::endl;  std::cout << "PASSED: " << x << std::endl; std::cerr.flush() ; std::cout::flush(); )
+    #define WHEREAMI(x,y) TRACE_LOG( "DEBUG: "<< x << " : "<< y )
 #else 
     #define WHEREAMI(x,y)  
 #endif
@@ -42,6 +42,7 @@
 #include "Constants.h"
 #include "DLGeneTreeLikelihood.h"
 #include "GenericTreeExplorationAlgorithms.h"
+#include "Profiler.h"
 
 using namespace bpp;
 
@@ -70,6 +71,7 @@ DLGeneTreeLikelihood::DLGeneTreeLikelihood( std::string file,
   tentativeNum0Lineages_ =num0Lineages_;
   tentativeNum1Lineages_ =num1Lineages_; 
   tentativeNum2Lineages_ =num2Lineages_;
+  exhaustiveTopologyIndex_ = -1;
   }
 
 /******************************************************************************/
@@ -135,11 +137,10 @@ DLGeneTreeLikelihood::DLGeneTreeLikelihood(
   const SiteContainer & data,
   SubstitutionModel * model,
   DiscreteDistribution * rDist,
-  TreeTemplate<Node> & spTree,
+  SpeciesTreeSnapshot & spSnapshot,
   TreeTemplate<Node> & rootedTree,
   TreeTemplate<Node> & geneTreeWithSpNames,
   const std::map <std::string, std::string> seqSp,
-  std::map <std::string,int> spId,
   std::vector <double> & lossProbabilities,
   std::vector <double> & duplicationProbabilities,
   std::vector <int> & num0Lineages,
@@ -159,11 +160,10 @@ GeneTreeLikelihood(tree,
 		   data,
 		   model,
 		   rDist,
-		   spTree,  
+		   spSnapshot,
 		   rootedTree, 
 		   geneTreeWithSpNames,
 		   seqSp,
-		   spId,
 		   speciesIdLimitForRootPosition,
 		   MLindex, 
 		   params,
@@ -183,6 +183,7 @@ GeneTreeLikelihood(tree,
   tentativeNum1Lineages_ =num1Lineages; 
   tentativeNum2Lineages_ =num2Lineages;
   DLStartingGeneTree_ = DLStartingGeneTree;
+  exhaustiveTopologyIndex_ = -1;
 }
 
 /******************************************************************************/
@@ -200,6 +201,9 @@ GeneTreeLikelihood(lik)
   tentativeNum1Lineages_ =lik.tentativeNum1Lineages_;
   tentativeNum2Lineages_ =lik.tentativeNum2Lineages_;
   DLStartingGeneTree_ = lik.DLStartingGeneTree_;
+  exhaustiveTopologies_ = lik.exhaustiveTopologies_;
+  exhaustiveSequenceLogLks_ = lik.exhaustiveSequenceLogLks_;
+  exhaustiveTopologyIndex_ = lik.exhaustiveTopologyIndex_;
 }
 
 /******************************************************************************/
@@ -217,6 +221,9 @@ DLGeneTreeLikelihood & DLGeneTreeLikelihood::operator=(const DLGeneTreeLikelihoo
   tentativeNum1Lineages_ =lik.tentativeNum1Lineages_;
   tentativeNum2Lineages_ =lik.tentativeNum2Lineages_;
   DLStartingGeneTree_ = lik.DLStartingGeneTree_;
+  exhaustiveTopologies_ = lik.exhaustiveTopologies_;
+  exhaustiveSequenceLogLks_ = lik.exhaustiveSequenceLogLks_;
+  exhaustiveTopologyIndex_ = lik.exhaustiveTopologyIndex_;
   return *this;
 }
 
@@ -229,11 +236,20 @@ DLGeneTreeLikelihood::~DLGeneTreeLikelihood()
 {
   WHEREAMI( __FILE__ , __LINE__ );
   if (levaluator_) delete levaluator_;
-  if (spTree_) delete spTree_;
   if (rootedTree_) delete rootedTree_;
   if (geneTreeWithSpNames_) delete geneTreeWithSpNames_;
 }
 
+/******************************************************************************/
+
+void DLGeneTreeLikelihood::setGeneTree(TreeTemplate<Node>* tree, TreeTemplate<Node>* rootedTree)
+{
+  GeneTreeLikelihood::setGeneTree(tree, rootedTree);
+  exhaustiveTopologies_.clear();
+  exhaustiveSequenceLogLks_.clear();
+  exhaustiveTopologyIndex_ = -1;
+}
+
 
 
 /******************************************************************************/
@@ -265,7 +281,7 @@ void DLGeneTreeLikelihood::initParameters()
       }
       else {
       scenarioLikelihood_ = findMLReconciliationDR (spTree_, rootedTree_,
-                                                    seqSp_, spId_, lossExpectedNumbers_,
+                                                    seqSp_, *spId_, lossExpectedNumbers_,
                                                     duplicationExpectedNumbers_, MLindex_,
                                                     num0Lineages_, num1Lineages_,
                                                     num2Lineages_, nodesToTryInNNISearch_);
@@ -387,7 +403,7 @@ void DLGeneTreeLikelihood::computeReconciliationLikelihood()
   WHEREAMI( __FILE__ , __LINE__ );
   resetLossesAndDuplications(*spTree_, /*lossNumbers_, */lossExpectedNumbers_, /*duplicationNumbers_, */duplicationExpectedNumbers_);
     scenarioLikelihood_ = findMLReconciliationDR (spTree_, rootedTree_, 
-						  seqSp_, spId_, 
+						  seqSp_, *spId_, 
 						  lossExpectedNumbers_, duplicationExpectedNumbers_, 
 						  tentativeMLindex_, 
 						  tentativeNum0Lineages_, tentativeNum1Lineages_, 
@@ -473,7 +489,7 @@ double DLGeneTreeLikelihood::testNNI(int nodeId) const throw (NodeException)
     
 
     candidateScenarioLk =  findMLReconciliationDR (spTree_, treeForNNI/*&rootedTree_*/, 
-					       seqSp_, spId_, 
+					       seqSp_, *spId_, 
 					       lossExpectedNumbers_, duplicationExpectedNumbers_, 
 					       tentativeMLindex_, 
 					       tentativeNum0Lineages_, tentativeNum1Lineages_, 
@@ -715,13 +731,15 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast2 (map<string, string> params)
   bool computeSequenceLikelihoodForSPR = ApplicationTools::getBooleanParameter("compute.sequence.likelihood.in.sprs", params, true, "", false, false);
   
   
-  while (numIterationsWithoutImprovement < rootedTree_->getNumberOfNodes() - 2 && (timeLimit_ == 0 || elapsedTime_ < timeLimit_))
+  double startingLogL = logL;
+  
+  while (numIterationsWithoutImprovement < rootedTree_->getNumberOfNodes() - 2 && hasSearchTimeLeft())
   {
     
     annotateGeneTreeWithDuplicationEvents (*spTree_, 
 					   *rootedTree_, 
 					   rootedTree_->getRootNode(), 
-					   seqSp_, spId_); 
+					   seqSp_, *spId_); 
     
     for (int nodeForSPR=rootedTree_->getNumberOfNodes()-1 ; nodeForSPR >0; nodeForSPR--) 
     {
@@ -741,12 +759,14 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast2 (map<string, string> params)
 	    treeForSPR = 0;
 	  }
 	  treeForSPR = rootedTree_->clone();
+	  Profiler::count(PROFILE_TREE_CLONE);
+	  Profiler::count(PROFILE_GENE_SPR_TRIED);
 	  
 	  nodesToUpdate = makeSPR(*treeForSPR, nodeForSPR, nodeIdsToRegraft[i], false, true);
 	  
 	  //Compute the DL likelihood
 	  candidateScenarioLk =  findMLReconciliationDR (spTree_, treeForSPR, 
-							 seqSp_, spId_, 
+							 seqSp_, *spId_, 
 						  lossExpectedNumbers_, 
 						  duplicationExpectedNumbers_, 
 						  tentativeMLindex_, 
@@ -775,8 +795,9 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast2 (map<string, string> params)
 	  if (logL - 0.01 > bestlogL) 
 	  {
             levaluator_->acceptAlternativeTree();
+            Profiler::count(PROFILE_GENE_SPR_ACCEPTED);
       WHEREAMI( __FILE__ , __LINE__ );
-	    std::cout << "Better tree overall: "<<logL << " compared to "<<bestlogL<<std::endl;
+	    DEBUG_LOG("Better tree overall: "<<logL << " compared to "<<bestlogL);
 	    
 	    betterTree = true;
 	    bestlogL = logL;
@@ -808,7 +829,10 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast2 (map<string, string> params)
 		break;
 	      }
 	    }
-	    writeReconciledGeneTree ( params, dynamic_cast<const TreeTemplate<Node> *> ((bestTree))->clone(), spTree_, seqSp_, true ) ;
+	    TreeTemplate<Node> * reconciledTree = dynamic_cast<const TreeTemplate<Node> *> ((bestTree))->clone();
+	    expandCollapsedSequences ( *reconciledTree, collapsedSequences_ );
+	    writeReconciledGeneTree ( params, reconciledTree, spTree_, seqSp_, true ) ;
+	    delete reconciledTree;
 	    
 	  }
 	  
@@ -865,14 +889,14 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast2 (map<string, string> params)
   
   //One more reconciliation, to update the "_num*Lineages" vectors.
   computeReconciliationLikelihood();
+  searchGain_ += getLogLikelihood() - startingLogL;
   
   Nhx *nhx = new Nhx();
   annotateGeneTreeWithDuplicationEvents (*spTree_, 
 					 *rootedTree_, 
 					 rootedTree_->getRootNode(), 
-					 seqSp_, spId_); 
-  cout << "Reconciled tree: "<<endl;
-  nhx->write(*rootedTree_, cout);
+					 seqSp_, *spId_); 
+  DEBUG_LOG("Reconciled tree: " << std::endl << nhx->treeToParenthesis(*rootedTree_));
 
   if (bestTree) {
     delete bestTree;
@@ -936,7 +960,7 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast3 (map<string, string> params)
     annotateGeneTreeWithDuplicationEvents (*spTree_, 
 					   *rootedTree_, 
 					   rootedTree_->getRootNode(), 
-					   seqSp_, spId_); 
+					   seqSp_, *spId_); 
     
     for (unsigned int nodeForSPR=rootedTree_->getNumberOfNodes()-1 ; nodeForSPR >0; nodeForSPR--) 
     {
@@ -960,7 +984,7 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast3 (map<string, string> params)
 	  
 	  //Compute the DL likelihood
 	  candidateScenarioLk =  findMLReconciliationDR (spTree_, treeForSPR, 
-							 seqSp_, spId_, 
+							 seqSp_, *spId_, 
 						  lossExpectedNumbers_, 
 						  duplicationExpectedNumbers_, 
 						  tentativeMLindex_, 
@@ -1000,7 +1024,7 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast3 (map<string, string> params)
                 // levaluator: since it the best tree, setting it as the current one
                 levaluator_->acceptAlternativeTree();
     WHEREAMI( __FILE__ , __LINE__ );
-		std::cout << "Better tree overall: "<<logL << " compared to "<<bestlogL<<std::endl;
+		DEBUG_LOG("Better tree overall: "<<logL << " compared to "<<bestlogL);
 		betterTree = true;
 		bestlogL = logL;
 		bestScenarioLk = candidateScenarioLk;
@@ -1030,7 +1054,10 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast3 (map<string, string> params)
 		    break;
 		  }
 		}
-		writeReconciledGeneTree ( params, dynamic_cast<const TreeTemplate<Node> *> ((bestTree))->clone(), spTree_, seqSp_, true ) ;
+		TreeTemplate<Node> * reconciledTree = dynamic_cast<const TreeTemplate<Node> *> ((bestTree))->clone();
+		expandCollapsedSequences ( *reconciledTree, collapsedSequences_ );
+		writeReconciledGeneTree ( params, reconciledTree, spTree_, seqSp_, true ) ;
+		delete reconciledTree;
 		break; //If we have found one topology better than the current one for seqlk+scenlk
 	      }
 	    }
@@ -1096,9 +1123,8 @@ void DLGeneTreeLikelihood::refineGeneTreeSPRsFast3 (map<string, string> params)
   annotateGeneTreeWithDuplicationEvents (*spTree_, 
 					 *rootedTree_, 
 					 rootedTree_->getRootNode(), 
-					 seqSp_, spId_); 
-  cout << "Reconciled tree: "<<endl;
-  nhx->write(*rootedTree_, cout);
+					 seqSp_, *spId_); 
+  DEBUG_LOG("Reconciled tree: " << std::endl << nhx->treeToParenthesis(*rootedTree_));
   
   if (bestTree) {
     delete bestTree;
@@ -1161,7 +1187,7 @@ void DLGeneTreeLikelihood::refineGeneTreeMuffato (map<string, string> params) {
     annotateGeneTreeWithScoredDuplicationEvents (*spTree_, 
 						 *rootedTree_, 
 						 rootedTree_->getRootNode(), 
-						 seqSp_, spId_); 
+						 seqSp_, *spId_); 
     
     double editionThreshold = ApplicationTools::getDoubleParameter("muffato.edition.threshold", params, 0.3, "", false, false);
     
@@ -1173,7 +1199,7 @@ void DLGeneTreeLikelihood::refineGeneTreeMuffato (map<string, string> params) {
     if (edited) {
     //Compute the DL likelihood
     candidateScenarioLk =  findMLReconciliationDR (spTree_, treeForSPR, 
-						   seqSp_, spId_, 
+						   seqSp_, *spId_, 
 						   lossExpectedNumbers_, 
 						   duplicationExpectedNumbers_, 
 						   tentativeMLindex_, 
@@ -1199,7 +1225,7 @@ void DLGeneTreeLikelihood::refineGeneTreeMuffato (map<string, string> params) {
         // then we accept the tree
         levaluator_->acceptAlternativeTree();
   WHEREAMI( __FILE__ , __LINE__ );      
-	std::cout << "Better tree overall: "<<logL << " compared to "<<bestlogL<<std::endl;
+	DEBUG_LOG("Better tree overall: "<<logL << " compared to "<<bestlogL);
 	betterTree = true;
 	bestlogL = logL;
 	bestScenarioLk = candidateScenarioLk;
@@ -1230,7 +1256,10 @@ void DLGeneTreeLikelihood::refineGeneTreeMuffato (map<string, string> params) {
 	    break;
 	  }
 	}
-	writeReconciledGeneTree ( params, dynamic_cast<const TreeTemplate<Node> *> ((bestTree))->clone(), spTree_, seqSp_, true ) ;
+	TreeTemplate<Node> * reconciledTree = dynamic_cast<const TreeTemplate<Node> *> ((bestTree))->clone();
+	expandCollapsedSequences ( *reconciledTree, collapsedSequences_ );
+	writeReconciledGeneTree ( params, reconciledTree, spTree_, seqSp_, true ) ;
+	delete reconciledTree;
 	
       }
       else {
@@ -1285,7 +1314,7 @@ void DLGeneTreeLikelihood::refineGeneTreeMuffato (map<string, string> params) {
   annotateGeneTreeWithDuplicationEvents (*spTree_, 
 					 *rootedTree_, 
 					 rootedTree_->getRootNode(), 
-					 seqSp_, spId_); 
+					 seqSp_, *spId_); 
   cout << "Muffato reconciled tree: "<<endl;
   nhx->write(*rootedTree_, cout);
   
@@ -1312,13 +1341,14 @@ void DLGeneTreeLikelihood::refineGeneTreeMuffato (map<string, string> params) {
 void DLGeneTreeLikelihood::refineGeneTreeNNIs(map<string, string> params, unsigned int verbose ) {
   WHEREAMI( __FILE__ , __LINE__ );
   
-  double startingTime = 0;
+  double startingTime = ApplicationTools::getTime();
   
   if (ApplicationTools::getBooleanParameter("optimization.topology", params, true, "", false, false) == false ) {
     //We don't do NNIs
     computeReconciliationLikelihood();
     return;
   }
+  double startingValue = getValue();
   bool test = true;
   do
   { 
@@ -1365,7 +1395,84 @@ void DLGeneTreeLikelihood::refineGeneTreeNNIs(map<string, string> params, unsign
     elapsedTime_ += (ApplicationTools::getTime() - startingTime);
     startingTime = ApplicationTools::getTime();
   }
-  while(test && (timeLimit_ == 0 || elapsedTime_ < timeLimit_));
+  while(test && hasSearchTimeLeft());
+  searchGain_ += startingValue - getValue();
+}
+
+
+/************************************************************************
+ * For small families, replaces the gene tree search.
+ * At the first call, all unrooted topologies of the (collapsed) sequences
+ * are listed and their sequence likelihoods computed once and for all.
+ * Then, for the current species tree and rates, all topologies are reconciled,
+ * and the one with the best total likelihood becomes the gene tree.
+ * The sequence likelihood is only computed again if the topology changes.
+ ************************************************************************/
+void DLGeneTreeLikelihood::refineGeneTreeExhaustively(map<string, string> params) {
+  WHEREAMI( __FILE__ , __LINE__ );
+
+  if (ApplicationTools::getBooleanParameter("optimization.topology", params, true, "", false, false) == false ) {
+    //We don't change the topology
+    computeReconciliationLikelihood();
+    return;
+  }
+  if (exhaustiveTopologies_.empty()) {
+    exhaustiveTopologies_ = getAllUnrootedTopologies(rootedTree_->getLeavesNames());
+    exhaustiveSequenceLogLks_.assign(exhaustiveTopologies_.size(), 0.0);
+    for (size_t i = 0 ; i < exhaustiveTopologies_.size() ; i++) {
+      if (considerSequenceLikelihood_) {
+        TreeTemplate<Node> * tree = TreeTemplateTools::parenthesisToTree(exhaustiveTopologies_[i]);
+        tree->setBranchLengths(0.1);
+        levaluator_->setAlternativeTree(tree);
+        exhaustiveSequenceLogLks_[i] = levaluator_->getAlternativeLogLikelihood();
+        delete tree;
+      }
+    }
+    DEBUG_LOG("Sequence likelihoods computed for "<< exhaustiveTopologies_.size() <<" topologies");
+  }
+  if (exhaustiveTopologies_.empty()) {
+    computeReconciliationLikelihood();
+    return;
+  }
+
+  resetLossesAndDuplications(*spTree_, lossExpectedNumbers_, duplicationExpectedNumbers_);
+  int bestIndex = -1;
+  double bestLogL = 0.0;
+  for (size_t i = 0 ; i < exhaustiveTopologies_.size() ; i++) {
+    TreeTemplate<Node> * tree = TreeTemplateTools::parenthesisToTree(exhaustiveTopologies_[i]);
+    double candidateScenarioLk = findMLReconciliationDR (spTree_, tree,
+                                                         seqSp_, *spId_,
+                                                         lossExpectedNumbers_, duplicationExpectedNumbers_,
+                                                         tentativeMLindex_,
+                                                         tentativeNum0Lineages_, tentativeNum1Lineages_,
+                                                         tentativeNum2Lineages_, tentativeNodesToTryInNNISearch_, false);
+    delete tree;
+    if (bestIndex < 0 || candidateScenarioLk + exhaustiveSequenceLogLks_[i] > bestLogL) {
+      bestIndex = static_cast<int>(i);
+      bestLogL = candidateScenarioLk + exhaustiveSequenceLogLks_[i];
+    }
+  }
+
+  if (bestIndex != exhaustiveTopologyIndex_) {
+    TreeTemplate<Node> * tree = TreeTemplateTools::parenthesisToTree(exhaustiveTopologies_[bestIndex]);
+    tree->setBranchLengths(0.1);
+    if (considerSequenceLikelihood_) {
+      levaluator_->setAlternativeTree(tree);
+      levaluator_->acceptAlternativeTree();
+      //The gene tree gets the branch lengths optimized by the evaluator,
+      //rooted as in the listed topology, on its first leaf.
+      std::string outgroup = tree->getLeavesNames()[0];
+      delete tree;
+      tree = dynamic_cast<const TreeTemplate<Node> *> (levaluator_->getTree())->clone();
+      tree->newOutGroup(tree->getLeafId(outgroup));
+    }
+    if (rootedTree_) delete rootedTree_;
+    rootedTree_ = tree;
+    exhaustiveTopologyIndex_ = bestIndex;
+  }
+  rootedTree_->resetNodesId();
+  //One more reconciliation, to update the "_num*Lineages" vectors.
+  computeReconciliationLikelihood();
 }
 
 
@@ -1402,7 +1509,7 @@ size_t DLGeneTreeLikelihood::findBestGeneTreeAmongCandidates(vector<Tree*> &tree
     for (size_t i = 0; i < trees.size() ; ++i) {
         candidateTree = dynamic_cast < TreeTemplate < Node > * > (trees[i]);
         candidateScenarioLk =  findMLReconciliationDR (spTree_, candidateTree,
-                                                       seqSp_, spId_,
+                                                       seqSp_, *spId_,
                                                        lossExpectedNumbers_, duplicationExpectedNumbers_,
                                                        tentativeMLindex_,
                                                        tentativeNum0Lineages_, tentativeNum1Lineages_,
@@ -93,6 +93,11 @@ public GeneTreeLikelihood
   mutable std::vector <int> tentativeNum1Lineages_; 
   mutable std::vector <int> tentativeNum2Lineages_;
   mutable bool DLStartingGeneTree_;
+  //For small families: all gene tree topologies, with their sequence log-likelihoods,
+  //and the index of the current one, -1 if they have not been computed yet.
+  std::vector <std::string> exhaustiveTopologies_;
+  std::vector <double> exhaustiveSequenceLogLks_;
+  int exhaustiveTopologyIndex_;
   
 public:
   
@@ -165,10 +170,9 @@ public:
    * @param data Sequences to use.
    * @param model The substitution model to use.
    * @param rDist The rate across sites distribution to use.
-   * @param spTree The species tree
+   * @param spSnapshot The species tree and the link between species name and species ID, shared with the caller
    * @param rootedTree rooted version of the gene tree
    * @param seqSp link between sequence and species names
-   * @param spId link between species name and species ID
    * @param lossNumbers vector to store loss numbers per branch
    * @param lossProbabilities vector to store expected numbers of losses per branch
    * @param duplicationNumbers vector to store duplication numbers per branch
@@ -189,11 +193,10 @@ public:
     const SiteContainer & data,
     SubstitutionModel * model,
     DiscreteDistribution * rDist,
-    TreeTemplate<Node> & spTree,  
+    SpeciesTreeSnapshot & spSnapshot,
     TreeTemplate<Node> & rootedTree,  
     TreeTemplate<Node> & geneTreeWithSpNames,
     const std::map <std::string, std::string> seqSp,
-    std::map <std::string,int> spId,
     //std::vector <int> & lossNumbers, 
     std::vector <double> & lossProbabilities, 
     //std::vector <int> & duplicationNumbers, 
@@ -263,10 +266,6 @@ public:
   
   double getScenarioLikelihood() const throw (Exception) { return scenarioLikelihood_; }
   
-  void setSpTree(TreeTemplate<Node> & spTree) { if (spTree_) delete spTree_; spTree_ = spTree.clone(); }
-  
-  void setSpId(std::map <std::string, int> & spId) {spId_ = spId;}
-  
   double testNNI(int nodeId) const throw (NodeException);
   
   void doNNI(int nodeId) throw (NodeException);
@@ -342,6 +341,18 @@ public:
    * they have been tried.
    ************************************************************************/
   void refineGeneTreeNNIs(map<string, string> params, unsigned int verbose = 0);
+
+  /************************************************************************
+   * For small families, replaces the gene tree search: the sequence likelihoods
+   * of all topologies are computed at the first call and kept, and the topology
+   * with the best total likelihood is chosen by reconciling them all.
+   ************************************************************************/
+  void refineGeneTreeExhaustively(map<string, string> params);
+
+  /**
+   * @brief Replaces the gene tree, and forgets the topologies listed for small families.
+   */
+  void setGeneTree(bpp::TreeTemplate<bpp::Node>* tree, bpp::TreeTemplate<bpp::Node>* rootedTree);
   
   /************************************************************************
    * Tells if the gene family is single copy (1 gene per sp)
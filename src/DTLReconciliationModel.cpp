@@ -0,0 +1,297 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <Bpp/Exceptions.h>
+
+#include "DTLReconciliationModel.h"
+#include "TreeSplits.h"
+
+using namespace bpp;
+
+
+//Relative tolerance and maximal number of sweeps used to solve the transfer term of a clade.
+static const double MEAN_TOLERANCE = 1e-12;
+static const unsigned int MAX_NUMBER_OF_SWEEPS = 1000;
+
+/******************************************************************************/
+
+DTLReconciliationModel::DTLReconciliationModel(double duplicationRate, double transferRate, double lossRate):
+speciationProbability_(0), duplicationProbability_(0), transferProbability_(0), lossProbability_(0),
+son0_(), son1_(), extinction_(), meanExtinction_(0), cache_(), numberOfCacheHits_(0)
+{
+  double sum = 1.0 + duplicationRate + transferRate + lossRate;
+  speciationProbability_ = 1.0 / sum;
+  duplicationProbability_ = duplicationRate / sum;
+  transferProbability_ = transferRate / sum;
+  lossProbability_ = lossRate / sum;
+}
+
+/******************************************************************************/
+
+void DTLReconciliationModel::setSpeciesTree(const TreeTemplate<Node> & spTree)
+{
+  size_t numberOfBranches = spTree.getNumberOfNodes();
+  son0_.assign(numberOfBranches, -1);
+  son1_.assign(numberOfBranches, -1);
+  std::vector <const Node *> nodes = spTree.getNodes();
+  for (size_t i = 0 ; i < nodes.size() ; i++)
+  {
+    if (!nodes[i]->isLeaf())
+    {
+      son0_[nodes[i]->getId()] = nodes[i]->getSon(0)->getId();
+      son1_[nodes[i]->getId()] = nodes[i]->getSon(1)->getId();
+    }
+  }
+  //Extinction probabilities are the fixed point of their equations, sons being
+  //visited before fathers as ids are numbered breadth-first.
+  extinction_.assign(numberOfBranches, 0.0);
+  meanExtinction_ = 0.0;
+  for (unsigned int iteration = 0 ; iteration < 1000 ; iteration++)
+  {
+    double change = 0.0;
+    for (size_t e = numberOfBranches ; e-- > 0 ; )
+    {
+      double E = extinction_[e];
+      double newE = lossProbability_ + duplicationProbability_ * E * E + transferProbability_ * E * meanExtinction_;
+      if (son0_[e] >= 0)
+        newE += speciationProbability_ * extinction_[son0_[e]] * extinction_[son1_[e]];
+      change = std::max(change, std::abs(newE - E));
+      extinction_[e] = newE;
+    }
+    double sum = 0.0;
+    for (size_t e = 0 ; e < numberOfBranches ; e++)
+      sum += extinction_[e];
+    meanExtinction_ = sum / static_cast<double>(numberOfBranches);
+    if (change < 1e-12)
+      break;
+  }
+  cache_.clear();
+}
+
+/******************************************************************************/
+
+void DTLReconciliationModel::solveClade(const std::vector <double> & fixedTerms, double * row, double & mean, double & scale) const
+{
+  size_t numberOfBranches = extinction_.size();
+  std::fill(row, row + numberOfBranches, 0.0);
+  mean = 0.0;
+  for (unsigned int sweep = 0 ; sweep < MAX_NUMBER_OF_SWEEPS ; sweep++)
+  {
+    double sum = 0.0;
+    for (size_t e = numberOfBranches ; e-- > 0 ; )
+    {
+      //Duplication or transfer followed by the loss of one copy, and speciation followed by a loss.
+      //The terms in row[e] itself are solved exactly, sons being solved before fathers.
+      double p = fixedTerms[e] + transferProbability_ * mean * extinction_[e];
+      if (son0_[e] >= 0)
+        p += speciationProbability_ * (row[son0_[e]] * extinction_[son1_[e]] + row[son1_[e]] * extinction_[son0_[e]]);
+      p /= 1.0 - 2.0 * duplicationProbability_ * extinction_[e] - transferProbability_ * meanExtinction_;
+      row[e] = p;
+      sum += p;
+    }
+    double newMean = sum / static_cast<double>(numberOfBranches);
+    bool converged = (std::abs(newMean - mean) <= MEAN_TOLERANCE * newMean);
+    mean = newMean;
+    if (converged)
+      break;
+  }
+  double maxValue = *std::max_element(row, row + numberOfBranches);
+  if (maxValue > 0.0)
+  {
+    for (size_t e = 0 ; e < numberOfBranches ; e++)
+      row[e] /= maxValue;
+    mean /= maxValue;
+    scale += log(maxValue);
+  }
+}
+
+/******************************************************************************/
+
+void DTLReconciliationModel::computeClade(const double * row0, double mean0, double scale0,
+                                          const double * row1, double mean1, double scale1,
+                                          std::vector <double> & fixedTerms,
+                                          double * row, double & mean, double & scale) const
+{
+  size_t numberOfBranches = extinction_.size();
+  for (size_t e = 0 ; e < numberOfBranches ; e++)
+  {
+    //Duplication, and transfer of either subclade.
+    double p = 2.0 * duplicationProbability_ * row0[e] * row1[e]
+      + transferProbability_ * (row0[e] * mean1 + row1[e] * mean0);
+    if (son0_[e] >= 0)
+      p += speciationProbability_ * (row0[son0_[e]] * row1[son1_[e]] + row1[son0_[e]] * row0[son1_[e]]);
+    fixedTerms[e] = p;
+  }
+  scale = scale0 + scale1;
+  solveClade(fixedTerms, row, mean, scale);
+}
+
+/******************************************************************************/
+
+static void getNodesInPostorder(const Node * node, std::vector <const Node *> & nodes)
+{
+  for (size_t i = 0 ; i < node->getNumberOfSons() ; i++)
+    getNodesInPostorder(node->getSon(i), nodes);
+  nodes.push_back(node);
+}
+
+/******************************************************************************/
+
+double DTLReconciliationModel::computeLogLikelihood(const TreeTemplate<Node> & geneTree,
+                                                    const std::map <std::string, std::string> & seqSp,
+                                                    const std::map <std::string, int> & spId)
+{
+  std::vector <std::string> leafNames = geneTree.getLeavesNames();
+  std::sort(leafNames.begin(), leafNames.end());
+  std::vector <int> leafSpecies (leafNames.size());
+  std::string key = computeUnrootedTopologyKey(geneTree);
+  for (size_t i = 0 ; i < leafNames.size() ; i++)
+  {
+    std::map <std::string, std::string>::const_iterator sp = seqSp.find(leafNames[i]);
+    std::map <std::string, int>::const_iterator id = (sp != seqSp.end()) ? spId.find(sp->second) : spId.end();
+    if (id == spId.end())
+      throw Exception("DTLReconciliationModel::computeLogLikelihood: no species for gene " + leafNames[i]);
+    leafSpecies[i] = id->second;
+    key += leafNames[i] + ":" + sp->second + ";";
+  }
+  //Gene trees of a collection may be scored by several threads, which share the cache.
+  bool isCached = false;
+  double cachedLogLk = 0.0;
+# ifdef _OPENMP
+#pragma omp critical(DTLReconciliationModelCache)
+# endif
+  {
+    std::map <std::string, double>::const_iterator cached = cache_.find(key);
+    if (cached != cache_.end())
+    {
+      numberOfCacheHits_++;
+      isCached = true;
+      cachedLogLk = cached->second;
+    }
+  }
+  if (isCached)
+    return cachedLogLk;
+
+  size_t numberOfBranches = extinction_.size();
+  std::vector <const Node *> nodes;
+  getNodesInPostorder(geneTree.getRootNode(), nodes);
+  std::map <const Node *, size_t> index;
+  for (size_t i = 0 ; i < nodes.size() ; i++)
+    index[nodes[i]] = i;
+
+  //down: clade below each node; up: clade on the other side of the branch above each node.
+  std::vector <double> down (nodes.size() * numberOfBranches, 0.0);
+  std::vector <double> up (nodes.size() * numberOfBranches, 0.0);
+  std::vector <double> downMean (nodes.size(), 0.0), downScale (nodes.size(), 0.0);
+  std::vector <double> upMean (nodes.size(), 0.0), upScale (nodes.size(), 0.0);
+  std::vector <double> fixedTerms (numberOfBranches, 0.0);
+
+  for (size_t i = 0 ; i < nodes.size() ; i++)
+  {
+    if (nodes[i]->isLeaf())
+    {
+      size_t leaf = std::lower_bound(leafNames.begin(), leafNames.end(), nodes[i]->getName()) - leafNames.begin();
+      std::fill(fixedTerms.begin(), fixedTerms.end(), 0.0);
+      fixedTerms[leafSpecies[leaf]] = speciationProbability_;
+      solveClade(fixedTerms, &down[i * numberOfBranches], downMean[i], downScale[i]);
+    }
+    else
+    {
+      size_t s0 = index[nodes[i]->getSon(0)];
+      size_t s1 = index[nodes[i]->getSon(1)];
+      computeClade(&down[s0 * numberOfBranches], downMean[s0], downScale[s0],
+                   &down[s1 * numberOfBranches], downMean[s1], downScale[s1],
+                   fixedTerms, &down[i * numberOfBranches], downMean[i], downScale[i]);
+    }
+  }
+
+  //Fathers come after their sons in nodes, the root being last.
+  for (size_t i = nodes.size() - 1 ; i-- > 0 ; )
+  {
+    const Node * father = nodes[i]->getFather();
+    size_t f = index[father];
+    size_t sibling = index[(father->getSon(0) == nodes[i]) ? father->getSon(1) : father->getSon(0)];
+    if (!father->hasFather())
+    {
+      std::copy(down.begin() + sibling * numberOfBranches, down.begin() + (sibling + 1) * numberOfBranches,
+                up.begin() + i * numberOfBranches);
+      upMean[i] = downMean[sibling];
+      upScale[i] = downScale[sibling];
+    }
+    else
+    {
+      computeClade(&up[f * numberOfBranches], upMean[f], upScale[f],
+                   &down[sibling * numberOfBranches], downMean[sibling], downScale[sibling],
+                   fixedTerms, &up[i * numberOfBranches], upMean[i], upScale[i]);
+    }
+  }
+
+  //Each branch of the gene tree is a possible root, the two sons of the root giving the same one.
+  //Genes originate on any branch of the species tree, and are conditioned on having survived.
+  std::vector <double> rootRow (numberOfBranches, 0.0);
+  double bestLogLk = -std::numeric_limits<double>::infinity();
+  const Node * skipped = 0;
+  if (nodes.size() == 1)
+    bestLogLk = log(downMean[0]) + downScale[0];
+  else
+    skipped = geneTree.getRootNode()->getSon(1);
+  for (size_t i = 0 ; i + 1 < nodes.size() ; i++)
+  {
+    if (nodes[i] == skipped)
+      continue;
+    double rootMean, rootScale;
+    computeClade(&down[i * numberOfBranches], downMean[i], downScale[i],
+                 &up[i * numberOfBranches], upMean[i], upScale[i],
+                 fixedTerms, &rootRow[0], rootMean, rootScale);
+    bestLogLk = std::max(bestLogLk, log(rootMean) + rootScale);
+  }
+  bestLogLk -= log(1.0 - meanExtinction_);
+# ifdef _OPENMP
+#pragma omp critical(DTLReconciliationModelCache)
+# endif
+  cache_[key] = bestLogLk;
+  return bestLogLk;
+}
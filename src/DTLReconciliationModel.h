@@ -0,0 +1,136 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* This file contains the undated duplication, transfer and loss model used to reconcile fixed gene trees.*/
+
+#ifndef _DTLRECONCILIATIONMODEL_H_
+#define _DTLRECONCILIATIONMODEL_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <Bpp/Phyl/TreeTemplate.h>
+#include <Bpp/Phyl/Node.h>
+
+
+/**
+ * @brief Likelihood of gene trees under an undated model of duplication, transfer and loss.
+ *
+ * A gene lineage on a branch of the species tree duplicates, is transferred, is lost,
+ * or reaches the end of the branch (a speciation, or a sampled gene at a leaf), with
+ * probabilities proportional to the duplication, transfer and loss rates and to 1.
+ * Transfers go to any branch of the species tree with the same probability, so that
+ * no time slices are needed, as in the undated model of Szollosi et al. (2013),
+ * Syst. Biol. 62(6), pp. 901-912.
+ *
+ * Probabilities are kept in flat arrays of one row per clade of the gene tree and one
+ * column per branch of the species tree, a branch being given by the id of its lower
+ * node, as for the DL model. Each row is scaled by its largest value, so that large
+ * gene trees do not underflow.
+ *
+ * The likelihood of a gene tree is the one of its most likely root, and is kept
+ * in a cache keyed by the unrooted gene tree, emptied when the species
+ * tree changes: files of fixed gene trees often contain the same tree many times.
+ * computeLogLikelihood can be called from several OpenMP threads at once, as long as
+ * the species tree is not changed meanwhile.
+ */
+class DTLReconciliationModel
+{
+  double speciationProbability_;
+  double duplicationProbability_;
+  double transferProbability_;
+  double lossProbability_;
+  //For each species node id, the ids of its sons, -1 for leaves.
+  std::vector <int> son0_;
+  std::vector <int> son1_;
+  //Probability that a gene on each branch has no sampled descendant, and its mean over branches.
+  std::vector <double> extinction_;
+  double meanExtinction_;
+  std::map <std::string, double> cache_;
+  unsigned int numberOfCacheHits_;
+
+public:
+  /**
+   * @param duplicationRate, transferRate, lossRate Rates of events, relative to the speciation rate.
+   */
+  DTLReconciliationModel(double duplicationRate, double transferRate, double lossRate);
+
+  /**
+   * @brief Sets the species tree, whose node ids must be numbered breadth-first, and empties the cache.
+   */
+  void setSpeciesTree(const bpp::TreeTemplate<bpp::Node> & spTree);
+
+  /**
+   * @brief Computes the log-likelihood of the gene tree at its most likely root.
+   *
+   * @param seqSp Link between sequence and species names.
+   * @param spId Link between species names and species node ids.
+   */
+  double computeLogLikelihood(const bpp::TreeTemplate<bpp::Node> & geneTree,
+                              const std::map <std::string, std::string> & seqSp,
+                              const std::map <std::string, int> & spId);
+
+  unsigned int getNumberOfCacheHits() const { return numberOfCacheHits_; }
+
+private:
+  /**
+   * Solves the probabilities of a clade on all branches, given the terms that do not
+   * depend on the clade itself (events giving its two subclades, or the sampled gene
+   * of a leaf). Each sweep from the leaves to the root of the species tree solves the
+   * terms of a branch in itself exactly; sweeps are repeated until the mean over
+   * branches, which transfers depend on, converges.
+   * The row is then divided by its largest value, whose log is added to scale.
+   */
+  void solveClade(const std::vector <double> & fixedTerms, double * row, double & mean, double & scale) const;
+
+  /**
+   * Computes the row of the clade made of the clades with rows row0 and row1.
+   */
+  void computeClade(const double * row0, double mean0, double scale0,
+                    const double * row1, double mean1, double scale1,
+                    std::vector <double> & fixedTerms,
+                    double * row, double & mean, double & scale) const;
+};
+
+
+#endif  //_DTLRECONCILIATIONMODEL_H_
@@ -0,0 +1,182 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include <Bpp/Exceptions.h>
+#include <Bpp/Text/TextTools.h>
+#include <Bpp/Text/StringTokenizer.h>
+
+#include "FamilyManifest.h"
+
+using namespace bpp;
+
+
+const std::string FamilyManifest::HEADER = "#PHYLDOG manifest";
+const std::string FamilyManifest::FAMILIES_SECTION = "[families]";
+
+
+/******************************************************************************/
+
+FamilyManifest::FamilyManifest(const std::string & file) :
+  file_(file), defaults_(), stream_(file.c_str())
+{
+  if (!stream_)
+    throw Exception("FamilyManifest: unable to open " + file);
+  std::string line;
+  bool foundFamilies = false;
+  while (getline(stream_, line))
+  {
+    line = TextTools::removeSurroundingWhiteSpaces(line);
+    if (line == FAMILIES_SECTION) {
+      foundFamilies = true;
+      break;
+    }
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::string::size_type equal = line.find('=');
+    if (equal == std::string::npos)
+      throw Exception("FamilyManifest: line '" + line + "' of " + file + " is not of the form option=value.");
+    defaults_[TextTools::removeSurroundingWhiteSpaces(line.substr(0, equal))] =
+      TextTools::removeSurroundingWhiteSpaces(line.substr(equal + 1));
+  }
+  if (!foundFamilies)
+    throw Exception("FamilyManifest: no " + FAMILIES_SECTION + " section in " + file);
+}
+
+/******************************************************************************/
+
+bool FamilyManifest::isManifest(const std::string & file)
+{
+  std::ifstream in(file.c_str());
+  std::string line;
+  getline(in, line);
+  return (TextTools::removeSurroundingWhiteSpaces(line) == HEADER);
+}
+
+/******************************************************************************/
+
+bool FamilyManifest::isManifestEntry(const std::string & entry)
+{
+  return (entry.find('@') != std::string::npos);
+}
+
+/******************************************************************************/
+
+std::vector<std::string> FamilyManifest::buildIndex()
+{
+  std::vector<std::string> entries;
+  std::vector<std::string> sizes;
+  bool allSized = true;
+  std::string line;
+  stream_.clear();
+  stream_.seekg(0);
+  while (getline(stream_, line) && TextTools::removeSurroundingWhiteSpaces(line) != FAMILIES_SECTION) {}
+  std::streamoff offset = stream_.tellg();
+  while (getline(stream_, line))
+  {
+    std::streamoff next = stream_.tellg();
+    if (!TextTools::removeSurroundingWhiteSpaces(line).empty() && line[0] != '#')
+    {
+      StringTokenizer st(line, "\t");
+      std::string name = TextTools::removeSurroundingWhiteSpaces(st.nextToken());
+      //'@' and ':' separate the fields of the entries we build.
+      if (name.find_first_of("@:") != std::string::npos)
+        throw Exception("FamilyManifest: family name " + name + " of " + file_ + " contains '@' or ':', which are not allowed.");
+      std::string size = "";
+      while (st.hasMoreToken()) {
+        std::string field = TextTools::removeSurroundingWhiteSpaces(st.nextToken());
+        if (field.substr(0, 5) == "size=")
+          size = field.substr(5);
+      }
+      if (size.empty())
+        allSized = false;
+      entries.push_back(name + "@" + TextTools::toString(offset));
+      sizes.push_back(size);
+    }
+    offset = next;
+  }
+  if (allSized)
+    for (size_t i = 0 ; i < entries.size() ; i++)
+      entries[i] = entries[i] + ":" + sizes[i];
+  return entries;
+}
+
+/******************************************************************************/
+
+std::string FamilyManifest::readRecord(const std::string & entry, std::map<std::string, std::string> & record)
+{
+  std::string::size_type at = entry.rfind('@');
+  std::streamoff offset = TextTools::to<std::streamoff>(entry.substr(at + 1));
+  stream_.clear();
+  stream_.seekg(offset);
+  std::string line;
+  getline(stream_, line);
+
+  StringTokenizer st(line, "\t");
+  std::string name = TextTools::removeSurroundingWhiteSpaces(st.nextToken());
+  if (name != entry.substr(0, at))
+    throw Exception("FamilyManifest: the record at offset " + entry.substr(at + 1) + " of " + file_ + " is not family " + entry.substr(0, at) + "; was the manifest modified during the run?");
+  record.clear();
+  record["DATA"] = name;
+  while (st.hasMoreToken())
+  {
+    std::string field = TextTools::removeSurroundingWhiteSpaces(st.nextToken());
+    std::string::size_type equal = field.find('=');
+    if (equal == std::string::npos)
+      throw Exception("FamilyManifest: field '" + field + "' of family " + name + " is not of the form option=value.");
+    std::string option = field.substr(0, equal);
+    std::string value = field.substr(equal + 1);
+    if (option == "size")
+      continue;
+    else if (option == "alignment")
+      record["input.sequence.file"] = value;
+    else if (option == "link")
+      record["taxaseq.file"] = value;
+    else if (option == "tree") {
+      record["gene.tree.file"] = value;
+      if (record.find("init.gene.tree") == record.end())
+        record["init.gene.tree"] = "user";
+    }
+    else
+      record[option] = value;
+  }
+  return name;
+}
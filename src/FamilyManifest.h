@@ -0,0 +1,127 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* This file contains the reader of gene family manifests: a single file describing all gene families, used instead of one option file per family.*/
+
+#ifndef _FAMILYMANIFEST_H_
+#define _FAMILYMANIFEST_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+
+
+/**
+ * @brief Reader of a gene family manifest.
+ *
+ * A manifest can be given with genelist.file instead of a list of option files.
+ * Its format is:
+ * @code
+ * #PHYLDOG manifest
+ * # Options shared by all families, one per line, as in a family option file:
+ * alphabet=DNA
+ * input.sequence.format=Fasta
+ * output.reconciled.tree.file=$(RESULT)$(DATA)_Reconciled.tree
+ * ...
+ * [families]
+ * HBG000001	alignment=/data/HBG000001.fasta	link=/data/HBG000001.link	size=65000
+ * HBG000002	alignment=/data/HBG000002.fasta	link=/data/HBG000002.link	tree=/data/HBG000002.tree	model=HKY85
+ * @endcode
+ * There is one record per line, fields being separated by tabulations: the family name,
+ * then options that override the shared ones for this family. alignment, link and tree are short
+ * for input.sequence.file, taxaseq.file and gene.tree.file (tree also sets init.gene.tree=user),
+ * and size is the weight of the family for load balancing. $(DATA) is the family name, which
+ * may not contain '@' or ':'.
+ *
+ * The server only builds an index of the records (their offsets in the file), and sends
+ * each client entries of the form name\@offset; clients then read their records directly.
+ */
+class FamilyManifest
+{
+  std::string file_;
+  std::map<std::string, std::string> defaults_;
+  std::ifstream stream_;
+
+public:
+  static const std::string HEADER;
+  static const std::string FAMILIES_SECTION;
+
+  /**
+   * @brief Opens the manifest and reads the shared options.
+   */
+  FamilyManifest(const std::string & file);
+
+private:
+  FamilyManifest(const FamilyManifest &);
+  FamilyManifest & operator=(const FamilyManifest &);
+
+public:
+  /**
+   * @return true if the file starts with the manifest header.
+   */
+  static bool isManifest(const std::string & file);
+
+  /**
+   * @return true if an entry of the list of families designates a manifest record.
+   */
+  static bool isManifestEntry(const std::string & entry);
+
+  const std::map<std::string, std::string> & getDefaults() const { return defaults_; }
+
+  /**
+   * @brief Lists all records as name\@offset, or name\@offset:size if all records have a size,
+   * in the format expected by generateListOfOptionsPerClient.
+   */
+  std::vector<std::string> buildIndex();
+
+  /**
+   * @brief Reads the record of an entry built by buildIndex.
+   * @param entry name\@offset.
+   * @param record filled with the options of this family only.
+   * @return the family name.
+   */
+  std::string readRecord(const std::string & entry, std::map<std::string, std::string> & record);
+};
+
+
+#endif  //_FAMILYMANIFEST_H_
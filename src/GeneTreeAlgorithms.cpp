@@ -1910,3 +1910,61 @@ Node * removeNodesWithDegree1(Node * node) {
         return node;
     }
 }
+
+
+
+/**************************************************************************
+ * Writes the subtree of node in Newick format, with a new leaf
+ * grafted on the branch above target.
+ **************************************************************************/
+static std::string subtreeToParenthesisWithGraftedLeaf(const Node * node, const Node * target, const std::string & leafName)
+{
+    std::string s;
+    if (node->isLeaf()) {
+        s = node->getName();
+    }
+    else {
+        s = "(";
+        for (unsigned int i = 0 ; i < node->getNumberOfSons() ; i++) {
+            if (i > 0)
+                s += ",";
+            s += subtreeToParenthesisWithGraftedLeaf(node->getSon(i), target, leafName);
+        }
+        s += ")";
+    }
+    if (node == target)
+        s = "(" + s + "," + leafName + ")";
+    return s;
+}
+
+
+/**************************************************************************
+ * This function lists all unrooted binary topologies of the given leaves,
+ * as Newick strings without branch lengths, rooted on the first leaf.
+ * The rooted topologies of the other leaves are built by stepwise addition,
+ * each new leaf being grafted on every branch, including above the root.
+ **************************************************************************/
+std::vector <std::string> getAllUnrootedTopologies(const std::vector <std::string> & leafNames)
+{
+    std::vector <std::string> topologies;
+    if (leafNames.size() < 3)
+        return topologies;
+    topologies.push_back("(" + leafNames[1] + "," + leafNames[2] + ")");
+    for (size_t k = 3 ; k < leafNames.size() ; k++) {
+        std::vector <std::string> newTopologies;
+        for (size_t i = 0 ; i < topologies.size() ; i++) {
+            TreeTemplate<Node> * tree = TreeTemplateTools::parenthesisToTree(topologies[i] + ";");
+            std::vector <Node *> nodes = tree->getNodes();
+            for (size_t j = 0 ; j < nodes.size() ; j++) {
+                newTopologies.push_back(subtreeToParenthesisWithGraftedLeaf(tree->getRootNode(), nodes[j], leafNames[k]));
+            }
+            delete tree;
+        }
+        topologies.swap(newTopologies);
+    }
+    for (size_t i = 0 ; i < topologies.size() ; i++) {
+        topologies[i] = "(" + leafNames[0] + "," + topologies[i] + ");";
+    }
+    return topologies;
+}
+
@@ -354,6 +354,14 @@ void editDuplicationNodesMuffato
  bpp::Node * removeNodesWithDegree1 ( bpp::Node * node
  
  ) ;
+
+
+/**************************************************************************
+ * This function lists all unrooted binary topologies of the given leaves,
+ * as Newick strings without branch lengths, rooted on the first leaf.
+ * There are (2n-5)!! of them for n leaves, i.e. 945 for 7 leaves.
+ **************************************************************************/
+std::vector <std::string> getAllUnrootedTopologies(const std::vector <std::string> & leafNames);
  
  
  #endif //_GENETREEALGORITHMS_H_
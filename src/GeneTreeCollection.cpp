@@ -0,0 +1,219 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include <Bpp/Phyl/Io/Newick.h>
+#include <Bpp/Phyl/TreeTemplateTools.h>
+
+#include "GeneTreeCollection.h"
+#include "ReconciliationTools.h"
+#include "COALTools.h"
+#include "GenericTreeExplorationAlgorithms.h"
+
+using namespace bpp;
+
+
+/******************************************************************************/
+
+GeneTreeCollection::GeneTreeCollection(const std::string & file,
+                                       const std::map <std::string, std::string> & seqSp,
+                                       const TreeTemplate<Node> & spTree):
+file_(file), trees_(), seqSp_(), numberOfDiscardedTrees_(0)
+{
+  std::vector <std::string> spNames = spTree.getLeavesNames();
+  std::set <std::string> species (spNames.begin(), spNames.end());
+  std::vector <Tree*> trees;
+  Newick newick(true);
+  newick.read(file, trees);
+  for (unsigned int i = 0 ; i < trees.size() ; i++)
+  {
+    TreeTemplate<Node> * tree = new TreeTemplate<Node>(*(trees[i]));
+    delete trees[i];
+    //Leaves are named after species if there is no link file.
+    std::vector <std::string> leafNames = tree->getLeavesNames();
+    std::vector <std::string> toDrop;
+    for (unsigned int j = 0 ; j < leafNames.size() ; j++)
+    {
+      std::map <std::string, std::string>::const_iterator it = seqSp.find(leafNames[j]);
+      if (seqSp.empty())
+        seqSp_[leafNames[j]] = leafNames[j];
+      else if (it != seqSp.end())
+        seqSp_[leafNames[j]] = it->second;
+      else {
+        std::cerr << "Error: sequence "<< leafNames[j] << " of a gene tree in "<< file
+                  << " is not in the file given by taxaseq.file."<<std::endl;
+        MPI::COMM_WORLD.Abort(1);
+        exit(-1);
+      }
+      if (species.find(seqSp_[leafNames[j]]) == species.end())
+        toDrop.push_back(leafNames[j]);
+    }
+    if (leafNames.size() - toDrop.size() < 3)
+    {
+      numberOfDiscardedTrees_++;
+      delete tree;
+      continue;
+    }
+    if (!toDrop.empty())
+      dropLeaves(*tree, toDrop);
+    if (!tree->isRooted())
+      tree->newOutGroup(tree->getLeaves()[0]);
+    tree->resetNodesId();
+    trees_.push_back(tree);
+  }
+}
+
+/******************************************************************************/
+
+GeneTreeCollection::~GeneTreeCollection()
+{
+  for (unsigned int i = 0 ; i < trees_.size() ; i++)
+    delete trees_[i];
+}
+
+/******************************************************************************/
+
+double GeneTreeCollection::computeDLLogLikelihood(TreeTemplate<Node> & spTree,
+                                                  const std::map <std::string, int> & spId,
+                                                  const std::vector <double> & lossExpectedNumbers,
+                                                  const std::vector <double> & duplicationExpectedNumbers,
+                                                  std::vector <int> & num0Lineages,
+                                                  std::vector <int> & num1Lineages,
+                                                  std::vector <int> & num2Lineages)
+{
+  double logL = 0.0;
+  size_t numberOfSpNodes = spTree.getNumberOfNodes();
+  //Gene trees are reconciled in parallel: the species tree is only read,
+  //and each thread sums its own counts, which are added to the totals at the end.
+# ifdef _OPENMP
+#pragma omp parallel reduction(-:logL)
+# endif
+  {
+    std::vector <int> num0 (numberOfSpNodes, 0);
+    std::vector <int> num1 (numberOfSpNodes, 0);
+    std::vector <int> num2 (numberOfSpNodes, 0);
+    std::vector <int> sum0 (numberOfSpNodes, 0);
+    std::vector <int> sum1 (numberOfSpNodes, 0);
+    std::vector <int> sum2 (numberOfSpNodes, 0);
+    std::set <int> nodesToTryInNNISearch;
+# ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+# endif
+    for (size_t i = 0 ; i < trees_.size() ; i++)
+    {
+      int MLindex = -1;
+      std::fill(num0.begin(), num0.end(), 0);
+      std::fill(num1.begin(), num1.end(), 0);
+      std::fill(num2.begin(), num2.end(), 0);
+      nodesToTryInNNISearch.clear();
+      logL -= findMLReconciliationDR (&spTree, trees_[i], seqSp_, spId,
+                                      lossExpectedNumbers, duplicationExpectedNumbers,
+                                      MLindex, num0, num1, num2,
+                                      nodesToTryInNNISearch);
+      for (unsigned int j = 0 ; j < numberOfSpNodes ; j++)
+      {
+        sum0[j] += num0[j];
+        sum1[j] += num1[j];
+        sum2[j] += num2[j];
+      }
+    }
+# ifdef _OPENMP
+#pragma omp critical(GeneTreeCollectionCounts)
+# endif
+    for (unsigned int j = 0 ; j < numberOfSpNodes ; j++)
+    {
+      num0Lineages[j] += sum0[j];
+      num1Lineages[j] += sum1[j];
+      num2Lineages[j] += sum2[j];
+    }
+  }
+  return logL;
+}
+
+/******************************************************************************/
+
+double GeneTreeCollection::computeCOALLogLikelihood(TreeTemplate<Node> & spTree,
+                                                    const std::map <std::string, int> & spId,
+                                                    const std::vector <double> & coalBls,
+                                                    std::vector <unsigned int> & num12Lineages,
+                                                    std::vector <unsigned int> & num22Lineages)
+{
+  double logL = 0.0;
+  size_t numberOfSpNodes = spTree.getNumberOfNodes();
+  //Not threaded: the coalescent likelihoods of COALTools are memoized in static tables.
+  std::set <int> nodesToTryInNNISearch;
+  //coalCounts: vector of genetreenbnodes vectors of 3 (3 directions) vectors of sptreenbnodes vectors of 2 ints
+  std::vector < std::vector < std::vector < std::vector <unsigned int> > > > coalCounts;
+  std::vector < std::vector < std::vector <unsigned int> > > coalCounts2 (3,
+      std::vector < std::vector <unsigned int> > (numberOfSpNodes, std::vector <unsigned int> (2, 0)));
+  for (unsigned int i = 0 ; i < trees_.size() ; i++)
+  {
+    int MLindex = -1;
+    coalCounts.assign(trees_[i]->getNumberOfNodes(), coalCounts2);
+    nodesToTryInNNISearch.clear();
+    logL -= findMLCoalReconciliationDR (&spTree, trees_[i], seqSp_, spId,
+                                        coalBls, MLindex, coalCounts,
+                                        nodesToTryInNNISearch);
+    //Same as COALGeneTreeLikelihood::computeNumLineagesFromCoalCounts
+    for (unsigned int j = 0 ; j < numberOfSpNodes ; j++)
+    {
+      if ( coalCounts[0][0][j][0] == 1 && coalCounts[0][0][j][1] == 2 )
+        num12Lineages[j] += 1;
+      else if ( coalCounts[0][0][j][0] == coalCounts[0][0][j][1] && coalCounts[0][0][j][1] != 1 )
+        num22Lineages[j] += 1;
+    }
+  }
+  return logL;
+}
+
+/******************************************************************************/
+
+double GeneTreeCollection::computeDTLLogLikelihood(DTLReconciliationModel & model,
+                                                   const std::map <std::string, int> & spId)
+{
+  double logL = 0.0;
+# ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(-:logL)
+# endif
+  for (size_t i = 0 ; i < trees_.size() ; i++)
+    logL -= model.computeLogLikelihood(*trees_[i], seqSp_, spId);
+  return logL;
+}
@@ -0,0 +1,142 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* This file contains the gene tree collections used when species trees are scored from fixed gene trees only.*/
+
+#ifndef _GENETREECOLLECTION_H_
+#define _GENETREECOLLECTION_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <Bpp/Phyl/TreeTemplate.h>
+#include <Bpp/Phyl/Node.h>
+
+#include "DTLReconciliationModel.h"
+
+
+/**
+ * @brief A set of fixed gene trees, scored against species trees by reconciliation only.
+ *
+ * With reconciliation.only=yes, each entry of genelist.file is a Newick file containing
+ * many gene trees, one per line. No alignment is read and no sequence likelihood
+ * is computed: the likelihood of a species tree is the sum of the likelihoods
+ * of the most likely reconciliations of all gene trees, under the DL, the COAL or the DTL model.
+ *
+ * Leaves are linked to species with the file given by taxaseq.file (same format as
+ * for gene families), or are named after species if taxaseq.file=none.
+ * Leaves of species absent from the species tree are removed, and trees with less
+ * than 3 remaining leaves are discarded. Gene trees are rerooted at each computation
+ * to their most likely root, as for gene families.
+ */
+class GeneTreeCollection
+{
+  std::string file_;
+  std::vector < bpp::TreeTemplate<bpp::Node> * > trees_;
+  std::map <std::string, std::string> seqSp_;
+  unsigned int numberOfDiscardedTrees_;
+
+public:
+  /**
+   * @brief Reads all gene trees of file.
+   *
+   * @param file A Newick file with one gene tree per line.
+   * @param seqSp Link between sequence and species names; if empty, leaves are species names.
+   * @param spTree The species tree, whose leaves are the species considered.
+   */
+  GeneTreeCollection(const std::string & file,
+                     const std::map <std::string, std::string> & seqSp,
+                     const bpp::TreeTemplate<bpp::Node> & spTree);
+
+  ~GeneTreeCollection();
+
+private:
+  GeneTreeCollection(const GeneTreeCollection &);
+  GeneTreeCollection & operator=(const GeneTreeCollection &);
+
+public:
+  const std::string & getFile() const { return file_; }
+
+  size_t getNumberOfTrees() const { return trees_.size(); }
+
+  unsigned int getNumberOfDiscardedTrees() const { return numberOfDiscardedTrees_; }
+
+  /**
+   * @brief Computes the DL reconciliations of all gene trees.
+   *
+   * The numbers of lineages of all trees are added to num0Lineages, num1Lineages and num2Lineages.
+   * Gene trees are reconciled by all OpenMP threads, if the program is built with OpenMP.
+   * @return Minus the sum of the reconciliation log-likelihoods, as GeneTreeLikelihood::getValue().
+   */
+  double computeDLLogLikelihood(bpp::TreeTemplate<bpp::Node> & spTree,
+                                const std::map <std::string, int> & spId,
+                                const std::vector <double> & lossExpectedNumbers,
+                                const std::vector <double> & duplicationExpectedNumbers,
+                                std::vector <int> & num0Lineages,
+                                std::vector <int> & num1Lineages,
+                                std::vector <int> & num2Lineages);
+
+  /**
+   * @brief Computes the COAL reconciliations of all gene trees.
+   *
+   * The numbers of lineages of all trees are added to num12Lineages and num22Lineages.
+   * @return Minus the sum of the reconciliation log-likelihoods, as GeneTreeLikelihood::getValue().
+   */
+  double computeCOALLogLikelihood(bpp::TreeTemplate<bpp::Node> & spTree,
+                                  const std::map <std::string, int> & spId,
+                                  const std::vector <double> & coalBls,
+                                  std::vector <unsigned int> & num12Lineages,
+                                  std::vector <unsigned int> & num22Lineages);
+
+  /**
+   * @brief Computes the DTL likelihoods of all gene trees, whose species tree is set in model.
+   * Gene trees are scored by all OpenMP threads, if the program is built with OpenMP.
+   *
+   * @return Minus the sum of the log-likelihoods, as GeneTreeLikelihood::getValue().
+   */
+  double computeDTLLogLikelihood(DTLReconciliationModel & model,
+                                 const std::map <std::string, int> & spId);
+};
+
+
+#endif  //_GENETREECOLLECTION_H_
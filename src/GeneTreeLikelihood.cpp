@@ -61,10 +61,14 @@ class geneTreeLikelihoodException: public exception
 
 
 GeneTreeLikelihood::GeneTreeLikelihood():
-levaluator_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_(), spId_() {
+levaluator_(00), spSnapshot_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_(), spId_(00) {
   WHEREAMI( __FILE__ , __LINE__ );
   totalIterations_ = 0;
   counter_ = 0;
+  timeLimit_ = 0;
+  elapsedTime_ = 0;
+  roundDeadline_ = 0;
+  searchGain_ = 0;
 }
 
 
@@ -73,14 +77,13 @@ GeneTreeLikelihood::GeneTreeLikelihood(
   map<string, string> params,
   TreeTemplate<Node> & spTree )
 throw (exception):
-levaluator_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_(), spId_(),
+levaluator_(00), spSnapshot_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_(), spId_(00),
 params_(params), considerSequenceLikelihood_(true)
 {
   WHEREAMI( __FILE__ , __LINE__ );
   totalIterations_ = 0;
   counter_ = 0;
-  spTree_ = spTree.clone();
-  spId_ = computeSpeciesNamesToIdsMap(*spTree_);
+  setSpTree(spTree);
 
   bool avoidFamily = false;
 
@@ -96,6 +99,8 @@ params_(params), considerSequenceLikelihood_(true)
 
   timeLimit_ = ApplicationTools::getDoubleParameter("family.time.limit",params_,0);
   elapsedTime_ = 0;
+  roundDeadline_ = 0;
+  searchGain_ = 0;
 
 
   //TODO: dirty cont to eliminate
@@ -112,6 +117,12 @@ params_(params), considerSequenceLikelihood_(true)
     throw(Exception("Unable to load this family"));
   removeUselessSequencesFromAlignment( spTree_, levaluator_->getSites(), cont , spSeq, file) ;
 
+  //Identical sequences from the same species are searched as a single leaf, and put back in the output trees.
+  if (cont && ApplicationTools::getBooleanParameter("collapse.identical.sequences", params_, false, "", true, false))
+  {
+    collapseIdenticalSequences( levaluator_->getSites(), seqSp_, collapsedSequences_, file) ;
+  }
+
   if (cont) {
     /****************************************************************************
      * Then we need to get the file containing the gene tree,
@@ -119,6 +130,19 @@ params_(params), considerSequenceLikelihood_(true)
      *****************************************************************************/
     rootedTree_ = getTreeFromOptions(params_, levaluator_->getAlphabet(), levaluator_->getSites(), levaluator_->getSubstitutionModel(), levaluator_->getRateDistribution(), cont);
   }
+  if (cont && rootedTree_)
+  {
+    //A user gene tree still contains the collapsed sequences.
+    std::vector <std::string> leafNames = rootedTree_->getLeavesNames();
+    for (std::map <std::string, std::vector <std::string> >::iterator it = collapsedSequences_.begin(); it != collapsedSequences_.end(); ++it)
+    {
+      for (unsigned int j = 0 ; j < it->second.size() ; j++)
+      {
+        if (VectorTools::contains(leafNames, it->second[j]))
+          removeLeaf(*rootedTree_, it->second[j]);
+      }
+    }
+  }
 
   if (cont && qualityFilters)
   { //This family is phylogenetically informative
@@ -185,7 +209,7 @@ params_(params), considerSequenceLikelihood_(true)
       annotateGeneTreeWithDuplicationEvents (*spTree_,
                                              *rootedTree_,
                                              rootedTree_->getRootNode(),
-                                             seqSp_, spId_);
+                                             seqSp_, *spId_);
       nhx->write(*rootedTree_, startingGeneTreeFile, true);
 
       // newick.write(*geneTree_, startingGeneTreeFile, true);
@@ -317,11 +341,10 @@ GeneTreeLikelihood::GeneTreeLikelihood(
   const SiteContainer & data,
   SubstitutionModel * model,
   DiscreteDistribution * rDist,
-  TreeTemplate<Node> & spTree,
+  SpeciesTreeSnapshot & spSnapshot,
   TreeTemplate<Node> & rootedTree,
   TreeTemplate<Node> & geneTreeWithSpNames,
   const std::map <std::string, std::string> seqSp,
-  std::map <std::string,int> spId,
   int speciesIdLimitForRootPosition,
   int & MLindex,
 	std::map <std::string, std::string > params,
@@ -331,11 +354,11 @@ GeneTreeLikelihood::GeneTreeLikelihood(
   bool considerSequenceLikelihood,
   unsigned int sprLimitGeneTree)
 throw (Exception):
-levaluator_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_ (seqSp), spId_(spId), params_(params)
+levaluator_(00), spSnapshot_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_ (seqSp), spId_(00), params_(params)
 {
   WHEREAMI( __FILE__ , __LINE__ );
   levaluator_ = new LikelihoodEvaluator(&tree, &data, model, rDist, params, false, verbose);
-  spTree_ = spTree.clone();
+  setSpeciesTreeSnapshot(&spSnapshot);
   rootedTree_ = rootedTree.clone();
   geneTreeWithSpNames_ = geneTreeWithSpNames.clone();
   scenarioLikelihood_ = UNLIKELY;
@@ -349,6 +372,10 @@ levaluator_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_
   optimizeReconciliationLikelihood_ = true;
   considerSequenceLikelihood_ = considerSequenceLikelihood;
   sprLimitGeneTree_ = sprLimitGeneTree;
+  timeLimit_ = ApplicationTools::getDoubleParameter("family.time.limit",params_,0,"",false,false);
+  elapsedTime_ = 0;
+  roundDeadline_ = 0;
+  searchGain_ = 0;
 }
 
 
@@ -356,11 +383,11 @@ levaluator_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_
  * @brief Copy constructor.
  */
 GeneTreeLikelihood::GeneTreeLikelihood(const GeneTreeLikelihood & lik):
-levaluator_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_ (lik.seqSp_), spId_(lik.spId_), timeLimit_(lik.timeLimit_), elapsedTime_(lik.elapsedTime_)
+levaluator_(00), spSnapshot_(00), spTree_(00), rootedTree_(00), geneTreeWithSpNames_(00), seqSp_ (lik.seqSp_), collapsedSequences_ (lik.collapsedSequences_), spId_(00), timeLimit_(lik.timeLimit_), elapsedTime_(lik.elapsedTime_), roundDeadline_(lik.roundDeadline_), searchGain_(lik.searchGain_)
 {
   WHEREAMI( __FILE__ , __LINE__ );
   levaluator_ = lik.levaluator_->clone();
-  spTree_ = dynamic_cast<TreeTemplate<Node> *> (lik.spTree_->clone()) ;
+  setSpeciesTreeSnapshot(lik.spSnapshot_);
   rootedTree_ = dynamic_cast<TreeTemplate<Node> *> (lik.rootedTree_->clone()) ;
   geneTreeWithSpNames_ = dynamic_cast<TreeTemplate<Node> *> (lik.geneTreeWithSpNames_->clone()) ;
   scenarioLikelihood_ = lik.scenarioLikelihood_;
@@ -384,13 +411,11 @@ GeneTreeLikelihood & GeneTreeLikelihood::operator=(const GeneTreeLikelihood & li
   if (levaluator_) delete levaluator_;
   levaluator_ = lik.levaluator_->clone();
 
-  if (spTree_) delete spTree_;
-  spTree_ = dynamic_cast<TreeTemplate<Node> *> (lik.spTree_->clone());
+  setSpeciesTreeSnapshot(lik.spSnapshot_);
   if (rootedTree_) delete rootedTree_;
   rootedTree_= dynamic_cast<TreeTemplate<Node> *> (lik.rootedTree_->clone());
   if (geneTreeWithSpNames_) delete geneTreeWithSpNames_;
   geneTreeWithSpNames_ = dynamic_cast<TreeTemplate<Node> *> (lik.geneTreeWithSpNames_->clone()) ;
-  spId_ = lik.spId_;
   scenarioLikelihood_ = lik.scenarioLikelihood_;
   MLindex_ = lik.MLindex_;
   rootOptimization_ = lik.rootOptimization_;
@@ -404,11 +429,24 @@ GeneTreeLikelihood & GeneTreeLikelihood::operator=(const GeneTreeLikelihood & li
   optimizeReconciliationLikelihood_ = lik.optimizeReconciliationLikelihood_ ;
   considerSequenceLikelihood_ = lik.considerSequenceLikelihood_;
   sprLimitGeneTree_ = lik.sprLimitGeneTree_;
+  collapsedSequences_ = lik.collapsedSequences_;
   timeLimit_ = lik.timeLimit_;
   elapsedTime_ = lik.elapsedTime_;
+  roundDeadline_ = lik.roundDeadline_;
+  searchGain_ = lik.searchGain_;
   return *this;
 }
 
+void GeneTreeLikelihood::setSpeciesTreeSnapshot(SpeciesTreeSnapshot * spSnapshot) {
+  if (spSnapshot == spSnapshot_)
+    return;
+  SpeciesTreeSnapshot::acquire(spSnapshot);
+  SpeciesTreeSnapshot::release(spSnapshot_);
+  spSnapshot_ = spSnapshot;
+  spTree_ = spSnapshot_ ? &(spSnapshot_->getTree()) : 00;
+  spId_ = spSnapshot_ ? &(spSnapshot_->getSpId()) : 00;
+}
+
 void GeneTreeLikelihood::setGeneTree(TreeTemplate<Node>* tree, TreeTemplate<Node>* rootedTree) {
   WHEREAMI( __FILE__ , __LINE__ );
   if (rootedTree_) delete rootedTree_;
@@ -59,6 +59,7 @@
 #include "ReconciliationTools.h"
 #include "GeneTreeAlgorithms.h"
 #include "LikelihoodEvaluator.h"
+#include "SpeciesTreeSnapshot.h"
 
 #include <Bpp/Text/StringTokenizer.h>
 
@@ -88,11 +89,17 @@ protected:
   LikelihoodEvaluator * levaluator_;
 
   //  bpp::TreeTemplate<bpp::Node> * _tree;
+  //Species tree and species name to id map, possibly shared with other families.
+  SpeciesTreeSnapshot * spSnapshot_;
+  //Tree of spSnapshot_, not owned.
   bpp::TreeTemplate<bpp::Node> * spTree_;
   bpp::TreeTemplate<bpp::Node> * rootedTree_;
   bpp::TreeTemplate<bpp::Node> * geneTreeWithSpNames_;
   std::map <std::string, std::string> seqSp_; //link between sequence and species
-  std::map <std::string, int> spId_;
+  //Sequences removed by collapse.identical.sequences, for each sequence standing for them
+  std::map <std::string, std::vector <std::string> > collapsedSequences_;
+  //Species name to id map of spSnapshot_, not owned.
+  const std::map <std::string, int> * spId_;
   std::set <int> nodesToTryInNNISearch_;
   double scenarioLikelihood_;
   //  mutable double _sequenceLikelihood;
@@ -113,6 +120,18 @@ protected:
   unsigned int sprLimitGeneTree_;
   double timeLimit_;
   double elapsedTime_;
+  //Absolute time (ApplicationTools::getTime()) at which the current round's search must stop, 0 if none.
+  double roundDeadline_;
+  //Log-likelihood gained by topology searches since the last resetSearchGain().
+  double searchGain_;
+
+  /**
+   * @brief True while the search may go on, given the family time limit and the round deadline.
+   */
+  bool hasSearchTimeLeft() const {
+    return (timeLimit_ == 0 || elapsedTime_ < timeLimit_)
+      && (roundDeadline_ == 0 || bpp::ApplicationTools::getTime() < roundDeadline_);
+  }
 
 public:
 
@@ -136,10 +155,9 @@ public:
    * @param data Sequences to use.
    * @param model The substitution model to use.
    * @param rDist The rate across sites distribution to use.
-   * @param spTree The species tree
+   * @param spSnapshot The species tree and the link between species name and species ID, shared with the caller
    * @param rootedTree rooted version of the gene tree
    * @param seqSp link between sequence and species names
-   * @param spId link between species name and species ID
    * @param speciesIdLimitForRootPosition limit for gene tree rooting heuristics
    * @param MLindex ML rooting position
    * @param checkRooted Tell if we have to check for the tree to be unrooted.
@@ -152,11 +170,10 @@ public:
     const SiteContainer & data,
     SubstitutionModel * model,
     DiscreteDistribution * rDist,
-    bpp::TreeTemplate<bpp::Node> & spTree,
+    SpeciesTreeSnapshot & spSnapshot,
     bpp::TreeTemplate<bpp::Node> & rootedTree,
     bpp::TreeTemplate<bpp::Node> & geneTreeWithSpNames,
     const std::map <std::string, std::string> seqSp,
-    std::map <std::string,int> spId,
     int speciesIdLimitForRootPosition,
     int & MLindex,
     std::map <std::string, std::string > params,
@@ -178,7 +195,7 @@ public:
 
   GeneTreeLikelihood & operator=(const GeneTreeLikelihood & lik);
 
-  virtual ~GeneTreeLikelihood() {};
+  virtual ~GeneTreeLikelihood() { SpeciesTreeSnapshot::release(spSnapshot_); };
 
 
 
@@ -193,9 +210,22 @@ public:
 
   const std::map <std::string, std::string> getSeqSp() {return seqSp_;}
 
-  void setSpTree(bpp::TreeTemplate<bpp::Node> & spTree) { if (spTree_) delete spTree_; spTree_ = spTree.clone(); }
+  //Multiplicities of the leaves of collapsed families: the leaf name gives the sequences it stands for.
+  const std::map <std::string, std::vector <std::string> > & getCollapsedSequences() const {return collapsedSequences_;}
 
-  void setSpId(std::map <std::string, int> & spId) {spId_ = spId;}
+  void setCollapsedSequences(const std::map <std::string, std::vector <std::string> > & collapsedSequences) {collapsedSequences_ = collapsedSequences;}
+
+  //Copies spTree into a snapshot of its own: setSpeciesTreeSnapshot avoids this copy.
+  void setSpTree(bpp::TreeTemplate<bpp::Node> & spTree) { setSpeciesTreeSnapshot(new SpeciesTreeSnapshot(spTree)); }
+
+  /**
+   * @brief Points to a species tree snapshot, usually shared with other families.
+   *
+   * The previous snapshot is released.
+   */
+  void setSpeciesTreeSnapshot(SpeciesTreeSnapshot * spSnapshot);
+
+  SpeciesTreeSnapshot * getSpeciesTreeSnapshot() const {return spSnapshot_;}
 
   //   ParameterList getParameters() {return nniLk_->getParameters();}
 
@@ -221,13 +251,28 @@ public:
     return sprLimitGeneTree_;
   }
 
+  /**
+   * @brief Sets the absolute time at which topology searches must stop (0: no deadline).
+   */
+  void setRoundDeadline(double deadline) {
+    roundDeadline_ = deadline;
+  }
+
+  double getSearchGain() const {
+    return searchGain_;
+  }
+
+  void resetSearchGain() {
+    searchGain_ = 0;
+  }
+
 
   bool isInitialized() {
     return levaluator_->isInitialized();
   }
   unsigned int seqsToRemove();
 
-  void setGeneTree(bpp::TreeTemplate<bpp::Node>* tree, bpp::TreeTemplate<bpp::Node>* rootedTree) ;
+  virtual void setGeneTree(bpp::TreeTemplate<bpp::Node>* tree, bpp::TreeTemplate<bpp::Node>* rootedTree) ;
 
   std::map <std::string, std::string > getParams () {
     return params_;
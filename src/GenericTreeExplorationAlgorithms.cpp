@@ -38,6 +38,9 @@
  * The fact that you are presently reading this means that you have had
  * knowledge of the CeCILL license and that you accept its terms.
  */
+#include <algorithm>
+#include <cmath>
+
 #include "GenericTreeExplorationAlgorithms.h"
 
 
@@ -715,11 +718,12 @@ bool checkChangeHasNotBeenDone(TreeTemplate<Node> &tree, TreeTemplate<Node> *bes
  * Procedure that makes sure that an NNI or rerooting one is about to make has
  * not been computed already.
  * Simpler than above, should work.
+ * treesToLogLk is indexed by computeTopologyKey.
  ************************************************************************/
-double checkChangeHasNotBeenDone(TreeTemplate<Node> &tree, map<string, double> treesToLogLk)
+double checkChangeHasNotBeenDone(TreeTemplate<Node> &tree, const map<string, double> & treesToLogLk)
 {
-  string treeStr = TreeTemplateTools::treeToParenthesis(tree, false);
-  std::map< std::string, double >::iterator it; 
+  string treeStr = computeTopologyKey(tree);
+  std::map< std::string, double >::const_iterator it; 
   double newLogLikelihood_ = 0.0;
   it = treesToLogLk.find(treeStr);
   if ( it != treesToLogLk.end() ) {
@@ -766,6 +770,96 @@ Tree* MRP(const vector<Tree*>& vecTr)
 }
 
 
+/************************************************************************
+ * Function to build a MRP bionj tree from a split-frequency table,
+ * leafNames[i] being the name of leaf i of the splits.
+ * Each split is a binary character weighted by its count, missing for the
+ * leaves absent from its trees: the distance between two leaves is the JC
+ * distance on the characters where both are present, which is what
+ * DistanceEstimation gives on the MRPEncode matrix, without building it.
+ * Leaves that are in no tree are not in the returned tree.
+ ************************************************************************/
+Tree* MRP(const SplitFrequencies & frequencies, const std::vector<std::string> & leafNames)
+{
+  std::vector< const std::pair<Split, Split> * > characters;
+  std::vector<double> weights;
+  std::vector<size_t> leaves;
+  std::vector<bool> isPresent (leafNames.size(), false);
+  for (SplitFrequencies::const_iterator it = frequencies.begin() ; it != frequencies.end() ; ++it)
+  {
+    for (size_t i = 0 ; i < leafNames.size() ; i++)
+    {
+      if (splitHasLeaf(it->first.first, i))
+        isPresent[i] = true;
+    }
+    //Empty splits only record the leaves of their trees.
+    if (it->first.second == Split(it->first.second.size(), 0))
+      continue;
+    characters.push_back(&(it->first));
+    weights.push_back(static_cast<double>(it->second));
+  }
+  for (size_t i = 0 ; i < leafNames.size() ; i++)
+  {
+    if (isPresent[i])
+      leaves.push_back(i);
+  }
+
+  //Distances are computed row by row, rows being independent.
+  //Pairs without any shared character, or saturated, get the largest distance found.
+  const double undefined = -1.;
+  std::vector< std::vector<double> > distances (leaves.size(), std::vector<double> (leaves.size(), 0.));
+# ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (size_t i = 0 ; i < leaves.size() ; i++)
+  {
+    for (size_t j = i + 1 ; j < leaves.size() ; j++)
+    {
+      double shared = 0.;
+      double different = 0.;
+      for (size_t c = 0 ; c < characters.size() ; c++)
+      {
+        const Split & present = characters[c]->first;
+        if (!splitHasLeaf(present, leaves[i]) || !splitHasLeaf(present, leaves[j]))
+          continue;
+        shared += weights[c];
+        if (splitHasLeaf(characters[c]->second, leaves[i]) != splitHasLeaf(characters[c]->second, leaves[j]))
+          different += weights[c];
+      }
+      double p = (shared > 0.) ? different / shared : 1.;
+      distances[i][j] = (p < 0.75) ? -0.75 * log(1. - 4. / 3. * p) : undefined;
+    }
+  }
+  double maxDistance = 0.;
+  for (size_t i = 0 ; i < leaves.size() ; i++)
+  {
+    for (size_t j = i + 1 ; j < leaves.size() ; j++)
+      maxDistance = std::max(maxDistance, distances[i][j]);
+  }
+  if (maxDistance == 0.)
+    maxDistance = 1.;
+
+  std::vector<std::string> names;
+  for (size_t i = 0 ; i < leaves.size() ; i++)
+    names.push_back(leafNames[leaves[i]]);
+  DistanceMatrix matrix (names);
+  for (size_t i = 0 ; i < leaves.size() ; i++)
+  {
+    for (size_t j = i + 1 ; j < leaves.size() ; j++)
+    {
+      double d = (distances[i][j] == undefined) ? maxDistance : distances[i][j];
+      matrix(i, j) = d;
+      matrix(j, i) = d;
+    }
+  }
+  BioNJ bionjTreeBuilder;
+  bionjTreeBuilder.setDistanceMatrix(matrix);
+  bionjTreeBuilder.computeTree();
+  TreeTemplate<Node>* tree = new TreeTemplate<Node>(*bionjTreeBuilder.getTree());
+  return tree;
+}
+
+
 /************************************************************************
  * Function to root a tree based on a list of outgroup taxa.
  ************************************************************************/
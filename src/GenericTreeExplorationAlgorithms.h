@@ -58,6 +58,7 @@ knowledge of the CeCILL license and that you accept its terms.
 #include <Bpp/Seq/Alphabet/DNA.h>
 
 #include "ReconciliationTools.h"
+#include "TreeSplits.h"
 
 
 void changeRoot(bpp::TreeTemplate<bpp::Node> &tree, int newOutGroup);
@@ -83,9 +84,10 @@ void makeDeterministicNNIsAndRootChangesOnly(bpp::TreeTemplate<bpp::Node> &tree,
 bool checkChangeHasNotBeenDone(bpp::TreeTemplate<bpp::Node> &tree, bpp::TreeTemplate<bpp::Node> *bestTree, size_t & nodeForNNI, 
                                size_t & nodeForRooting, std::vector < double >  &NNILks, 
                                std::vector < double >  &rootLks);
-double checkChangeHasNotBeenDone(bpp::TreeTemplate<bpp::Node> &tree, std::map<std::string, double> treesToLogLk);
+double checkChangeHasNotBeenDone(bpp::TreeTemplate<bpp::Node> &tree, const std::map<std::string, double> & treesToLogLk);
 void dropLeaves(bpp::TreeTemplate<bpp::Node> & tree, const std::vector<std::string> &spToDrop);
 bpp::Tree* MRP(const std::vector<bpp::Tree*>& vecTr);
+bpp::Tree* MRP(const SplitFrequencies & frequencies, const std::vector<std::string> & leafNames);
 void rootTreeWithOutgroup (bpp::TreeTemplate<bpp::Node> &tree, 
 						   const std::vector<std::string> outgroupTaxa) throw ( bpp::TreeException );
 bool isTreeRootedWithOutgroup (const bpp::TreeTemplate<bpp::Node> &tree, const std::vector<std::string> outgroupTaxa) ;
@@ -54,6 +54,8 @@ extern "C" {
 #include <cstdio>
 #include <string>
 #include <fstream>
+#include <algorithm>
+#include <set>
 #include <boost/graph/graph_traits.hpp>
 
 #include <Bpp/Seq/Container/SiteContainerTools.h>
@@ -63,6 +65,8 @@ extern "C" {
 #include "Constants.h"
 #include "LikelihoodEvaluator.h"
 #include "ReconciliationTools.h"
+#include "Profiler.h"
+#include "TreeSplits.h"
 
 
 
@@ -91,6 +95,7 @@ LikelihoodEvaluator::LikelihoodEvaluator(map<string, string> params):
   WHEREAMI( __FILE__ , __LINE__ );
   loadDataFromParams();
   tolerance_ = 0.5;
+  warmStart_ = ApplicationTools::getBooleanParameter("sequence.model.warm.start", params, true, "", true, false);
 }
 
 void LikelihoodEvaluator::loadDataFromParams(){
@@ -262,8 +267,9 @@ void LikelihoodEvaluator::initialize_PLL()
   WHEREAMI( __FILE__ , __LINE__ );
 
   // #1 PREPARING
-  // must have the strict names loaded
-  loadStrictNamesFromAlignment_forPLL();
+  // must have the strict names loaded; they do not change once the alignment files are written
+  if(!aligmentFilesForPllWritten_ || realToStrict.empty())
+    loadStrictNamesFromAlignment_forPLL();
   writeAlignmentFilesForPLL();
   
   // preparing the tree
@@ -307,6 +313,7 @@ void LikelihoodEvaluator::setTree(TreeTemplate<Node> * newTree)
 double LikelihoodEvaluator::PLL_evaluate(TreeTemplate<Node>** treeToEvaluate)
 {
   WHEREAMI( __FILE__ , __LINE__ );
+  ScopedTimer timer(PROFILE_PLL_EVALUATION);
   
   //TODO debug remove
   Newick debugTree;
@@ -320,16 +327,13 @@ double LikelihoodEvaluator::PLL_evaluate(TreeTemplate<Node>** treeToEvaluate)
   
   // getting the root
   bool wasRooted = (treeForPLL->isRooted() ? true : false);
-  set<string> leaves1, leaves2;
+  // the root is recorded as the split (set of leaves) below one of its sons
+  map<string, size_t> leafIndices;
+  Split rootSplit;
   if(wasRooted)
   {
-    Node* root = treeForPLL->getRootNode();
-    Node* son1 = root->getSon(0);
-    Node* son2 = root->getSon(1);
-    vector<string> leaves1Vector = TreeTemplateTools::getLeavesNames(*son1);
-    vector<string> leaves2Vector = TreeTemplateTools::getLeavesNames(*son2);
-    leaves1.insert(leaves1Vector.begin(),leaves1Vector.end());
-    leaves2.insert(leaves2Vector.begin(),leaves2Vector.end());
+    leafIndices = computeLeafIndices(*treeForPLL);
+    rootSplit = computeSplit(*(treeForPLL->getRootNode()->getSon(0)), leafIndices);
     treeForPLL->unroot();
   }
   
@@ -348,6 +352,11 @@ double LikelihoodEvaluator::PLL_evaluate(TreeTemplate<Node>** treeToEvaluate)
   WHEREAMI( __FILE__ , __LINE__ );
   if(!pll_model_already_initialized_){
     pllInitModel(PLL_instance, PLL_partitions);
+    if(warmStart_ && !PLL_warmState_.alphas.empty())
+    {
+      PLL_restoreWarmState();
+      pllEvaluateLikelihood (PLL_instance, PLL_partitions, PLL_instance->start, PLL_TRUE, PLL_FALSE);
+    }
     pll_model_already_initialized_ = true;
   }
   else
@@ -375,39 +384,16 @@ double LikelihoodEvaluator::PLL_evaluate(TreeTemplate<Node>** treeToEvaluate)
   //re-rooting if needed
   if(wasRooted)
   {
-    // the plyogenetic root is between the current topological
-    // root and one of the three sons
-    // so, one of the three sons of a root is the outgroup
-    vector<Node*> rootSons = (*treeToEvaluate)->getRootNode()->getSons();
-    for(vector<Node*>::iterator currSon = rootSons.begin(); currSon != rootSons.end(); currSon++)
-    {
-      vector<string> currLeavesVector = TreeTemplateTools::getLeavesNames(**currSon);
-      set<string> currLeavesSet(currLeavesVector.begin(),currLeavesVector.end());
-      
-      if((currLeavesSet.size() == leaves1.size() && currLeavesSet == leaves1) || (currLeavesSet.size() == leaves2.size() && currLeavesSet == leaves2))
-        (*treeToEvaluate)->newOutGroup(*currSon);
+    // the phylogenetic root is above the node separating the same leaves
+    // as the original root, found by comparing splits in one traversal
+    Node* outgroup = findNodeWithSplit(**treeToEvaluate, leafIndices, rootSplit);
+    if(outgroup)
+      (*treeToEvaluate)->newOutGroup(outgroup);
 
-    }
-    
-    // if not, we will try all the internal branches as potential roots    
-    if(!(*treeToEvaluate)->isRooted())
-    {
-      vector<Node*> outgroupCandidates = (*treeToEvaluate)->getNodes();
-      for(vector<Node*>::iterator currCandidate = outgroupCandidates.begin(); currCandidate != outgroupCandidates.end(); currCandidate++)
-      {
-        vector<string> currLeavesVector = TreeTemplateTools::getLeavesNames(**currCandidate);
-        set<string> currLeavesSet(currLeavesVector.begin(),currLeavesVector.end());
-        
-        if((currLeavesSet.size() == leaves1.size() && currLeavesSet == leaves1) || (currLeavesSet.size() == leaves2.size() && currLeavesSet == leaves2))
-        (*treeToEvaluate)->newOutGroup(*currCandidate);
-      } 
-    }
-    
-    
     if(!(*treeToEvaluate)->isRooted())
     {
       cout << "Unable to re-root the tree, I will give up, sorry." << endl;
-      cout << "l1.s = " << leaves1.size() << ". l2.s = " << leaves2.size() << endl;
+      cout << "number of leaves = " << leafIndices.size() << endl;
       throw Exception("Unable to re-root the tree.");
     } 
     
@@ -424,87 +410,169 @@ double LikelihoodEvaluator::PLL_evaluate(TreeTemplate<Node>** treeToEvaluate)
   return(PLL_instance_likelihood);
 }
 
+/*
+ * Gives the branches of target that are also in reference (same unrooted split)
+ * the length they have in reference. Returns the ids of the nodes above the other
+ * branches and above their neighbouring branches, whose lengths are optimized again;
+ * all node ids if the trees do not have the same leaves.
+ */
+static set<int> warmStartBranchLengths(const TreeTemplate<Node> & reference, TreeTemplate<Node> & target)
+{
+  set<int> toOptimize;
+  vector<string> referenceLeaves = reference.getLeavesNames();
+  vector<string> targetLeaves = target.getLeavesNames();
+  sort(referenceLeaves.begin(), referenceLeaves.end());
+  sort(targetLeaves.begin(), targetLeaves.end());
+  vector<int> targetIds = target.getNodesId();
+  if(referenceLeaves != targetLeaves)
+  {
+    toOptimize.insert(targetIds.begin(), targetIds.end());
+    return toOptimize;
+  }
+  map<string, size_t> leafIndices = computeLeafIndices(target);
+  size_t numberOfLeaves = leafIndices.size();
+
+  // lengths of the branches of reference, splits being oriented away from leaf 0
+  TreeTemplate<Node> * unrootedReference = reference.clone();
+  if(unrootedReference->isRooted())
+    unrootedReference->unroot();
+  vector<const Node *> nodes;
+  vector<Split> splits;
+  computeSplits(*unrootedReference, leafIndices, nodes, splits);
+  map<Split, double> lengths;
+  for(size_t i = 0 ; i < nodes.size() ; i++)
+  {
+    if(nodes[i]->hasFather() && nodes[i]->hasDistanceToFather())
+      lengths[splitHasLeaf(splits[i], 0) ? complementSplit(splits[i], numberOfLeaves) : splits[i]] = nodes[i]->getDistanceToFather();
+  }
+  delete unrootedReference;
+
+  set<int> changed;
+  computeSplits(target, leafIndices, nodes, splits);
+  for(size_t i = 0 ; i < nodes.size() ; i++)
+  {
+    if(!nodes[i]->hasFather())
+      continue;
+    Node * node = target.getNode(nodes[i]->getId());
+    map<Split, double>::const_iterator length = lengths.find(splitHasLeaf(splits[i], 0) ? complementSplit(splits[i], numberOfLeaves) : splits[i]);
+    if(length != lengths.end())
+      node->setDistanceToFather(length->second);
+    else
+    {
+      changed.insert(node->getId());
+      if(!node->hasDistanceToFather())
+        node->setDistanceToFather(0.1);
+    }
+  }
+  for(set<int>::const_iterator id = changed.begin() ; id != changed.end() ; ++id)
+  {
+    Node * node = target.getNode(*id);
+    toOptimize.insert(*id);
+    for(size_t j = 0 ; j < node->getNumberOfSons() ; j++)
+      toOptimize.insert(node->getSon(j)->getId());
+    Node * father = node->getFather();
+    if(father->hasFather())
+      toOptimize.insert(father->getId());
+    for(size_t j = 0 ; j < father->getNumberOfSons() ; j++)
+      toOptimize.insert(father->getSon(j)->getId());
+  }
+  return toOptimize;
+}
+
 double LikelihoodEvaluator::BPP_evaluate(TreeTemplate<Node>** treeToEvaluate)
 { 
   WHEREAMI( __FILE__ , __LINE__ );
+  ScopedTimer timer(PROFILE_BPP_EVALUATION);
 
   // preparing the tree
   TreeTemplate<Node>* treeForBPP = (*treeToEvaluate)->clone();
 
   // getting the root
   bool wasRooted = (treeForBPP->isRooted() ? true : false);
-  set<string> leaves1, leaves2;
+  // the root is recorded as the split (set of leaves) below one of its sons
+  map<string, size_t> leafIndices;
+  Split rootSplit;
   if(wasRooted)
   {
-    Node* root = treeForBPP->getRootNode();
-    Node* son1 = root->getSon(0);
-    Node* son2 = root->getSon(1);
-    vector<string> leaves1Vector = TreeTemplateTools::getLeavesNames(*son1);
-    vector<string> leaves2Vector = TreeTemplateTools::getLeavesNames(*son2);
-    leaves1.insert(leaves1Vector.begin(),leaves1Vector.end());
-    leaves2.insert(leaves2Vector.begin(),leaves2Vector.end());
+    leafIndices = computeLeafIndices(*treeForBPP);
+    rootSplit = computeSplit(*(treeForBPP->getRootNode()->getSon(0)), leafIndices);
     treeForBPP->unroot();
   }
 
 
-  NNIHomogeneousTreeLikelihood * drlk = 0;
-  drlk  = new NNIHomogeneousTreeLikelihood (**treeToEvaluate, 
-                                              *(nniLk->getData()), 
-                                              nniLk->getSubstitutionModel(), 
-                                              nniLk->getRateDistribution(), 
-                                              true, false);
-
-  drlk->initialize();
-  auto_ptr<BackupListener> backupListener;
-  int tlEvalMax = 100;
-  OutputStream* messageHandler = 0 ; 
-  OptimizationTools::optimizeBranchLengthsParameters(dynamic_cast<DiscreteRatesAcrossSitesTreeLikelihood*> (drlk), drlk->getParameters(), backupListener.get(), tolerance_, tlEvalMax, messageHandler, messageHandler, 0);
+  // the likelihood object of the previous candidate is kept: if this candidate
+  // has the same unrooted topology (for instance it only differs by its root),
+  // its optimized branch lengths and likelihood are reused as they are.
+  string topology = computeUnrootedTopologyKey(*treeForBPP);
+  if(!nniLkAlternative || topology != alternativeTopology_)
+  {
+    // Bio++ likelihood objects cannot change their topology: a new one is built,
+    // starting from the branch lengths of the current tree. Only the branches
+    // around the topology change are optimized again.
+    set<int> branchesToOptimize;
+    bool warmStart = (tree != 00);
+    if(warmStart)
+      branchesToOptimize = warmStartBranchLengths(*tree, *treeForBPP);
+    if(nniLkAlternative)
+      delete nniLkAlternative;
+    nniLkAlternative = new NNIHomogeneousTreeLikelihood (*treeForBPP, 
+                                                         *(nniLk->getData()), 
+                                                         nniLk->getSubstitutionModel(), 
+                                                         nniLk->getRateDistribution(), 
+                                                         true, false);
+
+    nniLkAlternative->initialize();
+    ParameterList parameters = nniLkAlternative->getBranchLengthsParameters();
+    if(warmStart)
+    {
+      // branch length i is the one of the i-th node of the likelihood tree in postorder, the root being last
+      const TreeTemplate<Node> & lkTree = dynamic_cast<const TreeTemplate<Node> &> (nniLkAlternative->getTree());
+      vector<const Node *> lkNodes = lkTree.getNodes();
+      lkNodes.pop_back();
+      if(lkNodes.size() == parameters.size())
+      {
+        ParameterList changedParameters;
+        for(size_t i = 0 ; i < lkNodes.size() ; i++)
+        {
+          if(branchesToOptimize.count(lkNodes[i]->getId()))
+            changedParameters.addParameter(parameters.getParameter("BrLen" + TextTools::toString(i)));
+        }
+        parameters = changedParameters;
+      }
+    }
+    if(parameters.size() > 0)
+    {
+      auto_ptr<BackupListener> backupListener;
+      int tlEvalMax = 100;
+      OutputStream* messageHandler = 0 ; 
+      OptimizationTools::optimizeBranchLengthsParameters(dynamic_cast<DiscreteRatesAcrossSitesTreeLikelihood*> (nniLkAlternative), parameters, backupListener.get(), tolerance_, tlEvalMax, messageHandler, messageHandler, 0);
+    }
+    alternativeTopology_ = topology;
+  }
+  delete treeForBPP;
 
   delete *treeToEvaluate;
-  *treeToEvaluate = static_cast< TreeTemplate<Node>* > (drlk->getTree().clone() );
+  *treeToEvaluate = static_cast< TreeTemplate<Node>* > (nniLkAlternative->getTree().clone() );
 
  //re-rooting if needed
   if(wasRooted)
   {
-    // the phylogenetic root is between the current topological
-    // root and one of the three sons
-    // so, one of the three sons of a root is the outgroup
-    vector<Node*> rootSons = (*treeToEvaluate)->getRootNode()->getSons();
-    for(vector<Node*>::iterator currSon = rootSons.begin(); currSon != rootSons.end(); currSon++)
-    {
-      vector<string> currLeavesVector = TreeTemplateTools::getLeavesNames(**currSon);
-      set<string> currLeavesSet(currLeavesVector.begin(),currLeavesVector.end());
-      
-      if((currLeavesSet.size() == leaves1.size() && currLeavesSet == leaves1) || (currLeavesSet.size() == leaves2.size() && currLeavesSet == leaves2))
-        (*treeToEvaluate)->newOutGroup(*currSon);
+    // the phylogenetic root is above the node separating the same leaves
+    // as the original root, found by comparing splits in one traversal
+    Node* outgroup = findNodeWithSplit(**treeToEvaluate, leafIndices, rootSplit);
+    if(outgroup)
+      (*treeToEvaluate)->newOutGroup(outgroup);
 
-    }
-    
-    // if not, we will try all the internal branches as potential roots    
-    if(!(*treeToEvaluate)->isRooted())
-    {
-      vector<Node*> outgroupCandidates = (*treeToEvaluate)->getNodes();
-      for(vector<Node*>::iterator currCandidate = outgroupCandidates.begin(); currCandidate != outgroupCandidates.end(); currCandidate++)
-      {
-        vector<string> currLeavesVector = TreeTemplateTools::getLeavesNames(**currCandidate);
-        set<string> currLeavesSet(currLeavesVector.begin(),currLeavesVector.end());
-        
-        if((currLeavesSet.size() == leaves1.size() && currLeavesSet == leaves1) || (currLeavesSet.size() == leaves2.size() && currLeavesSet == leaves2))
-        (*treeToEvaluate)->newOutGroup(*currCandidate);
-      } 
-    }
-    
-    
     if(!(*treeToEvaluate)->isRooted())
     {
       cout << "Unable to re-root the tree, I will give up, sorry." << endl;
-      cout << "l1.s = " << leaves1.size() << ". l2.s = " << leaves2.size() << endl;
+      cout << "number of leaves = " << leafIndices.size() << endl;
       throw Exception("Unable to re-root the tree.");
     } 
     
   }
 
-  return -drlk->getValue() * scaler_;
+  return -nniLkAlternative->getValue() * scaler_;
  
 
 }
@@ -527,6 +595,8 @@ void LikelihoodEvaluator::unload()
   initialized = false;
   if(method == PLL){
     if(pll_model_already_initialized_){
+      if(warmStart_)
+        PLL_saveWarmState();
       pllAlignmentDataDestroy(PLL_alignmentData);
       pllPartitionsDestroy(PLL_instance, &PLL_partitions);
       pllDestroyInstance(PLL_instance);
@@ -536,8 +606,44 @@ void LikelihoodEvaluator::unload()
   else
   {
     delete nniLk;
+    nniLk = 00;
     if(nniLkAlternative)
       delete nniLkAlternative;
+    nniLkAlternative = 00;
+    alternativeTopology_ = "";
+  }
+}
+
+void LikelihoodEvaluator::PLL_saveWarmState()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  size_t numberOfPartitions = PLL_partitions->numberOfPartitions;
+  PLL_warmState_.alphas.resize(numberOfPartitions);
+  PLL_warmState_.frequencies.resize(numberOfPartitions);
+  PLL_warmState_.substRates.resize(numberOfPartitions);
+  for(size_t i = 0; i < numberOfPartitions; i++)
+  {
+    pInfo * partition = PLL_partitions->partitionData[i];
+    int states = partition->states;
+    PLL_warmState_.alphas[i] = partition->alpha;
+    PLL_warmState_.frequencies[i].assign(partition->frequencies, partition->frequencies + states);
+    PLL_warmState_.substRates[i].assign(partition->substRates, partition->substRates + states * (states - 1) / 2);
+  }
+}
+
+void LikelihoodEvaluator::PLL_restoreWarmState()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  if(PLL_warmState_.alphas.size() != (size_t)PLL_partitions->numberOfPartitions)
+    return;
+  for(int i = 0; i < PLL_partitions->numberOfPartitions; i++)
+  {
+    pInfo * partition = PLL_partitions->partitionData[i];
+    partition->alpha = PLL_warmState_.alphas[i];
+    pllMakeGammaCats(partition->alpha, partition->gammaRates, 4, PLL_instance->useMedian);
+    std::copy(PLL_warmState_.frequencies[i].begin(), PLL_warmState_.frequencies[i].end(), partition->frequencies);
+    std::copy(PLL_warmState_.substRates[i].begin(), PLL_warmState_.substRates[i].end(), partition->substRates);
+    pllInitReversibleGTR(PLL_instance, PLL_partitions, i);
   }
 }
 
@@ -560,6 +666,7 @@ void LikelihoodEvaluator::initialize()
   WHEREAMI( __FILE__ , __LINE__ );
   if(initialized)
     return;
+  ScopedTimer timer(PROFILE_FULL_OPTIMIZATION);
   //checking the alignment and the tree contain the same number of sequences
   if(sites->getNumberOfSequences() != tree->getNumberOfLeaves()){
     ostringstream errorMessage;
@@ -583,6 +690,7 @@ void LikelihoodEvaluator::setAlternativeTree(TreeTemplate< Node >* newAlternativ
   WHEREAMI( __FILE__ , __LINE__ );
   if(!initialized)
     initialize();
+  ScopedTimer timer(PROFILE_PARTIAL_OPTIMIZATION);
   if(alternativeTree != 00)
     delete alternativeTree;
   alternativeTree = newAlternative->clone();
@@ -817,13 +925,15 @@ else {
 }
 
 LikelihoodEvaluator::LikelihoodEvaluator(LikelihoodEvaluator const &leval):
-params(leval.params), initialized(false), PLL_instance(00), PLL_alignmentData(00), PLL_newick(00), PLL_partitions(00), PLL_partitionInfo(00), tree(00), alternativeTree(00), nniLk(00), nniLkAlternative(00), substitutionModel(00), rateDistribution(00), sites(00), alphabet(00), aligmentFilesForPllWritten_(false), logLikelihood(0), pll_model_already_initialized_(false)
+params(leval.params), initialized(false), PLL_instance(00), PLL_alignmentData(00), PLL_newick(00), PLL_partitions(00), PLL_partitionInfo(00), tree(00), alternativeTree(00), nniLk(00), nniLkAlternative(00), alternativeTopology_(""), substitutionModel(00), rateDistribution(00), sites(00), alphabet(00), aligmentFilesForPllWritten_(false), logLikelihood(0), pll_model_already_initialized_(false)
 {
   WHEREAMI( __FILE__ , __LINE__ );
   
   loadDataFromParams();
   tree = leval.tree;
   sites = leval.sites;
+  warmStart_ = leval.warmStart_;
+  PLL_warmState_ = leval.PLL_warmState_;
   
   if(leval.initialized)
     initialize();
@@ -836,7 +946,7 @@ LikelihoodEvaluator* LikelihoodEvaluator::clone()
 }
 
 LikelihoodEvaluator::LikelihoodEvaluator(const Tree* tree, const SiteContainer* alignment, SubstitutionModel* model, DiscreteDistribution* rateDistribution, std::map<std::string, std::string> par, bool mustUnrootTrees, bool verbose):
-initialized(false), PLL_instance(00), PLL_alignmentData(00), PLL_newick(00), PLL_partitions(00), PLL_partitionInfo(00), tree(00), alternativeTree(00), nniLk(00), nniLkAlternative(00), substitutionModel(00), rateDistribution(00), sites(00), alphabet(00), params(par), aligmentFilesForPllWritten_(false), logLikelihood(0), pll_model_already_initialized_(false)
+initialized(false), PLL_instance(00), PLL_alignmentData(00), PLL_newick(00), PLL_partitions(00), PLL_partitionInfo(00), tree(00), alternativeTree(00), nniLk(00), nniLkAlternative(00), alternativeTopology_(""), substitutionModel(00), rateDistribution(00), sites(00), alphabet(00), params(par), aligmentFilesForPllWritten_(false), logLikelihood(0), pll_model_already_initialized_(false)
 {
   WHEREAMI( __FILE__ , __LINE__ );
   this->tree = dynamic_cast<TreeTemplate<Node> *>(tree->clone());
@@ -846,6 +956,7 @@ initialized(false), PLL_instance(00), PLL_alignmentData(00), PLL_newick(00), PLL
   
   string methodString = ApplicationTools::getStringParameter("likelihood.evaluator",params,"PLL");
   this->method = (methodString == "PLL"? PLL:BPP);
+  warmStart_ = ApplicationTools::getBooleanParameter("sequence.model.warm.start", params, true, "", true, false);
   
   initialize();
   
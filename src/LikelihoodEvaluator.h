@@ -160,6 +160,33 @@ private:
    // have the alignment files for PLL been aleady written
   bool pll_model_already_initialized_;
 
+  /**
+  Model parameters optimized by PLL, one element per partition.
+  They are kept by unload(), so that the model of the next initialization
+  starts from them instead of PLL default values. Branch lengths are kept
+  in the tree, and the last log-likelihood in logLikelihood.
+  */
+  struct PLLWarmState
+  {
+    std::vector<double> alphas;
+    std::vector< std::vector<double> > frequencies;
+    std::vector< std::vector<double> > substRates;
+  };
+  PLLWarmState PLL_warmState_;
+
+  // should initialize() reuse PLL_warmState_ (option sequence.model.warm.start)
+  bool warmStart_;
+
+  /**
+  Records the model parameters of PLL_partitions in PLL_warmState_.
+  */
+  void PLL_saveWarmState();
+
+  /**
+  Sets the model parameters of PLL_partitions to those of PLL_warmState_.
+  */
+  void PLL_restoreWarmState();
+
   /**
   Loads the PLL alignment
   */
@@ -326,6 +353,12 @@ private:
   */
   bpp::NNIHomogeneousTreeLikelihood * nniLkAlternative;
   
+  /**
+  * @brief Unrooted topology of nniLkAlternative (see computeUnrootedTopologyKey),
+  * so that it is reused by the next candidate with the same topology
+  */
+  std::string alternativeTopology_;
+  
   /**
    * @brief initialize the NNIHomogeneousTreeLikelihood object for BPP management
    */
@@ -0,0 +1,112 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include <Bpp/App/ApplicationTools.h>
+
+#include "Logger.h"
+
+using namespace bpp;
+
+
+LogLevel Logger::level_ = LOG_LEVEL_INFO;
+Logger::Buffer Logger::logBuffer_;
+std::ostream Logger::buffer_(&Logger::logBuffer_);
+size_t Logger::bufferSize_ = 65536;
+
+
+/******************************************************************************/
+
+void Logger::initialize(std::map<std::string, std::string> & params)
+{
+  std::string level = ApplicationTools::getStringParameter("log.level", params, "info", "", true, false);
+  if (level == "trace")
+    level_ = LOG_LEVEL_TRACE;
+  else if (level == "debug")
+    level_ = LOG_LEVEL_DEBUG;
+  else if (level == "info")
+    level_ = LOG_LEVEL_INFO;
+  else if (level == "warning")
+    level_ = LOG_LEVEL_WARNING;
+  else if (level == "error")
+    level_ = LOG_LEVEL_ERROR;
+  else if (level == "none")
+    level_ = LOG_LEVEL_NONE;
+  else {
+    std::cerr << "Unknown log.level: " << level << ", using info." << std::endl;
+    level_ = LOG_LEVEL_INFO;
+  }
+  if (level_ < PHYLDOG_MIN_LOG_LEVEL)
+    std::cerr << "log.level=" << level << " was asked for, but lower levels than " << PHYLDOG_MIN_LOG_LEVEL << " have been compiled out." << std::endl;
+  bufferSize_ = (size_t) ApplicationTools::getIntParameter("log.buffer.size", params, 65536, "", true, false);
+  //Buffered messages are written out before any direct write to std::cout
+  std::cout.tie(&buffer_);
+}
+
+/******************************************************************************/
+
+void Logger::endLine(LogLevel level)
+{
+  buffer_ << '\n';
+  if (level >= LOG_LEVEL_WARNING || (size_t) buffer_.tellp() >= bufferSize_)
+    flush();
+}
+
+/******************************************************************************/
+
+void Logger::flush()
+{
+  buffer_.flush();
+  std::cout.flush();
+}
+
+/******************************************************************************/
+
+int Logger::Buffer::sync()
+{
+  //The buffer is emptied first: writing to std::cout flushes it again through the tie.
+  std::string content = str();
+  if (!content.empty()) {
+    str("");
+    std::cout << content;
+  }
+  return 0;
+}
@@ -0,0 +1,143 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* This file contains a leveled, buffered logger used instead of direct writes to std::cout in the search loops.*/
+
+#ifndef _LOGGER_H_
+#define _LOGGER_H_
+
+#include <string>
+#include <map>
+#include <sstream>
+#include <iostream>
+
+
+enum LogLevel {
+  LOG_LEVEL_TRACE = 0,
+  LOG_LEVEL_DEBUG,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_WARNING,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_NONE
+};
+
+
+//Messages below this level are removed at compile time.
+//Release builds (NDEBUG) only keep INFO and above, unless PHYLDOG_MIN_LOG_LEVEL is given to the compiler.
+#ifndef PHYLDOG_MIN_LOG_LEVEL
+  #ifdef NDEBUG
+    #define PHYLDOG_MIN_LOG_LEVEL 2
+  #else
+    #define PHYLDOG_MIN_LOG_LEVEL 0
+  #endif
+#endif
+
+
+/**
+ * @brief Per-process buffered logger.
+ *
+ * Messages are written to a memory buffer, which is copied to std::cout
+ * (i.e. Client_N.out on clients) when it gets large, when a warning or an error is logged,
+ * when flush() is called (once per round of the main loop, and at the end of the run),
+ * or before anything else is written to std::cout, which is tied to the buffer:
+ * messages and direct writes to std::cout thus come out in the order they were made.
+ * The level is set at run time with the option log.level=trace|debug|info|warning|error|none (default info).
+ * Messages are only formatted if their level is enabled, see the PHYLDOG_LOG macro.
+ */
+class Logger
+{
+  /**
+   * @brief Memory buffer whose content is moved to std::cout when the stream is flushed.
+   */
+  class Buffer : public std::stringbuf
+  {
+  protected:
+    int sync();
+  };
+
+  static LogLevel level_;
+  static Buffer logBuffer_;
+  static std::ostream buffer_;
+  static size_t bufferSize_;
+
+public:
+  /**
+   * @brief Reads log.level and log.buffer.size from the options.
+   */
+  static void initialize(std::map<std::string, std::string> & params);
+
+  static bool isEnabled(LogLevel level) { return level >= level_; }
+
+  static void setLevel(LogLevel level) { level_ = level; }
+
+  static LogLevel getLevel() { return level_; }
+
+  static std::ostream & stream() { return buffer_; }
+
+  /**
+   * @brief Terminates the current message, and flushes the buffer if needed.
+   */
+  static void endLine(LogLevel level);
+
+  /**
+   * @brief Copies the buffer to std::cout.
+   */
+  static void flush();
+};
+
+
+#define PHYLDOG_LOG(level, message) \
+  do { \
+    if ((level) >= PHYLDOG_MIN_LOG_LEVEL && Logger::isEnabled(level)) { \
+      Logger::stream() << message; \
+      Logger::endLine(level); \
+    } \
+  } while (0)
+
+#define TRACE_LOG(message)   PHYLDOG_LOG(LOG_LEVEL_TRACE, message)
+#define DEBUG_LOG(message)   PHYLDOG_LOG(LOG_LEVEL_DEBUG, message)
+#define INFO_LOG(message)    PHYLDOG_LOG(LOG_LEVEL_INFO, message)
+#define WARNING_LOG(message) PHYLDOG_LOG(LOG_LEVEL_WARNING, message)
+#define ERROR_LOG(message)   PHYLDOG_LOG(LOG_LEVEL_ERROR, message)
+
+
+#endif  //_LOGGER_H_
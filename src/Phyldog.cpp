@@ -51,6 +51,8 @@ namespace mpi = boost::mpi;
 
 #include "SpeciesTreeLikelihood.h"
 #include "ClientComputingGeneLikelihoods.h"
+#include "Profiler.h"
+#include "Logger.h"
 
 
 
@@ -92,7 +94,12 @@ void help()
     (*ApplicationTools::message << "branch.expected.numbers.optimization | average, branchwise, average_then_branchwise or no: how we optimize duplication and loss probabilities").endLine();
     (*ApplicationTools::message << "genome.coverage.file                 | file giving the percent coverage of the genomes used").endLine();
     (*ApplicationTools::message << "spr.limit                            | integer giving the breadth of SPR movements, in number of nodes. 0.1* number of nodes in the species tree might be OK.").endLine();
-    (*ApplicationTools::message << "reconciliation.model                 | 'DL' or 'COAL' giving the type of model to reconcile gene trees against the species tree.").endLine();
+    (*ApplicationTools::message << "reconciliation.model                 | 'DL' or 'COAL' giving the type of model to reconcile gene trees against the species tree ('DTL' with reconciliation.only=yes).").endLine();
+    (*ApplicationTools::message << "reconciliation.only                  | yes or no: genelist.file lists files of fixed gene trees, which are only reconciled").endLine();
+    (*ApplicationTools::message << "family.cost.file                     | file of family costs measured by a previous run (output.family.cost.file), used to distribute families").endLine();
+    (*ApplicationTools::message << "client.memory.budget                 | memory budget of each client in MB: families that do not fit are unloaded between rounds").endLine();
+    (*ApplicationTools::message << "round.time.budget                    | seconds of gene tree search per round on each client, shared by families according to their recent improvement").endLine();
+    (*ApplicationTools::message << "profile                              | yes or no: write per-rank counters and timings to PATH/Server.profile.csv and PATH/Client_N.profile.csv").endLine();
 
     (*ApplicationTools::message << "  Refer to the README file or the Bio++ Program Suite Manual for a list of supplementary options.").endLine();
     (*ApplicationTools::message << "__________________________________________________________________________").endLine();
@@ -177,6 +184,8 @@ int main(int args, char ** argv)
     ApplicationTools::startTimer();
         //All processors parse the main options
     std::map<std::string, std::string> params = AttributesTools::parseOptions(args, argv);
+    Profiler::initialize(params, rank);
+    Logger::initialize(params);
 
     
         //##################################################################################################################
@@ -216,6 +225,13 @@ int main(int args, char ** argv)
             spTL.initialize();
 
             spTL.MLSearch();
+            //Next searches from other starting species trees, if any
+            while (spTL.startNextSearch())
+              spTL.MLSearch();
+            spTL.outputStartResults();
+            spTL.reportFamilyCosts();
+            Profiler::write("end");
+            Logger::flush();
                         
       std::cout << "PHYLDOG's done. Bye." << std::endl;
       ApplicationTools::displayTime("Total execution time:");
@@ -266,6 +282,11 @@ int main(int args, char ** argv)
 	      
 	      //Main loop, computation of the gene tree likelihoods given species trees sent by the server.
 	      client.MLSearch();
+	      while (client.startNextSearch())
+	        client.MLSearch();
+	      client.sendFamilyCosts();
+	      Profiler::write("end");
+	      Logger::flush();
 
 			if (!debug) {
 				cerr.rdbuf(backupcerr);    // restore cerr's original streambuf
@@ -278,6 +299,7 @@ int main(int args, char ** argv)
   }
   catch(std::exception & e)
   {
+    Logger::flush();
     std::cout << e.what() << std::endl;
         MPI::COMM_WORLD.Abort(1);
     exit(-1);
@@ -0,0 +1,448 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+#include <Bpp/App/ApplicationTools.h>
+#include <Bpp/Io/FileTools.h>
+#include <Bpp/Numeric/Random/RandomTools.h>
+#include <Bpp/Text/TextTools.h>
+#include <Bpp/Utils/AttributesTools.h>
+#include <Bpp/Phyl/Io/Newick.h>
+#include <Bpp/Phyl/Simulation/HomogeneousSequenceSimulator.h>
+#include <Bpp/Seq/Io/Fasta.h>
+
+#include "ReconciliationTools.h"
+
+using namespace bpp;
+
+
+/*
+This program simulates data sets in the format read by phyldog: a species tree, and gene families
+evolving along it under a birth-death model of duplications and losses, with their alignments,
+link files, option files, and a list of option files weighted by family size.
+It is meant to build data sets of any size (in species and in families) for tests and benchmarks.
+The gene tree process is the one of the duplication/loss simulator of dev-utils (without transfers,
+which phyldog does not model), with homogeneous rates along the species tree.
+*/
+
+/******************************************************************************/
+
+void help()
+{
+    (*ApplicationTools::message << "__________________________________________________________________________").endLine();
+    (*ApplicationTools::message << "phyldog_generator parameter1_name=parameter1_value parameter2_name=parameter2_value"   ).endLine();
+    (*ApplicationTools::message << "      ... param=option_file").endLine();
+    (*ApplicationTools::message).endLine();
+    (*ApplicationTools::message << "PATH                                 | directory where all files are written").endLine();
+    (*ApplicationTools::message << "species.number                       | number of species of the random (Yule) species tree, if no species tree is given").endLine();
+    (*ApplicationTools::message << "species.tree.file                    | instead, path to a rooted species tree with branch lengths, in time units").endLine();
+    (*ApplicationTools::message << "families.number                      | number of gene families to simulate").endLine();
+    (*ApplicationTools::message << "duplication.rate                     | duplications per lineage per unit of time, the species tree having height 1").endLine();
+    (*ApplicationTools::message << "loss.rate                            | losses per lineage per unit of time").endLine();
+    (*ApplicationTools::message << "min.genes                            | families with fewer genes are simulated again").endLine();
+    (*ApplicationTools::message << "alignment.length                     | number of sites of the alignments").endLine();
+    (*ApplicationTools::message << "substitution.rate                    | expected number of substitutions per site from the root to the leaves").endLine();
+    (*ApplicationTools::message << "alphabet, model, rate_distribution   | sequence evolution model, as in phyldog option files").endLine();
+    (*ApplicationTools::message << "seed                                 | random seed").endLine();
+    (*ApplicationTools::message << "__________________________________________________________________________").endLine();
+}
+
+
+/******************************************************************************/
+// Random species tree of height 1 under the Yule process.
+/******************************************************************************/
+
+TreeTemplate<Node> * simulateYuleTree(unsigned int numberOfSpecies)
+{
+  Node * root = new Node();
+  std::vector<Node*> lineages;
+  lineages.push_back(root);
+  double height = 0;
+  while (lineages.size() < numberOfSpecies) {
+    double dt = RandomTools::randExponential(1.0 / lineages.size());
+    height += dt;
+    for (unsigned int i = 0 ; i < lineages.size() ; i++)
+      if (lineages[i]->hasFather())
+        lineages[i]->setDistanceToFather(lineages[i]->getDistanceToFather() + dt);
+    unsigned int k = RandomTools::giveIntRandomNumberBetweenZeroAndEntry<unsigned int>(lineages.size());
+    Node * father = lineages[k];
+    Node * son0 = new Node();
+    Node * son1 = new Node();
+    father->addSon(son0);
+    father->addSon(son1);
+    son0->setDistanceToFather(0);
+    son1->setDistanceToFather(0);
+    lineages[k] = son0;
+    lineages.push_back(son1);
+  }
+  //A last interval, so that the youngest speciation is not at the leaves
+  double dt = RandomTools::randExponential(1.0 / lineages.size());
+  height += dt;
+  for (unsigned int i = 0 ; i < lineages.size() ; i++) {
+    lineages[i]->setDistanceToFather(lineages[i]->getDistanceToFather() + dt);
+    lineages[i]->setName("S" + TextTools::toString(i + 1));
+  }
+  TreeTemplate<Node> * tree = new TreeTemplate<Node>(root);
+  TreeTemplateTools::scaleTree(*root, 1.0 / height);
+  return tree;
+}
+
+
+/******************************************************************************/
+// Duplications and losses along a species branch: lineages are the gene nodes
+// entering the branch, and are replaced by the gene nodes leaving it.
+// Lost lineages are named "LOST", and removed afterwards.
+/******************************************************************************/
+
+void addTimeToLineages(std::vector<Node*> & lineages, double dt)
+{
+  for (unsigned int i = 0 ; i < lineages.size() ; i++)
+    if (lineages[i]->hasFather())
+      lineages[i]->setDistanceToFather(lineages[i]->getDistanceToFather() + dt);
+}
+
+void simulateGeneLineages(const Node * spNode,
+                          std::vector<Node*> lineages,
+                          double duplicationRate,
+                          double lossRate,
+                          std::map<std::string, unsigned int> & genesPerSpecies)
+{
+  double length = spNode->hasFather() ? spNode->getDistanceToFather() : 0.0;
+  double t = 0;
+  while (lineages.size() > 0 && duplicationRate + lossRate > 0) {
+    double dt = RandomTools::randExponential(1.0 / (lineages.size() * (duplicationRate + lossRate)));
+    if (t + dt > length)
+      break;
+    t += dt;
+    addTimeToLineages(lineages, dt);
+    unsigned int k = RandomTools::giveIntRandomNumberBetweenZeroAndEntry<unsigned int>(lineages.size());
+    if (RandomTools::giveRandomNumberBetweenZeroAndEntry(duplicationRate + lossRate) < duplicationRate) {
+      Node * son0 = new Node();
+      Node * son1 = new Node();
+      lineages[k]->addSon(son0);
+      lineages[k]->addSon(son1);
+      son0->setDistanceToFather(0);
+      son1->setDistanceToFather(0);
+      lineages[k] = son0;
+      lineages.push_back(son1);
+    }
+    else {
+      lineages[k]->setName("LOST");
+      lineages.erase(lineages.begin() + k);
+    }
+  }
+  //Surviving lineages reach the end of the branch, also when there are no events
+  addTimeToLineages(lineages, length - t);
+
+  if (spNode->isLeaf()) {
+    for (unsigned int i = 0 ; i < lineages.size() ; i++) {
+      unsigned int number = ++genesPerSpecies[spNode->getName()];
+      lineages[i]->setName(spNode->getName() + "_" + TextTools::toString(number));
+    }
+    return;
+  }
+  //Speciation: each lineage is split between the two daughter species
+  std::vector<Node*> lineages0, lineages1;
+  for (unsigned int i = 0 ; i < lineages.size() ; i++) {
+    Node * son0 = new Node();
+    Node * son1 = new Node();
+    lineages[i]->addSon(son0);
+    lineages[i]->addSon(son1);
+    son0->setDistanceToFather(0);
+    son1->setDistanceToFather(0);
+    lineages0.push_back(son0);
+    lineages1.push_back(son1);
+  }
+  simulateGeneLineages(spNode->getSon(0), lineages0, duplicationRate, lossRate, genesPerSpecies);
+  simulateGeneLineages(spNode->getSon(1), lineages1, duplicationRate, lossRate, genesPerSpecies);
+}
+
+
+/******************************************************************************/
+// Copies the surviving part of a simulated gene tree: lost lineages are removed,
+// and nodes left with a single son are merged with it. Returns 0 if nothing survives.
+/******************************************************************************/
+
+Node * copySurvivingGenes(const Node * node)
+{
+  if (node->isLeaf()) {
+    if (node->getName() == "LOST")
+      return 0;
+    Node * copy = new Node(node->getName());
+    copy->setDistanceToFather(node->getDistanceToFather());
+    return copy;
+  }
+  std::vector<Node*> survivors;
+  for (unsigned int i = 0 ; i < node->getNumberOfSons() ; i++) {
+    Node * son = copySurvivingGenes(node->getSon(i));
+    if (son)
+      survivors.push_back(son);
+  }
+  if (survivors.size() == 0)
+    return 0;
+  double distance = node->hasFather() ? node->getDistanceToFather() : 0.0;
+  if (survivors.size() == 1) {
+    survivors[0]->setDistanceToFather(survivors[0]->getDistanceToFather() + distance);
+    return survivors[0];
+  }
+  Node * copy = new Node();
+  for (unsigned int i = 0 ; i < survivors.size() ; i++)
+    copy->addSon(survivors[i]);
+  copy->setDistanceToFather(distance);
+  return copy;
+}
+
+
+/******************************************************************************/
+// Simulates gene trees until one has at least minGenes genes.
+/******************************************************************************/
+
+TreeTemplate<Node> * simulateGeneTree(const TreeTemplate<Node> & spTree,
+                                      double duplicationRate,
+                                      double lossRate,
+                                      unsigned int minGenes)
+{
+  for (unsigned int trial = 0 ; trial < 10000 ; trial++) {
+    Node * origin = new Node();
+    TreeTemplate<Node> simulated(origin);
+    std::vector<Node*> lineages;
+    lineages.push_back(origin);
+    std::map<std::string, unsigned int> genesPerSpecies;
+    simulateGeneLineages(spTree.getRootNode(), lineages, duplicationRate, lossRate, genesPerSpecies);
+    Node * root = copySurvivingGenes(origin);
+    if (!root)
+      continue;
+    TreeTemplate<Node> * geneTree = new TreeTemplate<Node>(root);
+    if (geneTree->getNumberOfLeaves() >= minGenes)
+      return geneTree;
+    delete geneTree;
+  }
+  throw Exception("phyldog_generator: could not simulate a gene family with at least " + TextTools::toString(minGenes) + " genes; increase duplication.rate or decrease loss.rate or min.genes.");
+}
+
+
+/******************************************************************************/
+
+void writeLinkFile(const TreeTemplate<Node> & geneTree, const std::string & file)
+{
+  std::map<std::string, std::vector<std::string> > spSeqs;
+  std::vector<std::string> genes = geneTree.getLeavesNames();
+  for (unsigned int i = 0 ; i < genes.size() ; i++)
+    spSeqs[genes[i].substr(0, genes[i].rfind('_'))].push_back(genes[i]);
+  std::ofstream out(file.c_str());
+  for (std::map<std::string, std::vector<std::string> >::iterator it = spSeqs.begin() ; it != spSeqs.end() ; it++) {
+    out << it->first << ":";
+    for (unsigned int i = 0 ; i < it->second.size() ; i++)
+      out << (i > 0 ? ";" : "") << it->second[i];
+    out << std::endl;
+  }
+  out.close();
+}
+
+
+void writeFamilyOptionFile(const std::string & path,
+                           const std::string & family,
+                           std::map<std::string, std::string> & params)
+{
+  std::ofstream out((path + family + ".option").c_str());
+  out << "######## First, data files ########" << std::endl;
+  out << "PATH=" << path << std::endl;
+  out << "DATA=" << family << std::endl;
+  out << "alphabet=" << ApplicationTools::getStringParameter("alphabet", params, "DNA", "", true, false) << std::endl;
+  out << "taxaseq.file=$(PATH)$(DATA).link" << std::endl;
+  out << "input.sequence.file=$(PATH)$(DATA).fasta" << std::endl;
+  out << "input.sequence.format=Fasta" << std::endl;
+  out << "output.reconciled.tree.file=$(PATH)$(DATA)_Reconciled.tree" << std::endl;
+  out << "output.duplications.tree.file=$(PATH)$(DATA)_Duplications.tree" << std::endl;
+  out << "output.losses.tree.file=$(PATH)$(DATA)_Losses.tree" << std::endl;
+  out << "output.numbered.tree.file=$(PATH)$(DATA)_Numbered.tree" << std::endl;
+  out << "input.sequence.sites_to_use=all" << std::endl;
+  out << "init.gene.tree=bionj" << std::endl;
+  out << "#The true gene tree, which may be used with init.gene.tree=user" << std::endl;
+  out << "gene.tree.file=$(PATH)$(DATA).tree" << std::endl;
+  out << "output.starting.gene.tree.file=$(PATH)$(DATA)_starting.tree" << std::endl;
+  out << "######## Then, model options ########" << std::endl;
+  out << "model=" << params["model"] << std::endl;
+  out << "rate_distribution=" << params["rate_distribution"] << std::endl;
+  out << "######## Finally, optimization options ########" << std::endl;
+  out << "optimization.topology=no" << std::endl;
+  out << "optimization.tolerance=0.01" << std::endl;
+  out << "optimization.method_DB.nstep=0" << std::endl;
+  out << "optimization.topology.numfirst=false" << std::endl;
+  out << "optimization.topology.tolerance.before=100" << std::endl;
+  out << "optimization.topology.tolerance.during=100" << std::endl;
+  out << "optimization.max_number_f_eval=1000000" << std::endl;
+  out << "optimization.final=none" << std::endl;
+  out << "optimization.verbose=0" << std::endl;
+  out << "optimization.message_handler=none" << std::endl;
+  out << "optimization.profiler=none" << std::endl;
+  out << "optimization.reparametrization=no" << std::endl;
+  out.close();
+}
+
+
+void writeGeneralOptionFile(const std::string & path)
+{
+  std::ofstream out((path + "GeneralOptions.txt").c_str());
+  out << "######## First, data files ########" << std::endl;
+  out << "PATH=" << path << std::endl;
+  out << "init.species.tree=random" << std::endl;
+  out << "species.names.file=$(PATH)SpeciesNames.txt" << std::endl;
+  out << "#The true species tree, which may be used with init.species.tree=user" << std::endl;
+  out << "species.tree.file=$(PATH)SpeciesTree.tree" << std::endl;
+  out << "starting.tree.file=$(PATH)StartingTree.tree" << std::endl;
+  out << "output.tree.file=$(PATH)OutputSpeciesTree.tree" << std::endl;
+  out << "output.temporary.tree.file=$(PATH)CurrentSpeciesTree.tree" << std::endl;
+  out << "genelist.file=$(PATH)genelist.file" << std::endl;
+  out << "output.duplications.tree.file=$(PATH)OutputSpeciesTree_Duplications.tree" << std::endl;
+  out << "output.losses.tree.file=$(PATH)OutputSpeciesTree_Losses.tree" << std::endl;
+  out << "output.numbered.tree.file=$(PATH)OutputSpeciesTree_Numbered.tree" << std::endl;
+  out << "######## Second, options ########" << std::endl;
+  out << "optimization.topology=yes" << std::endl;
+  out << "branch.expected.numbers.optimization=average_then_branchwise" << std::endl;
+  out << "spr.limit=5" << std::endl;
+  out << "time.limit=23" << std::endl;
+  out.close();
+}
+
+
+/*********************************************************************************************************/
+//////////////////////////////////////////////////////MAIN/////////////////////////////////////////////////
+/*********************************************************************************************************/
+
+int main(int args, char ** argv)
+{
+  if(args == 1)
+  {
+    help();
+    exit(0);
+  }
+
+  try {
+    std::map<std::string, std::string> params = AttributesTools::parseOptions(args, argv);
+
+    std::string path = ApplicationTools::getStringParameter("PATH", params, "./", "", true, false);
+    if (path[path.size() - 1] != '/')
+      path = path + "/";
+    unsigned int numberOfSpecies = (unsigned int) ApplicationTools::getIntParameter("species.number", params, 10, "", true, false);
+    unsigned int numberOfFamilies = (unsigned int) ApplicationTools::getIntParameter("families.number", params, 100, "", true, false);
+    double duplicationRate = ApplicationTools::getDoubleParameter("duplication.rate", params, 0.5, "", true, false);
+    double lossRate = ApplicationTools::getDoubleParameter("loss.rate", params, 0.5, "", true, false);
+    unsigned int minGenes = (unsigned int) ApplicationTools::getIntParameter("min.genes", params, 4, "", true, false);
+    unsigned int alignmentLength = (unsigned int) ApplicationTools::getIntParameter("alignment.length", params, 500, "", true, false);
+    double substitutionRate = ApplicationTools::getDoubleParameter("substitution.rate", params, 0.5, "", true, false);
+    long seed = ApplicationTools::getIntParameter("seed", params, 1, "", true, false);
+    if (params.find("model") == params.end())
+      params["model"] = "JC69";
+    if (params.find("rate_distribution") == params.end())
+      params["rate_distribution"] = "Gamma(n=4,alpha=1)";
+    RandomTools::setSeed(seed);
+    if (!FileTools::directoryExists(path))
+      throw Exception("phyldog_generator: directory " + path + " does not exist.");
+
+    //The species tree
+    TreeTemplate<Node> * spTree = 0;
+    std::string spTreeFile = ApplicationTools::getStringParameter("species.tree.file", params, "none", "", true, false);
+    Newick newick(false);
+    if (spTreeFile != "none")
+      spTree = newick.read(spTreeFile);
+    else
+      spTree = simulateYuleTree(numberOfSpecies);
+    newick.write(*spTree, path + "SpeciesTree.tree", true);
+    std::vector<std::string> spNames = spTree->getLeavesNames();
+    std::ofstream namesFile((path + "SpeciesNames.txt").c_str());
+    for (unsigned int i = 0 ; i < spNames.size() ; i++)
+      namesFile << spNames[i] << std::endl;
+    namesFile.close();
+    std::cout << "Species tree with " << spNames.size() << " species written in " << path << "SpeciesTree.tree" << std::endl;
+
+    //Sequence evolution model
+    bool cont = false;
+    Alphabet * alphabet = getAlphabetFromOptions(params, cont);
+    SubstitutionModel * model = getModelFromOptions(params, alphabet, 0, cont);
+    DiscreteDistribution * rDist = getRateDistributionFromOptions(params, model, cont);
+
+    //Gene families
+    unsigned int numberOfDigits = TextTools::toString(numberOfFamilies).size();
+    std::ofstream geneList((path + "genelist.file").c_str());
+    std::ofstream allGeneTrees((path + "GeneTrees.trees").c_str());
+    for (unsigned int i = 0 ; i < numberOfFamilies ; i++) {
+      std::string family = "FAM" + TextTools::resizeLeft(TextTools::toString(i + 1), numberOfDigits, '0');
+      TreeTemplate<Node> * geneTree = simulateGeneTree(*spTree, duplicationRate, lossRate, minGenes);
+      newick.write(*geneTree, path + family + ".tree", true);
+      newick.write(*geneTree, allGeneTrees);
+      writeLinkFile(*geneTree, path + family + ".link");
+
+      TreeTemplateTools::scaleTree(*geneTree->getRootNode(), substitutionRate);
+      HomogeneousSequenceSimulator simulator(model, rDist, geneTree);
+      SiteContainer * sites = simulator.simulate(alignmentLength);
+      Fasta fasta;
+      fasta.writeAlignment(path + family + ".fasta", *sites, true);
+
+      writeFamilyOptionFile(path, family, params);
+      //Family weight for the load balance between clients, as number of sequences times alignment length
+      geneList << path << family << ".option:" << geneTree->getNumberOfLeaves() * alignmentLength << std::endl;
+      delete sites;
+      delete geneTree;
+      if ((i + 1) % 1000 == 0)
+        std::cout << "Simulated " << i + 1 << " families." << std::endl;
+    }
+    geneList.close();
+    allGeneTrees.close();
+    writeGeneralOptionFile(path);
+    std::cout << numberOfFamilies << " gene families written in " << path << "; run phyldog with param=" << path << "GeneralOptions.txt" << std::endl;
+
+    delete rDist;
+    delete model;
+    delete alphabet;
+    delete spTree;
+  }
+  catch(std::exception & e)
+  {
+    std::cout << e.what() << std::endl;
+    exit(-1);
+  }
+  return (0);
+}
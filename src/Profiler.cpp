@@ -0,0 +1,200 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include <fstream>
+#include <iomanip>
+#include <sys/time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <Bpp/App/ApplicationTools.h>
+#include <Bpp/Text/TextTools.h>
+
+#include "Profiler.h"
+
+using namespace bpp;
+
+
+unsigned long Profiler::counts_[NUMBER_OF_PROFILED_EVENTS] = { 0 };
+double Profiler::times_[NUMBER_OF_PROFILED_EVENTS] = { 0.0 };
+std::map<std::string, double> Profiler::familyTimes_;
+std::map<std::string, unsigned long> Profiler::familyRounds_;
+std::map<std::string, std::pair<double, double> > Profiler::familyResidentBytes_;
+std::map<std::string, std::pair<double, double> > Profiler::familyLoadedBytes_;
+std::string Profiler::file_ = "";
+unsigned int Profiler::rank_ = 0;
+double Profiler::startingTime_ = 0.0;
+int Profiler::lastStep_ = -1;
+
+
+/******************************************************************************/
+
+void Profiler::initialize(std::map<std::string, std::string> & params, unsigned int rank)
+{
+  rank_ = rank;
+  startingTime_ = getWallTime();
+  file_ = "";
+  if (!ApplicationTools::getBooleanParameter("profile", params, false, "", true, false))
+    return;
+  std::string path = ApplicationTools::getStringParameter("PATH", params, "", "", true, false);
+  if (rank == 0)
+    file_ = path + "Server.profile.csv";
+  else
+    file_ = path + "Client_" + TextTools::toString(rank) + ".profile.csv";
+  std::ofstream out (file_.c_str(), std::ios::out);
+  out << "rank,checkpoint,kind,name,count,seconds" << std::endl;
+  out.close();
+}
+
+/******************************************************************************/
+
+void Profiler::addFamilyTime(const std::string & family, double seconds)
+{
+  familyTimes_[family] += seconds;
+  familyRounds_[family] += 1;
+}
+
+/******************************************************************************/
+
+double Profiler::getFamilyTime(const std::string & family)
+{
+  std::map<std::string, double>::const_iterator it = familyTimes_.find(family);
+  if (it == familyTimes_.end())
+    return 0.0;
+  return it->second;
+}
+
+/******************************************************************************/
+
+void Profiler::setFamilyMemory(const std::string & family,
+                               const std::pair<double, double> & resident,
+                               const std::pair<double, double> & loaded)
+{
+  familyResidentBytes_[family] = resident;
+  familyLoadedBytes_[family] = loaded;
+}
+
+/******************************************************************************/
+
+double Profiler::getHeapBytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return (double)info.uordblks + (double)info.hblkhd;
+#elif defined(__GLIBC__)
+  //The fields of mallinfo are ints, and wrap around beyond 2 GB.
+  struct mallinfo info = mallinfo();
+  return (double)(unsigned int)info.uordblks + (double)(unsigned int)info.hblkhd;
+#else
+  return 0.0;
+#endif
+}
+
+/******************************************************************************/
+
+double Profiler::getWallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+/******************************************************************************/
+
+std::string Profiler::getEventName(ProfiledEvent event)
+{
+  switch (event) {
+    case PROFILE_DL_RECONCILIATION:    return "dl_reconciliation";
+    case PROFILE_COAL_RECONCILIATION:  return "coal_reconciliation";
+    case PROFILE_SINGLE_COPY_RECONCILIATION: return "single_copy_reconciliation";
+    case PROFILE_PLL_EVALUATION:       return "pll_evaluation";
+    case PROFILE_BPP_EVALUATION:       return "bpp_evaluation";
+    case PROFILE_FULL_OPTIMIZATION:    return "full_optimization";
+    case PROFILE_PARTIAL_OPTIMIZATION: return "partial_optimization";
+    case PROFILE_GENE_SPR_TRIED:       return "gene_spr_tried";
+    case PROFILE_GENE_SPR_ACCEPTED:    return "gene_spr_accepted";
+    case PROFILE_SPECIES_SPR_TRIED:    return "species_spr_tried";
+    case PROFILE_SPECIES_SPR_ACCEPTED: return "species_spr_accepted";
+    case PROFILE_TREE_CLONE:           return "tree_clone";
+    case PROFILE_MPI_BROADCAST:        return "mpi_broadcast";
+    case PROFILE_MPI_REDUCE:           return "mpi_reduce";
+    default:                           return "unknown";
+  }
+}
+
+/******************************************************************************/
+
+void Profiler::write(const std::string & checkpoint)
+{
+  if (file_ == "")
+    return;
+  std::ofstream out (file_.c_str(), std::ios::out | std::ios::app);
+  out << std::setprecision(9);
+  out << rank_ << "," << checkpoint << ",total,wall_time,1," << getWallTime() - startingTime_ << std::endl;
+  for (unsigned int i = 0 ; i < NUMBER_OF_PROFILED_EVENTS ; i++)
+  {
+    out << rank_ << "," << checkpoint << ",event," << getEventName((ProfiledEvent)i) << "," << counts_[i] << "," << times_[i] << std::endl;
+  }
+  for (std::map<std::string, double>::const_iterator it = familyTimes_.begin(); it != familyTimes_.end(); ++it)
+  {
+    out << rank_ << "," << checkpoint << ",family," << it->first << "," << familyRounds_[it->first] << "," << it->second << std::endl;
+  }
+  out << rank_ << "," << checkpoint << ",total,heap_bytes," << (unsigned long)getHeapBytes() << ",0" << std::endl;
+  for (std::map<std::string, std::pair<double, double> >::const_iterator it = familyResidentBytes_.begin(); it != familyResidentBytes_.end(); ++it)
+  {
+    const std::pair<double, double> & loaded = familyLoadedBytes_[it->first];
+    out << rank_ << "," << checkpoint << ",family_resident_bytes," << it->first << "," << (unsigned long)it->second.first << "," << (unsigned long)it->second.second << std::endl;
+    out << rank_ << "," << checkpoint << ",family_loaded_bytes," << it->first << "," << (unsigned long)loaded.first << "," << (unsigned long)loaded.second << std::endl;
+  }
+  out.close();
+}
+
+/******************************************************************************/
+
+void Profiler::stepCheckpoint(unsigned int step)
+{
+  if ((int)step == lastStep_)
+    return;
+  lastStep_ = (int)step;
+  write("step_" + TextTools::toString(step));
+}
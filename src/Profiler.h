@@ -0,0 +1,201 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* This file contains a light-weight profiler: counters and timers for the hot spots of the program, dumped per rank as a CSV file.*/
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <string>
+#include <map>
+
+
+/**
+ * @brief Events counted and timed by the Profiler.
+ * Events that are only counted (SPR candidates, tree clones) have a null time.
+ */
+enum ProfiledEvent {
+  PROFILE_DL_RECONCILIATION = 0,
+  PROFILE_COAL_RECONCILIATION,
+  PROFILE_SINGLE_COPY_RECONCILIATION,
+  PROFILE_PLL_EVALUATION,
+  PROFILE_BPP_EVALUATION,
+  PROFILE_FULL_OPTIMIZATION,
+  PROFILE_PARTIAL_OPTIMIZATION,
+  PROFILE_GENE_SPR_TRIED,
+  PROFILE_GENE_SPR_ACCEPTED,
+  PROFILE_SPECIES_SPR_TRIED,
+  PROFILE_SPECIES_SPR_ACCEPTED,
+  PROFILE_TREE_CLONE,
+  PROFILE_MPI_BROADCAST,
+  PROFILE_MPI_REDUCE,
+  NUMBER_OF_PROFILED_EVENTS
+};
+
+
+/**
+ * @brief Per-process counters and timers.
+ *
+ * All members are static: there is one profiler per MPI process.
+ * Counting and timing are always on, and cost an array increment and two
+ * gettimeofday calls per timed event. Counts and times of events can be added
+ * from several OpenMP threads; the other members are only updated by the main thread. The file is only written if the option
+ * profile=yes is given; it is then PATH/Server.profile.csv or PATH/Client_N.profile.csv.
+ * Each call to write() appends the current cumulated values, tagged with a checkpoint name,
+ * as rows "rank,checkpoint,kind,name,count,seconds".
+ * Memory rows are "rank,checkpoint,total,heap_bytes,bytes,0" and, for each family,
+ * "rank,checkpoint,family_resident_bytes,family,estimated,measured" and the same for
+ * family_loaded_bytes: estimates come from the dimensions of the alignment and trees,
+ * measures from the heap of the process (0 if the allocator cannot be queried).
+ */
+class Profiler
+{
+  static unsigned long counts_[NUMBER_OF_PROFILED_EVENTS];
+  static double times_[NUMBER_OF_PROFILED_EVENTS];
+  static std::map<std::string, double> familyTimes_;
+  static std::map<std::string, unsigned long> familyRounds_;
+  static std::map<std::string, std::pair<double, double> > familyResidentBytes_;
+  static std::map<std::string, std::pair<double, double> > familyLoadedBytes_;
+  static std::string file_;
+  static unsigned int rank_;
+  static double startingTime_;
+  static int lastStep_;
+
+public:
+  /**
+   * @brief Reads the profile options, and truncates the output file.
+   *
+   * @param params The general options.
+   * @param rank The MPI rank of this process.
+   */
+  static void initialize(std::map<std::string, std::string> & params, unsigned int rank);
+
+  static void count(ProfiledEvent event, unsigned long n = 1)
+  {
+# ifdef _OPENMP
+#pragma omp atomic
+# endif
+    counts_[event] += n;
+  }
+
+  static void addTime(ProfiledEvent event, double seconds)
+  {
+# ifdef _OPENMP
+#pragma omp atomic
+# endif
+    times_[event] += seconds;
+  }
+
+  /**
+   * @brief Adds the wall time spent on a gene family: its setup, or one round of the main loop.
+   */
+  static void addFamilyTime(const std::string & family, double seconds);
+
+  static unsigned long getCount(ProfiledEvent event) { return counts_[event]; }
+
+  static double getTime(ProfiledEvent event) { return times_[event]; }
+
+  static double getFamilyTime(const std::string & family);
+
+  static const std::map<std::string, double> & getFamilyTimes() { return familyTimes_; }
+
+  /**
+   * @brief Records the memory of a gene family, in bytes.
+   *
+   * @param family The family.
+   * @param resident Estimated and measured memory kept between rounds: alignment, trees, tables.
+   * @param loaded Estimated and measured memory of the likelihood evaluator, freed when the family is unloaded.
+   */
+  static void setFamilyMemory(const std::string & family,
+                              const std::pair<double, double> & resident,
+                              const std::pair<double, double> & loaded);
+
+  /**
+   * @brief Bytes currently allocated on the heap of this process, or 0 if unknown.
+   */
+  static double getHeapBytes();
+
+  /**
+   * @brief Wall clock time in seconds, with microsecond resolution.
+   */
+  static double getWallTime();
+
+  static std::string getEventName(ProfiledEvent event);
+
+  /**
+   * @brief Appends the current values to the profile file, if profiling was asked for.
+   *
+   * @param checkpoint A label for this dump, e.g. "step_2" or "end".
+   */
+  static void write(const std::string & checkpoint);
+
+  /**
+   * @brief Writes a "step_N" checkpoint the first time a given step of the algorithm is reached.
+   */
+  static void stepCheckpoint(unsigned int step);
+};
+
+
+/**
+ * @brief Counts one occurrence of an event and adds the time spent in the enclosing scope.
+ */
+class ScopedTimer
+{
+  ProfiledEvent event_;
+  double startingTime_;
+
+public:
+  ScopedTimer(ProfiledEvent event) : event_(event), startingTime_(Profiler::getWallTime()) {}
+
+  ~ScopedTimer()
+  {
+    Profiler::count(event_);
+    Profiler::addTime(event_, Profiler::getWallTime() - startingTime_);
+  }
+
+private:
+  ScopedTimer(const ScopedTimer &);
+  ScopedTimer & operator=(const ScopedTimer &);
+};
+
+
+#endif  //_PROFILER_H_
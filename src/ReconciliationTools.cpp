@@ -41,6 +41,8 @@
 /* This file contains various functions useful for reconciliations, such as reconciliation computation, printing of trees with integer indexes, search of a root with reconciliation...*/
 
 #include "ReconciliationTools.h"
+#include "Profiler.h"
+#include "TreeSplits.h"
 
 #include "mpi.h"
 
@@ -2200,6 +2202,130 @@ void computeNumbersOfLineagesFromRoot ( TreeTemplate<Node> * spTree,
  * The boolean "fillTables" is here to tell whether we want to update the vectors num*lineages.
  ****************************************************************************/
 
+static void addSingleCopyLineages ( const Node * node,
+                                    const std::vector <int> & numberOfGenesBelow,
+                                    const std::vector< double> & lossRates,
+                                    const std::vector < double> & duplicationRates,
+                                    double & logLk,
+                                    std::vector <int> &num0lineages,
+                                    std::vector <int> &num1lineages,
+                                    bool fillTables )
+{
+  int id = node->getId();
+  if ( numberOfGenesBelow[id] == 0 ) {
+    logLk += computeLogBranchProbability ( duplicationRates[id], lossRates[id], 0 );
+    if ( fillTables )
+      num0lineages[id] += 1;
+    return;
+  }
+  logLk += computeLogBranchProbability ( duplicationRates[id], lossRates[id], 1 );
+  if ( fillTables )
+    num1lineages[id] += 1;
+  for ( unsigned int i = 0; i < node->getNumberOfSons(); i++ ) {
+    addSingleCopyLineages ( node->getSon ( i ), numberOfGenesBelow, lossRates, duplicationRates,
+                            logLk, num0lineages, num1lineages, fillTables );
+  }
+}
+
+
+/*****************************************************************************
+ * Fast path of findMLReconciliationDR for gene trees with at most one gene
+ * per species, whose unrooted topology is the one induced by the species tree
+ * on their species, as is often the case for single-copy families.
+ * Unless duplication probabilities are very high, their most likely
+ * reconciliation is the one without duplication, rooted as the species tree:
+ * each branch of the species tree below the last common ancestor of the
+ * species has one gene, or ends with a loss if it has no gene. Its likelihood
+ * and lineage counts are thus obtained from the species tree, without
+ * reconciliation tables.
+ * Returns false, without changing anything, if the gene tree is not of this kind.
+ ****************************************************************************/
+
+static bool findSingleCopyReconciliation ( TreeTemplate<Node> * spTree,
+                                           TreeTemplate<Node> * geneTree,
+                                           const std::map<std::string, std::string > & seqSp,
+                                           const std::map<std::string, int > & spID,
+                                           const std::vector< double> & lossRates,
+                                           const std::vector < double> & duplicationRates,
+                                           double & logLk,
+                                           int & MLindex,
+                                           std::vector <int> &num0lineages,
+                                           std::vector <int> &num1lineages,
+                                           std::vector <int> &num2lineages,
+                                           std::set <int> &nodesToTryInNNISearch,
+                                           bool fillTables )
+{
+  size_t numberOfSpNodes = spTree->getNumberOfNodes();
+  std::vector <int> numberOfGenesBelow ( numberOfSpNodes, 0 );
+  std::map <std::string, size_t> geneIndices;
+  std::vector <std::string> geneNames = geneTree->getLeavesNames();
+  if ( geneNames.size() < 3 ) {
+    return false;
+  }
+  for ( unsigned int i = 0; i < geneNames.size(); i++ ) {
+    std::map<std::string, std::string >::const_iterator seqtosp = seqSp.find ( geneNames[i] );
+    if ( seqtosp == seqSp.end() ) {
+      return false;
+    }
+    std::map<std::string, int >::const_iterator sptoid = spID.find ( seqtosp->second );
+    if ( sptoid == spID.end() || numberOfGenesBelow[sptoid->second] > 0 ) {
+      return false;
+    }
+    numberOfGenesBelow[sptoid->second] = 1;
+    geneIndices[geneNames[i]] = sptoid->second;
+  }
+  std::map <std::string, size_t> speciesIndices ( spID.begin(), spID.end() );
+  const Node * outgroup = 0;
+  if ( !isInducedTopology ( *geneTree, geneIndices, *spTree, speciesIndices, outgroup ) ) {
+    return false;
+  }
+  Profiler::count ( PROFILE_SINGLE_COPY_RECONCILIATION );
+
+  //Sons have larger ids than their fathers.
+  for ( size_t i = numberOfSpNodes; i-- > 0; ) {
+    Node * node = spTree->getNode ( i );
+    for ( unsigned int j = 0; j < node->getNumberOfSons(); j++ ) {
+      numberOfGenesBelow[i] += numberOfGenesBelow[node->getSon ( j )->getId()];
+    }
+  }
+  //The root of the gene tree is at the last common ancestor of its species.
+  const Node * lca = spTree->getRootNode();
+  bool found = false;
+  while ( !found ) {
+    found = true;
+    for ( unsigned int j = 0; j < lca->getNumberOfSons(); j++ ) {
+      if ( numberOfGenesBelow[lca->getSon ( j )->getId()] == numberOfGenesBelow[lca->getId()] ) {
+        lca = lca->getSon ( j );
+        found = false;
+        break;
+      }
+    }
+  }
+  if ( fillTables ) {
+    nodesToTryInNNISearch.clear();
+    resetVector ( num0lineages );
+    resetVector ( num1lineages );
+    resetVector ( num2lineages );
+  }
+  logLk = 0.0;
+  addSingleCopyLineages ( lca, numberOfGenesBelow, lossRates, duplicationRates,
+                          logLk, num0lineages, num1lineages, fillTables );
+
+  vector<Node*> nodes = geneTree->getNodes();
+  for ( unsigned int i = 0 ; i < nodes.size() ; i++ ) {
+    if ( nodes[i]->hasNodeProperty ( "outgroupNode" ) ) {
+      nodes[i]->deleteNodeProperty ( "outgroupNode" );
+      break;
+    }
+  }
+  const_cast<Node *> ( outgroup )->setNodeProperty ( "outgroupNode", BppString ( "here" ) );
+  MLindex = outgroup->getId();
+  return true;
+}
+
+
+/****************************************************************************/
+
 double findMLReconciliationDR ( TreeTemplate<Node> * spTree,
                                 TreeTemplate<Node> * geneTree,
                                 const std::map<std::string, std::string > seqSp,
@@ -2213,6 +2339,7 @@ double findMLReconciliationDR ( TreeTemplate<Node> * spTree,
                                 std::set <int> &nodesToTryInNNISearch,
                                 bool fillTables )
 {
+  ScopedTimer timer ( PROFILE_DL_RECONCILIATION );
 
 /*  std::cout<< "findMLReconciliationDR "<<std::endl;
   VectorTools::print(lossRates);
@@ -2226,6 +2353,12 @@ std::cout << TreeTemplateTools::treeToParenthesis(*geneTree, true)<<std::endl;*/
     std::cout <<"!!!!!!gene tree is not rooted in findMLReconciliationDR !!!!!!"<<std::endl;
     exit ( -1 );
   }
+  double singleCopyLogLk;
+  if ( findSingleCopyReconciliation ( spTree, geneTree, seqSp, spID, lossRates, duplicationRates,
+                                      singleCopyLogLk, MLindex, num0lineages, num1lineages, num2lineages,
+                                      nodesToTryInNNISearch, fillTables ) ) {
+    return singleCopyLogLk;
+  }
   std::vector <double> nodeData ( 3, 0.0 );
   std::vector <std::vector<double> > likelihoodData ( geneTree->getNumberOfNodes(), nodeData );
 
@@ -2629,22 +2762,22 @@ void computeDuplicationAndLossRatesForTheSpeciesTree ( std::string &branchProbaO
 {
   //outputting trees with branch lengths in numbers of events, before correction.
   computeDuplicationAndLossProbabilitiesForAllBranches ( num0Lineages, num1Lineages, num2Lineages, lossExpectedNumbers, duplicationExpectedNumbers );
-  std::cout << "Species tree with expected numbers of duplications as branch lengths:"<<std::endl;
+  DEBUG_LOG("Species tree with expected numbers of duplications as branch lengths:");
   for ( unsigned int i =0; i<num0Lineages.size() ; i++ ) {
     tree.getNode ( i )->setBranchProperty ( "DUPLICATIONS", Number<double> ( duplicationExpectedNumbers[i] ) );
     if ( tree.getNode ( i )->hasFather() ) {
       tree.getNode ( i )->setDistanceToFather ( duplicationExpectedNumbers[i] );
     }
   }
-  std::cout << treeToParenthesisWithDoubleNodeValues ( tree, false, "DUPLICATIONS" ) <<std::endl;
-  std::cout << "Species tree with expected numbers of losses as branch lengths:"<<std::endl;
+  DEBUG_LOG(treeToParenthesisWithDoubleNodeValues ( tree, false, "DUPLICATIONS" ));
+  DEBUG_LOG("Species tree with expected numbers of losses as branch lengths:");
   for ( unsigned int i =0; i<num0Lineages.size() ; i++ ) {
     tree.getNode ( i )->setBranchProperty ( "LOSSES", Number<double> ( lossExpectedNumbers[i] ) );
     if ( tree.getNode ( i )->hasFather() ) {
       tree.getNode ( i )->setDistanceToFather ( lossExpectedNumbers[i] );
     }
   }
-  std::cout << treeToParenthesisWithDoubleNodeValues ( tree, false, "LOSSES" ) <<std::endl;
+  DEBUG_LOG(treeToParenthesisWithDoubleNodeValues ( tree, false, "LOSSES" ));
 
   //Doing the correction:
   if ( branchProbaOptimization=="average" ) {
@@ -2818,56 +2951,105 @@ bool sortMinFunction ( std::pair <std::vector<std::string>, double> i, std::pair
 
 
 
-void generateListOfOptionsPerClient ( std::vector <std::string> listOptions, int size, std::vector <std::vector<std::string> > &listOfOptionsPerClient, std::vector <unsigned int> &numbersOfGenesPerClient ) {
+void generateListOfOptionsPerClient ( std::vector <std::string> listOptions, int size, std::vector <std::vector<std::string> > &listOfOptionsPerClient, std::vector <unsigned int> &numbersOfGenesPerClient, std::vector <double> &predictedLoadsPerClient, double memoryBudget ) {
   //Here, two alternatives: either we do have information regarding the gene family sizes, or we don't.
   //Is there size information? == Is there a ":" in the first line?
   if ( TextTools::hasSubstring ( listOptions[0],":" ) ) {
     std::vector <std::pair <std::string, double> > elements;
+    //Resident and loaded memory of the families, if known (file:weight:resident:loaded)
+    std::map <std::string, std::pair <double, double> > memories;
     for ( unsigned int i = 0; i<listOptions.size() ; i++ ) {
       StringTokenizer st1 ( listOptions[i], ":", true );
       elements.push_back ( std::pair <std::string, double> ( st1.getToken ( 0 ), TextTools::toDouble ( st1.getToken ( 1 ) ) ) );
+      if ( st1.numberOfRemainingTokens() >= 4 ) {
+        memories[st1.getToken ( 0 )] = std::pair <double, double> ( TextTools::toDouble ( st1.getToken ( 2 ) ), TextTools::toDouble ( st1.getToken ( 3 ) ) );
+      }
     }
 
     //Now sort the gene families by their size, in descending order
     sort ( elements.begin(), elements.end(), sortMaxFunction );
-    //Now we assign gene families to nodes.
+    //Now we assign gene families to nodes (LPT scheduling).
     //We start with big families, and then go in decreasing order.
-    //First we assign the first families
-    std::vector <std::pair <std::vector<std::string>, double> > listOfOptionsAndTotSizePerClient;
-
-    std::vector<std::string> temp2;
-    std::pair <std::vector<std::string>, double> temp3;
+    //First we assign the first families, one per client
+    std::vector <std::vector<std::string> > optionsPerClient ( size-1 );
+    predictedLoadsPerClient.assign ( size, 0.0 );
+    //Memory of each client: resident memory of all its families, plus its largest loaded family
+    std::vector <double> residentPerClient ( size-1, 0.0 );
+    std::vector <double> maxLoadedPerClient ( size-1, 0.0 );
+    bool overBudget = false;
+    //Min-heap of (load, client), so that ties go to the client of smallest index
+    std::priority_queue < std::pair <double, int>, std::vector < std::pair <double, int> >, std::greater < std::pair <double, int> > > loads;
     unsigned int j = 0;
 
     for ( int i = 0; i<size-1 ; i++ ) {
-      listOfOptionsAndTotSizePerClient.push_back ( temp3 );
-      listOfOptionsAndTotSizePerClient[i].first.push_back ( elements[j].first );
-      listOfOptionsAndTotSizePerClient[i].second = elements[j].second;
+      optionsPerClient[i].push_back ( elements[j].first );
+      loads.push ( std::pair <double, int> ( elements[j].second, i ) );
+      if ( memories.find ( elements[j].first ) != memories.end() ) {
+        residentPerClient[i] = memories[elements[j].first].first;
+        maxLoadedPerClient[i] = memories[elements[j].first].second;
+      }
       j = j+1;
     }
 
     while ( j<listOptions.size() ) {
-      //We sort listOfOptionsAndTotSizePerClient in increasing function
-      sort ( listOfOptionsAndTotSizePerClient.begin(), listOfOptionsAndTotSizePerClient.end(), sortMinFunction );
-      listOfOptionsAndTotSizePerClient[0].first.push_back ( elements[j].first );
-      listOfOptionsAndTotSizePerClient[0].second = listOfOptionsAndTotSizePerClient[0].second + elements[j].second;
+      //The least loaded client gets the next family,
+      //or the least loaded of those whose memory budget it fits in.
+      std::pair <double, int> least = loads.top();
+      std::map <std::string, std::pair <double, double> >::const_iterator memory = memories.find ( elements[j].first );
+      if ( memoryBudget > 0.0 && memory != memories.end() ) {
+        std::vector < std::pair <double, int> > tooFull;
+        while ( !loads.empty() ) {
+          std::pair <double, int> candidate = loads.top();
+          loads.pop();
+          if ( residentPerClient[candidate.second] + memory->second.first + std::max ( maxLoadedPerClient[candidate.second], memory->second.second ) <= memoryBudget ) {
+            least = candidate;
+            break;
+          }
+          tooFull.push_back ( candidate );
+        }
+        if ( loads.size() + tooFull.size() == ( unsigned int ) ( size-1 ) ) {
+          //No client can take it within the budget
+          overBudget = true;
+          least = tooFull[0];
+          tooFull.erase ( tooFull.begin() );
+        }
+        for ( unsigned int k = 0 ; k < tooFull.size() ; k++ ) {
+          loads.push ( tooFull[k] );
+        }
+      }
+      else {
+        loads.pop();
+      }
+      optionsPerClient[least.second].push_back ( elements[j].first );
+      least.first = least.first + elements[j].second;
+      loads.push ( least );
+      if ( memory != memories.end() ) {
+        residentPerClient[least.second] += memory->second.first;
+        maxLoadedPerClient[least.second] = std::max ( maxLoadedPerClient[least.second], memory->second.second );
+      }
       j= j+1;
     }
+    if ( overBudget ) {
+      std::cout <<"WARNING: some gene families do not fit in the memory budget of any client (client.memory.budget)."<<std::endl;
+    }
+    while ( !loads.empty() ) {
+      predictedLoadsPerClient[loads.top().second + 1] = loads.top().first;
+      loads.pop();
+    }
 
     //Now all gene families must have been assigned to nodes.
-    // std::vector <std::vector<std::string> > listOfOptionsPerClient;
+    std::vector<std::string> temp2;
     listOfOptionsPerClient.push_back ( temp2 );
     listOfOptionsPerClient[0].push_back ( std::string ( "####" ) ); //For the root node
     numbersOfGenesPerClient.push_back ( 0 );
 
     //We print the result of the assignment and fill listOfOptionsPerClient:
     for ( int i = 0; i<size-1 ; i++ ) {
-      std::cout <<"Client "<<i<<" is in charge of "<< listOfOptionsAndTotSizePerClient[i].first.size() <<" gene families; Total Weight : "<<listOfOptionsAndTotSizePerClient[i].second<<std::endl;
-      listOfOptionsPerClient.push_back ( listOfOptionsAndTotSizePerClient[i].first );
-      numbersOfGenesPerClient.push_back ( listOfOptionsAndTotSizePerClient[i].first.size() );
+      std::cout <<"Client "<<i<<" is in charge of "<< optionsPerClient[i].size() <<" gene families; Total Weight : "<<predictedLoadsPerClient[i + 1]<<std::endl;
+      listOfOptionsPerClient.push_back ( optionsPerClient[i] );
+      numbersOfGenesPerClient.push_back ( optionsPerClient[i].size() );
     }
     return ;
-    //generateListOfOptionsPerClient(listOptions, size, listOfOptionsPerClient, numbersOfGenesPerClient);
   }
   else {
     int numberOfGenesPerClient = ( int ) ( listOptions.size() ) / ( size -1 );
@@ -2883,6 +3065,7 @@ void generateListOfOptionsPerClient ( std::vector <std::string> listOptions, int
     }
     std::vector<unsigned int>::iterator it2 = numbersOfGenesPerClient.begin();
     numbersOfGenesPerClient.insert ( it2, int ( 0 ) ); //For the server, we insert a "dumb" option file at the beginning of the std::vector, so only clients compute the reconciliation
+    predictedLoadsPerClient.assign ( numbersOfGenesPerClient.begin(), numbersOfGenesPerClient.end() );
     int currentFile = 0;
     std::vector<std::string> temp2;
     for ( int i = 0 ; i< size ; i++ ) {
@@ -3432,6 +3615,68 @@ void qualityControlGeneTree ( TreeTemplate<Node>* geneTree, bpp::VectorSiteConta
 }
 
 
+void collapseIdenticalSequences ( bpp::VectorSiteContainer * sites, const std::map <std::string, std::string> & seqSp, std::map <std::string, std::vector <std::string> > & collapsedSequences, std::string file) {
+  //For each species, the sequences already kept, by content
+  std::map <std::string, std::map <std::string, std::string> > keptSequences;
+  std::vector <std::string> seqsToRemove;
+  std::vector <std::string> seqNames = sites->getSequencesNames();
+  for ( unsigned int j = 0 ; j < seqNames.size() ; j++ ) {
+    std::map <std::string, std::string>::const_iterator sp = seqSp.find ( seqNames[j] );
+    if ( sp == seqSp.end() )
+      continue;
+    std::string content = sites->getSequence ( seqNames[j] ).toString();
+    std::map <std::string, std::string> & kept = keptSequences[sp->second];
+    std::map <std::string, std::string>::iterator it = kept.find ( content );
+    if ( it == kept.end() )
+      kept[content] = seqNames[j];
+    else {
+      collapsedSequences[it->second].push_back ( seqNames[j] );
+      seqsToRemove.push_back ( seqNames[j] );
+    }
+  }
+  //Small families are left as they are.
+  if ( seqNames.size() - seqsToRemove.size() < 3 ) {
+    collapsedSequences.clear();
+    return;
+  }
+  for ( unsigned int j =0 ; j<seqsToRemove.size(); j++ ) {
+    sites->deleteSequence ( seqsToRemove[j] );
+  }
+  if ( seqsToRemove.size() > 0 )
+    std::cout << "Collapsed "<< seqsToRemove.size() <<" sequences identical to another sequence of the same species in family "<< file <<std::endl;
+  return;
+}
+
+
+void expandCollapsedSequences ( TreeTemplate<Node> & geneTree, const std::map <std::string, std::vector <std::string> > & collapsedSequences ) {
+  if ( collapsedSequences.empty() )
+    return;
+  std::vector <Node*> leaves = geneTree.getLeaves();
+  for ( unsigned int j = 0 ; j < leaves.size() ; j++ ) {
+    std::map <std::string, std::vector <std::string> >::const_iterator it = collapsedSequences.find ( leaves[j]->getName() );
+    if ( it == collapsedSequences.end() || !leaves[j]->hasFather() )
+      continue;
+    //Each removed sequence is grafted with a null branch length onto the branch leading to the kept sequence.
+    for ( unsigned int k = 0 ; k < it->second.size() ; k++ ) {
+      Node * father = leaves[j]->getFather();
+      size_t pos = father->getSonPosition ( leaves[j] );
+      Node * duplication = new Node();
+      father->removeSon ( pos );
+      father->addSon ( pos, duplication );
+      if ( leaves[j]->hasDistanceToFather() )
+        duplication->setDistanceToFather ( leaves[j]->getDistanceToFather() );
+      duplication->addSon ( leaves[j] );
+      leaves[j]->setDistanceToFather ( 0.0 );
+      Node * copy = new Node ( it->second[k] );
+      duplication->addSon ( copy );
+      copy->setDistanceToFather ( 0.0 );
+    }
+  }
+  geneTree.resetNodesId();
+  return;
+}
+
+
 bpp::Alphabet* getAlphabetFromOptions ( std::map <std::string, std::string>  params, bool& cont)
 {
   Alphabet *alphabet = bpp::SequenceApplicationTools::getAlphabet ( params, "", false );
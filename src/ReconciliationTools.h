@@ -45,6 +45,7 @@ knowledge of the CeCILL license and that you accept its terms.
 #ifndef _RECONCILIATIONTOOLS_H_
 #define _RECONCILIATIONTOOLS_H_
 
+#include <functional>
 #include <queue>
 #include <set>
 
@@ -318,7 +319,9 @@ bool sortMinFunction ( std::pair <std::vector<std::string>, double> i, std::pair
 void generateListOfOptionsPerClient ( std::vector <std::string> listOptions,
                                       int size,
                                       std::vector <std::vector<std::string> > &listOfOptionsPerClient,
-                                      std::vector <unsigned int> &numbersOfGenesPerClient );
+                                      std::vector <unsigned int> &numbersOfGenesPerClient,
+                                      std::vector <double> &predictedLoadsPerClient,
+                                      double memoryBudget = 0.0 );
 std::string removeComments (
     const std::string & s,
     const std::string & begin,
@@ -374,6 +377,13 @@ void removeUselessSequencesFromAlignment ( const TreeTemplate<Node>* spTree, bpp
 //Remove sequences from both the alignment and gene tree in case they have a very long branch
 void qualityControlGeneTree ( bpp::TreeTemplate<bpp::Node>* geneTree, bpp::VectorSiteContainer * sites, bool& cont, std::string file);
 
+//Keeps one sequence per set of identical sequences of the same species, and removes the others from the alignment.
+//collapsedSequences gives, for each kept sequence, the names of the sequences it stands for.
+void collapseIdenticalSequences ( bpp::VectorSiteContainer * sites, const std::map <std::string, std::string> & seqSp, std::map <std::string, std::vector <std::string> > & collapsedSequences, std::string file);
+
+//Puts back the sequences removed by collapseIdenticalSequences, as recent duplications of the sequence that stood for them
+void expandCollapsedSequences ( bpp::TreeTemplate<bpp::Node> & geneTree, const std::map <std::string, std::vector <std::string> > & collapsedSequences );
+
 // Utilitary function to recover a loss after a duplication.
 int recoverLossClosestToDuplication(TreeTemplate<Node> * spTree, int a, int aold);
 
@@ -40,8 +40,44 @@ knowledge of the CeCILL license and that you accept its terms.
 */
 /* This file contains various functions useful for the search of the species tree*/
 
+#include <algorithm>
+#include <cmath>
+
 #include "Constants.h"
 #include "SpeciesTreeExploration.h"
+#include "Profiler.h"
+
+
+
+
+/************************************************************************
+ * Rate refinement: after a round, the server re-estimates the duplication
+ * and loss rates (or coalescent branch lengths) from the lineage counts of
+ * the clients. The clients are queried again with the new rates only if
+ * these moved by more than rates.requery.threshold (relative change on the
+ * most changed branch), for at most rates.max.rounds rounds. Below the
+ * threshold, reconciliations are unlikely to change, and the new rates are
+ * kept for the next species tree without another round.
+************************************************************************/
+static double ratesRequeryThreshold = 0.0;
+static int ratesMaxRounds = 1;
+
+void initializeRateRefinement(std::map<std::string, std::string> & params)
+{
+  ratesRequeryThreshold = ApplicationTools::getDoubleParameter("rates.requery.threshold", params, 0.0, "", true, false);
+  ratesMaxRounds = ApplicationTools::getIntParameter("rates.max.rounds", params, 1, "", true, false);
+}
+
+
+static double computeMaxRelativeChange(const std::vector<double> & before, const std::vector<double> & after)
+{
+  double change = 0.0;
+  for (unsigned int i = 0 ; i < before.size() && i < after.size() ; i++)
+  {
+    change = std::max(change, fabs(after[i] - before[i]) / std::max(fabs(before[i]), 0.000001));
+  }
+  return change;
+}
 
 
 
@@ -178,11 +214,11 @@ void localOptimizationWithNNIsAndReRootings(const mpi::communicator& world,
           }
         }*/
 
-              treesToLogLk[TreeTemplateTools::treeToParenthesis( *tree, false )] = logL;
+              treesToLogLk[computeTopologyKey( *tree )] = logL;
 
           if (logL+0.01<bestlogL)
           {
-              std::cout << "\t\tNNIs or Root changes: Improvement: new total Likelihood value "<<logL<<" compared to the best log Likelihood : "<<bestlogL<< std::endl;
+              INFO_LOG("\t\tNNIs or Root changes: Improvement: new total Likelihood value "<<logL<<" compared to the best log Likelihood : "<<bestlogL);
               numIterationsWithoutImprovement = 0;
               bestlogL =logL;
 			 // breadthFirstreNumber (*tree);
@@ -206,7 +242,7 @@ void localOptimizationWithNNIsAndReRootings(const mpi::communicator& world,
                   bestTree = 0;
               }
               bestTree = tree->clone();
-              std::cout << "Improved species tree: "<<TreeTemplateTools::treeToParenthesis(*tree, true)<< std::endl;
+              DEBUG_LOG("Improved species tree: "<<TreeTemplateTools::treeToParenthesis(*tree, true));
               bestIndex = index;
               for (unsigned int i = 0 ; i< NNILks.size() ; i++ )
               {
@@ -225,7 +261,7 @@ void localOptimizationWithNNIsAndReRootings(const mpi::communicator& world,
       else
         {
             numIterationsWithoutImprovement++;
-            std::cout <<"\t\tNNIs or Root changes: Number of iterations without improvement: "<<numIterationsWithoutImprovement<< std::endl;
+            INFO_LOG("\t\tNNIs or Root changes: Number of iterations without improvement: "<<numIterationsWithoutImprovement);
             if (tree) delete tree;
             tree = bestTree->clone();
             if (reconciliationModel == "DL") {
@@ -248,9 +284,9 @@ void localOptimizationWithNNIsAndReRootings(const mpi::communicator& world,
         }
       }
       else { //The tree has already been found.
-            std::cout << "This species tree has already been tried. "<<std::endl;
+            DEBUG_LOG("This species tree has already been tried. ");
             numIterationsWithoutImprovement++;
-            std::cout <<"\t\tNNIs or Root changes: Number of iterations without improvement: "<<numIterationsWithoutImprovement<< std::endl;
+            INFO_LOG("\t\tNNIs or Root changes: Number of iterations without improvement: "<<numIterationsWithoutImprovement);
             if (tree) delete tree;
             tree = bestTree->clone();
             if (reconciliationModel == "DL") {
@@ -481,9 +517,9 @@ void fastTryAllPossibleReRootingsAndMakeBestOne(const mpi::communicator& world,
           }
 
         bestIndex = index;
-       std::cout <<"ReRooting: Improvement! : "<<numIterationsWithoutImprovement<< " logLk: "<<logL<< std::endl;
-       std::cout << "Better candidate tree likelihood : "<<bestlogL<< std::endl;
-       std::cout << TreeTemplateTools::treeToParenthesis(*tree, true)<< std::endl;
+       INFO_LOG("ReRooting: Improvement! : "<<numIterationsWithoutImprovement<< " logLk: "<<logL);
+       INFO_LOG("Better candidate tree likelihood : "<<bestlogL);
+       DEBUG_LOG(TreeTemplateTools::treeToParenthesis(*tree, true));
 		/*  //TEMP PRINTING
 		  //For loss rates
 		  for (unsigned int i =0; i<num0Lineages.size() ; i++ )
@@ -505,7 +541,7 @@ void fastTryAllPossibleReRootingsAndMakeBestOne(const mpi::communicator& world,
         numIterationsWithoutImprovement++;
 		 duplicationExpectedNumbers = backupDupProba ;
 		 lossExpectedNumbers = backupLossProba ;
-        std::cout <<"ReRooting: Number of iterations without improvement : "<<numIterationsWithoutImprovement<< " logLk: "<<logL<< std::endl;
+        INFO_LOG("ReRooting: Number of iterations without improvement : "<<numIterationsWithoutImprovement<< " logLk: "<<logL);
       }
     }
     if (ApplicationTools::getTime() >= timeLimit)
@@ -535,8 +571,8 @@ void fastTryAllPossibleReRootingsAndMakeBestOne(const mpi::communicator& world,
       }
     if (currentTree) delete currentTree;
     currentTree = bestTree->clone();
-   std::cout << "\t\tServer: tryAllPossibleReRootingsAndMakeBestOne: new total Likelihood value "<<logL<< std::endl;
-   std::cout << TreeTemplateTools::treeToParenthesis(*currentTree, true)<< std::endl;
+   INFO_LOG("\t\tServer: tryAllPossibleReRootingsAndMakeBestOne: new total Likelihood value "<<logL);
+   DEBUG_LOG(TreeTemplateTools::treeToParenthesis(*currentTree, true));
 
 	  /*
 	  //TEMP PRINTING
@@ -565,7 +601,7 @@ void fastTryAllPossibleReRootingsAndMakeBestOne(const mpi::communicator& world,
       //COMPUTATION IN CLIENTS
       index++;
       bestIndex = index;
-      std::cout <<"\t\tNumber of species trees tried : "<<index<< std::endl;
+      INFO_LOG("\t\tNumber of species trees tried : "<<index);
           gathersInformationFromClients (world,
                                          server,
                                          server,
@@ -612,9 +648,67 @@ void fastTryAllPossibleReRootingsAndMakeBestOne(const mpi::communicator& world,
 }
 
 
+/************************************************************************
+ * Gives the order in which subtrees are pruned by fastTryAllPossibleSPRs.
+ * By default, nodes are taken from the last id to the first.
+ * With conflictOrdering, nodes come by decreasing conflict between the species tree
+ * and the gene trees, as measured by the lineage numbers of the last reconciliations
+ * on the branch above the node and on the branch above its father:
+ * proportion of duplications and losses for DL, of deep coalescences for COAL.
+ ************************************************************************/
+static double computeBranchConflict(int id,
+                                    const std::string &reconciliationModel,
+                                    const std::vector<int> &num0Lineages,
+                                    const std::vector<int> &num1Lineages,
+                                    const std::vector<int> &num2Lineages,
+                                    const std::vector<unsigned int> &num12Lineages,
+                                    const std::vector<unsigned int> &num22Lineages)
+{
+  size_t i = (size_t)id;
+  if (reconciliationModel == "DL" && i < num0Lineages.size() && i < num1Lineages.size() && i < num2Lineages.size()) {
+    double total = num0Lineages[i] + num1Lineages[i] + num2Lineages[i];
+    return total > 0 ? (num0Lineages[i] + num2Lineages[i]) / total : 0.0;
+  }
+  else if (reconciliationModel == "COAL" && i < num12Lineages.size() && i < num22Lineages.size()) {
+    double total = num12Lineages[i] + num22Lineages[i];
+    return total > 0 ? num22Lineages[i] / total : 0.0;
+  }
+  return 0.0;
+}
+
+static void computeSPROrder(TreeTemplate<Node> &tree, bool conflictOrdering,
+                            const std::string &reconciliationModel,
+                            const std::vector<int> &num0Lineages,
+                            const std::vector<int> &num1Lineages,
+                            const std::vector<int> &num2Lineages,
+                            const std::vector<unsigned int> &num12Lineages,
+                            const std::vector<unsigned int> &num22Lineages,
+                            std::vector<int> &order)
+{
+  order.clear();
+  std::vector< std::pair<double, int> > conflicts;
+  for (int id = (int)tree.getNumberOfNodes()-1 ; id > 0 ; id--) {
+    double conflict = 0.0;
+    if (conflictOrdering) {
+      conflict = computeBranchConflict(id, reconciliationModel, num0Lineages, num1Lineages, num2Lineages, num12Lineages, num22Lineages);
+      Node * node = tree.getNode(id);
+      if (node->hasFather() && node->getFather()->hasFather())
+        conflict += computeBranchConflict(node->getFather()->getId(), reconciliationModel, num0Lineages, num1Lineages, num2Lineages, num12Lineages, num22Lineages);
+    }
+    //Ties keep the default order
+    conflicts.push_back(std::make_pair(-conflict, -id));
+  }
+  std::sort(conflicts.begin(), conflicts.end());
+  for (size_t i = 0 ; i < conflicts.size() ; i++)
+    order.push_back(-conflicts[i].second);
+}
+
+
 /************************************************************************
  * Tries all SPRs at a distance < dist for all possible subtrees of the subtree starting in node nodeForSPR,
  * and executes the ones with the highest likelihood.
+ * Subtrees are pruned in the order given by computeSPROrder. If the first sprCutoffFraction
+ * of them do not improve the tree, the other ones are not tried, and count as iterations without improvement.
  ************************************************************************/
 void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *& currentTree,
                             TreeTemplate<Node> *& bestTree, unsigned int &index, unsigned int &bestIndex,
@@ -633,7 +727,8 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
                             bool rearrange, unsigned int &numIterationsWithoutImprovement, unsigned int server,
                             std::string &branchExpectedNumbersOptimization, std::map < std::string, int> genomeMissing,
                             int sprLimit, bool optimizeRates, unsigned int currentStep,
-							const bool fixedOutgroupSpecies_, const std::vector < std::string > outgroupSpecies_) {
+							const bool fixedOutgroupSpecies_, const std::vector < std::string > outgroupSpecies_,
+                            const bool sprConflictOrdering, const double sprCutoffFraction) {
 
     std::vector <double> bestDupProba;
     std::vector <double> bestLossProba;
@@ -656,8 +751,22 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
     std::vector <int> nodeIdsToRegraft;
   bool betterTree;
   TreeTemplate<Node> *tree = 0;
+  std::vector <int> sprOrder;
+  computeSPROrder(*currentTree, sprConflictOrdering, reconciliationModel,
+                  num0Lineages, num1Lineages, num2Lineages, num12Lineages, num22Lineages, sprOrder);
+  size_t cutoff = (size_t) ceil(sprCutoffFraction * sprOrder.size());
+  bool improvedInPass = false;
+  //After an accepted SPR the order is recomputed, and tried again from its start
+  bool orderRecomputed = false;
 	//Main loop
-  for (unsigned int nodeForSPR=currentTree->getNumberOfNodes()-1 ; nodeForSPR >0; nodeForSPR--) {
+  for (size_t rank = 0 ; rank < sprOrder.size() ; rank = orderRecomputed ? 0 : rank + 1) {
+    orderRecomputed = false;
+    if (!improvedInPass && rank >= cutoff) {
+      numIterationsWithoutImprovement += sprOrder.size() - rank;
+      INFO_LOG("SPRs: no improvement from the first "<< rank <<" subtrees, ending this pass.");
+      break;
+    }
+    unsigned int nodeForSPR = sprOrder[rank];
     buildVectorOfRegraftingNodesLimitedDistance(*currentTree, nodeForSPR, sprLimit, nodeIdsToRegraft);
     betterTree = false;
     for (size_t i =0 ; i<nodeIdsToRegraft.size() ; i++) {
@@ -666,6 +775,8 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
         tree = 0;
       }
       tree = currentTree->clone();
+      Profiler::count(PROFILE_TREE_CLONE);
+      Profiler::count(PROFILE_SPECIES_SPR_TRIED);
 
       makeSPR(*tree, nodeForSPR, nodeIdsToRegraft[i]);
 		if (!fixedOutgroupSpecies_ || (fixedOutgroupSpecies_ && isTreeRootedWithOutgroup (*tree, outgroupSpecies_) ) )
@@ -720,6 +831,7 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
       if (logL+0.01<bestlogL) {
         betterTree = true;
         bestlogL =logL;
+        Profiler::count(PROFILE_SPECIES_SPR_ACCEPTED);
           if (bestTree) {
               delete bestTree;
               bestTree=0;
@@ -741,8 +853,8 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
           }
         bestIndex = index;
 
-       std::cout << "SPRs: Better candidate tree likelihood : "<<bestlogL<< std::endl;
-       std::cout << TreeTemplateTools::treeToParenthesis(*bestTree, true)<< std::endl;
+       INFO_LOG("SPRs: Better candidate tree likelihood : "<<bestlogL);
+       DEBUG_LOG(TreeTemplateTools::treeToParenthesis(*bestTree, true));
 		  /*
 		  //TEMP PRINTING
 		  //For loss rates
@@ -791,10 +903,11 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
      // deleteTreeProperties(*currentTree);
       if (currentTree) delete currentTree;
       currentTree = bestTree->clone();
+      improvedInPass = true;
 
 //      breadthFirstreNumber (*currentTree, duplicationExpectedNumbers, lossExpectedNumbers); //TEST
-     std::cout <<"SPRs: Improvement! : "<<numIterationsWithoutImprovement<< std::endl;
-     std::cout << "\t\tServer: SPRs: new total Likelihood value "<<logL<< std::endl;
+     INFO_LOG("SPRs: Improvement! : "<<numIterationsWithoutImprovement);
+     INFO_LOG("\t\tServer: SPRs: new total Likelihood value "<<logL);
 
       if (ApplicationTools::getTime() < timeLimit)
         {
@@ -811,7 +924,7 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
         //COMPUTATION IN CLIENTS
         index++;
         bestIndex = index;
-        std::cout <<"\t\tNumber of species trees tried : "<<index<< std::endl;
+        INFO_LOG("\t\tNumber of species trees tried : "<<index);
             gathersInformationFromClients (world,
                                            server,
                                            server,
@@ -826,6 +939,12 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
                                            num22Lineages,
                                            reconciliationModel);
 			ApplicationTools::displayTime("Execution time so far:");
+        //Node ids and conflicts have changed with the new tree
+        if (sprConflictOrdering) {
+          computeSPROrder(*currentTree, sprConflictOrdering, reconciliationModel,
+                          num0Lineages, num1Lineages, num2Lineages, num12Lineages, num22Lineages, sprOrder);
+          orderRecomputed = true;
+        }
         }
       else
         {
@@ -854,7 +973,7 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world, TreeTemplate<Node> *
         if (currentTree) delete currentTree;
         currentTree = bestTree->clone();
         numIterationsWithoutImprovement++;
-        std::cout <<"SPRs: Number of iterations without improvement : "<<numIterationsWithoutImprovement<< std::endl;
+        INFO_LOG("SPRs: Number of iterations without improvement : "<<numIterationsWithoutImprovement);
     }
     if (tree) {
       delete tree;
@@ -912,7 +1031,9 @@ void fastTryAllPossibleSPRsAndReRootings(const mpi::communicator& world,
                                          bool optimizeRates,
                                          unsigned int currentStep,
 										 const bool fixedOutgroupSpecies_,
-										 const std::vector < std::string > outgroupSpecies_) {
+										 const std::vector < std::string > outgroupSpecies_,
+                                         const bool sprConflictOrdering,
+                                         const double sprCutoffFraction) {
   if (optimizeRates)
     {
     std::cout <<"Making SPRs and Rerootings and optimizing duplication and loss rates."<< std::endl;
@@ -938,7 +1059,8 @@ void fastTryAllPossibleSPRsAndReRootings(const mpi::communicator& world,
                            rearrange, numIterationsWithoutImprovement,
                            server, branchExpectedNumbersOptimization, genomeMissing,
                            sprLimit, optimizeRates, currentStep,
-						   fixedOutgroupSpecies_, outgroupSpecies_);
+						   fixedOutgroupSpecies_, outgroupSpecies_,
+                           sprConflictOrdering, sprCutoffFraction);
 
     if (ApplicationTools::getTime() >= timeLimit)
       {
@@ -1169,12 +1291,18 @@ void computeSpeciesTreeLikelihoodWhileOptimizingDuplicationAndLossRates(const mp
 		//   std::cout << "Species tree LogLikelihood after the first round: "<< - logL<<std::endl;
 		//Then we update duplication and loss rates based on the results of this first
 		//computation, until the likelihood stabilizes (roughly)
-        std::cout<<";\t\tLogLk value for the species before optimizing DL parameters: "<< - logL<<std::endl;
-        while ((i<=1)&&(currentlogL-logL>logL-bestlogL))
+        INFO_LOG(";\t\tLogLk value for the species before optimizing DL parameters: "<< - logL);
+        while ((i<=ratesMaxRounds)&&(currentlogL-logL>logL-bestlogL))
             //      while (logL - bestlogL > 0.1)
         {
             currentlogL = logL;
             i++;
+            //Rates and counts of the last round, in case the clients are not queried again
+            std::vector<double> previousRates = (reconciliationModel == "COAL") ? coalBls : duplicationExpectedNumbers;
+            std::vector<double> previousLossRates = lossExpectedNumbers;
+            std::vector<int> counts0 = num0Lineages;
+            std::vector<int> counts1 = num1Lineages;
+            std::vector<int> counts2 = num2Lineages;
             if (reconciliationModel == "DL") {
 				computeDuplicationAndLossRatesForTheSpeciesTree (branchExpectedNumbersOptimization,
 																 num0Lineages, num1Lineages,
@@ -1197,6 +1325,29 @@ void computeSpeciesTreeLikelihoodWhileOptimizingDuplicationAndLossRates(const mp
 									coalBls) ;
 				}
             }
+            if (ratesRequeryThreshold > 0.0)
+            {
+                double change = (reconciliationModel == "COAL") ? computeMaxRelativeChange(previousRates, coalBls) :
+                    std::max(computeMaxRelativeChange(previousRates, duplicationExpectedNumbers),
+                             computeMaxRelativeChange(previousLossRates, lossExpectedNumbers));
+                if (change < ratesRequeryThreshold)
+                {
+                    //logL was computed with the previous rates: they are kept with it, so that
+                    //callers store and compare a likelihood with the rates it was computed with.
+                    //The counts were corrected in place for coverage: we keep those of the clients.
+                    if (reconciliationModel == "COAL")
+                        coalBls = previousRates;
+                    else {
+                        duplicationExpectedNumbers = previousRates;
+                        lossExpectedNumbers = previousLossRates;
+                    }
+                    num0Lineages = counts0;
+                    num1Lineages = counts1;
+                    num2Lineages = counts2;
+                    DEBUG_LOG("Rates changed by at most "<< change <<": clients are not queried again.");
+                    break;
+                }
+            }
             computeSpeciesTreeLikelihoodWithGivenStringSpeciesTree(world,index,
                                                                    stop, logL,
                                                                    num0Lineages,
@@ -1214,7 +1365,7 @@ void computeSpeciesTreeLikelihoodWhileOptimizingDuplicationAndLossRates(const mp
                                                                    genomeMissing, tree,
                                                                    currentSpeciesTree, false, currentStep);
         }
-        std::cout<<";\t\tLogLk value for the species after optimizing DL parameters: "<< - logL<<std::endl;
+        INFO_LOG(";\t\tLogLk value for the species after optimizing DL parameters: "<< - logL);
     }
 	ApplicationTools::displayTime("Execution time so far:");
 
@@ -1237,8 +1388,10 @@ void broadcastsAllInformation(const mpi::communicator& world, unsigned int serve
                               unsigned int &currentStep,
                               std::string &reconciliationModel) {
   //  MPI_Barrier(world);
-
-    broadcast(world, stop, server);
+    {
+        ScopedTimer timer(PROFILE_MPI_BROADCAST);
+        broadcast(world, stop, server);
+    }
 
     broadcastsAllInformationButStop(world,server, rearrange,
                                     lossExpectedNumbers,
@@ -1255,20 +1408,23 @@ void broadcastsAllInformationButStop(const mpi::communicator& world, unsigned in
                                      std::string &currentSpeciesTree,
                                      unsigned int &currentStep,
                                      std::string &reconciliationModel) {
-
-    broadcast(world, rearrange, server);
-    if (reconciliationModel == "DL")
-    {
-        broadcast(world, lossExpectedNumbers, server);
-        broadcast(world, duplicationExpectedNumbers, server);
-    }
-    else if (reconciliationModel == "COAL")
     {
-        broadcast(world, coalBls, server);
-    }
+        ScopedTimer timer(PROFILE_MPI_BROADCAST);
+        broadcast(world, rearrange, server);
+        if (reconciliationModel == "DL")
+        {
+            broadcast(world, lossExpectedNumbers, server);
+            broadcast(world, duplicationExpectedNumbers, server);
+        }
+        else if (reconciliationModel == "COAL")
+        {
+            broadcast(world, coalBls, server);
+        }
 
-    broadcast(world, currentSpeciesTree, server);
-    broadcast(world, currentStep, server);
+        broadcast(world, currentSpeciesTree, server);
+        broadcast(world, currentStep, server);
+    }
+    Profiler::stepCheckpoint(currentStep);
  /*  double t = MPI_Wtime();
     broadcast(world, t, server);
     std::cout << "broadcastsAllInformationButStop: " << currentStep<<" "<< setprecision(30)<< t <<std::endl;
@@ -1358,20 +1514,20 @@ void secondCommunicationsServerClient (const mpi::communicator & world ,
 
 /******************************************************************************/
 // This function runs the communication between the server and the clients for building a MRP species tree.
-// The clients send back gene trees with one gene per species,
+// The clients send back the split-frequency tables of their gene trees with one gene per species,
 // and the server can then build the MRP species tree.
 /******************************************************************************/
 void mrpCommunicationsServerClient (const mpi::communicator & world,
                                unsigned int & server,
                                unsigned int & whoami,
-                               string & trees1PerSpecies,
-                               std::vector<string> & allTrees1PerSpecies) {
+                               std::vector<unsigned long> & splitFrequencies,
+                               std::vector< std::vector<unsigned long> > & allSplitFrequencies) {
 //    MPI_Barrier(world);
 
     if (whoami == server)
-        gather(world, trees1PerSpecies, allTrees1PerSpecies, server);
+        gather(world, splitFrequencies, allSplitFrequencies, server);
     else {
-        gather(world, trees1PerSpecies, server);
+        gather(world, splitFrequencies, server);
     }
   //  MPI_Barrier(world);
     return;
@@ -1498,6 +1654,9 @@ void gathersInformationFromClients (const mpi::communicator & world,
                                     std::string &reconciliationModel)
 {
   //  MPI_Barrier(world);
+    //Buffered log lines are written once per round, outside of the reduce timing
+    Logger::flush();
+    ScopedTimer timer(PROFILE_MPI_REDUCE);
 
     if (whoami == server) {
         //AFTER COMPUTATION IN CLIENTS
@@ -1579,6 +1738,70 @@ void gathersInformationFromClients (const mpi::communicator & world,
 }
 
 
+/************************************************************************
+ * Sends the next batch of species trees of the aLRT stage to the clients.
+ * An empty batch tells the clients that the stage is over.
+ ************************************************************************/
+bool broadcastsALRTBatch (const mpi::communicator & world,
+                          unsigned int & server,
+                          std::vector<std::string> & trees)
+{
+    ScopedTimer timer(PROFILE_MPI_BROADCAST);
+    broadcast(world, trees, server);
+    return (!trees.empty());
+}
+
+
+/************************************************************************
+ * Sums the likelihoods of a batch of species trees over all clients.
+ * logLs must have the size of the batch in all processes.
+ ************************************************************************/
+void gathersALRTBatchLikelihoods (const mpi::communicator & world,
+                                  unsigned int & server,
+                                  unsigned int & whoami,
+                                  std::vector<double> & logLs)
+{
+    Logger::flush();
+    ScopedTimer timer(PROFILE_MPI_REDUCE);
+    if (logLs.empty())
+        return;
+    if (whoami == server) {
+        std::vector<double> tempLogLs (logLs.size(), 0.0);
+        mpi::reduce(world, &tempLogLs.front(), tempLogLs.size(), &logLs.front(), std::plus<double>(), server);
+    }
+    else {
+        mpi::reduce(world, &logLs.front(), logLs.size(), std::plus<double>(), server);
+    }
+    return ;
+}
+
+
+/************************************************************************
+ * At the end of the run, gathers the measured cost of each gene family
+ * at the server. costs has three values per family: seconds (setup and
+ * all rounds), resident bytes and loaded bytes.
+ * On the server, allFamilies[i] and allCosts[i] are those of process i.
+ ************************************************************************/
+void gathersFamilyCostsFromClients (const mpi::communicator & world,
+                                    unsigned int & server,
+                                    unsigned int & whoami,
+                                    std::vector<std::string> & families,
+                                    std::vector<double> & costs,
+                                    std::vector< std::vector<std::string> > & allFamilies,
+                                    std::vector< std::vector<double> > & allCosts)
+{
+    if (whoami == server) {
+        gather(world, families, allFamilies, server);
+        gather(world, costs, allCosts, server);
+    }
+    else {
+        gather(world, families, server);
+        gather(world, costs, server);
+    }
+    return ;
+}
+
+
 /******************************************************************************/
 // These functions input and output alternate topologies likelihoods.
 /******************************************************************************/
@@ -58,6 +58,7 @@ knowledge of the CeCILL license and that you accept its terms.
 //From the BOOST library !!
 #include <boost/mpi.hpp>
 #include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
 #include <boost/mpi/communicator.hpp>
 
 namespace mpi = boost::mpi;
@@ -199,7 +200,9 @@ void fastTryAllPossibleSPRs(const mpi::communicator& world,
                             int sprLimit, 
                             bool optimizeRates, unsigned int currentStep, 
 							const bool fixedOutgroupSpecies_, 
-							const std::vector < std::string > outgroupSpecies_);
+							const std::vector < std::string > outgroupSpecies_,
+                            const bool sprConflictOrdering,
+                            const double sprCutoffFraction);
 void fastTryAllPossibleSPRsAndReRootings(const mpi::communicator& world, 
                                          TreeTemplate<Node> *& currentTree, 
                                          TreeTemplate<Node> *& bestTree, 
@@ -234,7 +237,9 @@ void fastTryAllPossibleSPRsAndReRootings(const mpi::communicator& world,
                                          int sprLimit, 
                                          bool optimizeRates, unsigned int currentStep, 
 										 const bool fixedOutgroupSpecies_, 
-										 const std::vector < std::string > outgroupSpecies_);
+										 const std::vector < std::string > outgroupSpecies_,
+                                         const bool sprConflictOrdering,
+                                         const double sprCutoffFraction);
 void broadcastsAllInformation(const mpi::communicator& world, 
                               unsigned int server, bool stop, bool &rearrange, 
                               std::vector<double> &lossExpectedNumbers, 
@@ -348,14 +353,14 @@ void secondCommunicationsServerClient (const mpi::communicator & world ,
                                        std::string & currentSpeciesTree);
 /******************************************************************************/
 // This function runs the communication between the server and the clients for building a MRP species tree.
-// The clients send back gene trees with one gene per species, 
-// and the server can then build the MRP species tree.
+// The clients send back the split-frequency tables of their gene trees with one gene per species,
+// as flattened by encodeSplitFrequencies, and the server can then build the MRP species tree.
 /******************************************************************************/
 void mrpCommunicationsServerClient (const mpi::communicator & world, 
                                     unsigned int & server, 
                                     unsigned int & whoami, 
-                                    string & trees1PerSpecies, 
-                                    std::vector<string> & allTrees1PerSpecies);
+                                    std::vector<unsigned long> & splitFrequencies, 
+                                    std::vector< std::vector<unsigned long> > & allSplitFrequencies);
 /******************************************************************************/
 // This function runs the communication between the server and the clients for counting gene families after filtering.
 /******************************************************************************/
@@ -370,6 +375,11 @@ void lastCommunicationsServerClient (const mpi::communicator & world,
                                      unsigned int & server, 
                                      bool & stop, 
                                      unsigned int & bestIndex);
+/************************************************************************
+ * Reads rates.requery.threshold and rates.max.rounds, which decide when
+ * the clients are queried again after the server updates the rates.
+ ************************************************************************/
+void initializeRateRefinement(std::map<std::string, std::string> & params);
 /************************************************************************
  * Gathers information from clients. 
  ************************************************************************/
@@ -386,6 +396,20 @@ void gathersInformationFromClients (const mpi::communicator & world,
                                     std::vector<unsigned int> &num12Lineages,
                                     std::vector<unsigned int> &num22Lineages, 
                                     std::string &reconciliationModel );
+bool broadcastsALRTBatch (const mpi::communicator & world,
+                          unsigned int & server,
+                          std::vector<std::string> & trees);
+void gathersALRTBatchLikelihoods (const mpi::communicator & world,
+                                  unsigned int & server,
+                                  unsigned int & whoami,
+                                  std::vector<double> & logLs);
+void gathersFamilyCostsFromClients (const mpi::communicator & world,
+                                    unsigned int & server,
+                                    unsigned int & whoami,
+                                    std::vector<std::string> & families,
+                                    std::vector<double> & costs,
+                                    std::vector< std::vector<std::string> > & allFamilies,
+                                    std::vector< std::vector<double> > & allCosts);
 void inputNNIAndRootLks(std::vector <double> & NNILks, 
                         std::vector <double> & rootLks, 
                         std::map<std::string, std::string> & params, 
@@ -42,6 +42,7 @@
 #include "Constants.h"
 #include "SpeciesTreeLikelihood.h"
 #include "SpeciesTreeExploration.h"
+#include "Profiler.h"
 
 using namespace bpp;
 
@@ -176,6 +177,10 @@ void SpeciesTreeLikelihood::initialize()
                     num22Lineages_,
                     coalBls_) ;
   }
+  else if (reconciliationModel_ == "DTL") {
+    //DTL rates are fixed options of the clients.
+    breadthFirstreNumber (*tree_);
+  }
   //We write the starting species tree to a file
   std::string file = ApplicationTools::getStringParameter("starting.tree.file", params_, "starting.tree");
   bestTree_ = tree_->clone();
@@ -209,6 +214,15 @@ void SpeciesTreeLikelihood::initialize()
 
 
 
+  computeStartingLikelihood();
+  return;
+}
+
+
+/*******************************************************************************/
+void SpeciesTreeLikelihood::computeStartingLikelihood()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
   /****************************************************************************
    * First species tree likelihood computation.
    *****************************************************************************/
@@ -425,6 +439,13 @@ void SpeciesTreeLikelihood::parseOptions()
    *****************************************************************************/
   optimizeSpeciesTreeTopology_ = ApplicationTools::getBooleanParameter("optimization.topology", params_, false, "", true, false);
   branchExpectedNumbersOptimization_ = ApplicationTools::getStringParameter("branch.expected.numbers.optimization",params_,"average");
+  if (reconciliationModel_ == "DTL" && branchExpectedNumbersOptimization_ != "no")
+  {
+    //DTL rates are fixed options of the clients (dtl.*.rate): the species tree is searched with these rates.
+    std::cout << "DTL rates are not estimated: branch.expected.numbers.optimization is set to 'no'."<<std::endl;
+    branchExpectedNumbersOptimization_ = "no";
+  }
+  initializeRateRefinement(params_);
   std::cout << "Optimization of the branch-wise expected numbers of duplications and losses: "<<branchExpectedNumbersOptimization_ <<std::endl;
   if ((branchExpectedNumbersOptimization_!="average")&&(branchExpectedNumbersOptimization_!="branchwise")&&
     (branchExpectedNumbersOptimization_!="average_then_branchwise")&&(branchExpectedNumbersOptimization_!="no"))
@@ -436,6 +457,45 @@ void SpeciesTreeLikelihood::parseOptions()
   //When doing a spr, how far from the original position can we regraft the pruned subtree?
   //Hordjik and Gascuel (2005) consider 10% of the total number of hedges is already large.
   sprLimit_=ApplicationTools::getIntParameter("spr.limit",params_,4);
+  //SPRs can first prune the subtrees whose branches have the most duplications and losses
+  //(or deep coalescences), and stop once a fraction of them has been tried without improvement.
+  sprConflictOrdering_ = ApplicationTools::getBooleanParameter("spr.conflict.ordering", params_, false, "", true, false);
+  sprCutoffFraction_ = ApplicationTools::getDoubleParameter("spr.cutoff.fraction", params_, 1.0, "", true, false);
+  if (sprCutoffFraction_ <= 0.0 || sprCutoffFraction_ > 1.0)
+  {
+    std::cout << "spr.cutoff.fraction should be in ]0, 1]."<<std::endl;
+    MPI::COMM_WORLD.Abort(1);
+    exit(-1);
+  }
+
+  /****************************************************************************
+   * Several species tree searches can be run one after the other,
+   * sharing the gene families loaded by the clients.
+   *****************************************************************************/
+  int numberOfStarts = ApplicationTools::getIntParameter("multistart.number", params_, 1, "", true, false);
+  numberOfStarts_ = numberOfStarts > 1 ? (unsigned int)numberOfStarts : 1;
+  if (numberOfStarts_ > 1)
+  {
+    startSpeciesTreeFiles_ = ApplicationTools::getVectorParameter<std::string>("multistart.species.tree.files", params_, ',', "", "", true, false);
+    std::cout << "Number of species tree searches: "<<numberOfStarts_ <<std::endl;
+  }
+
+  /****************************************************************************
+   * alrtComputation_ sets how the aLRT supports of the species tree branches are obtained:
+   * "nni": from the alternative topologies met during the NNI phase of the search.
+   * "batch": from a dedicated stage run at the end, which evaluates both NNI
+   * alternatives of all internal branches of the final species tree in batched rounds.
+   * "no": no aLRT.
+   *****************************************************************************/
+  alrtComputation_ = ApplicationTools::getStringParameter("compute.alrt", params_, "nni", "", true, false);
+  if ((alrtComputation_!="nni")&&(alrtComputation_!="batch")&&(alrtComputation_!="no"))
+  {
+    std::cout << "compute.alrt is not properly set; please set to either 'nni', 'batch', or 'no'. "<<std::endl;
+    MPI::COMM_WORLD.Abort(1);
+    exit(-1);
+  }
+  int alrtBatchSize = ApplicationTools::getIntParameter("alrt.batch.size", params_, 0, "", true, false);
+  alrtBatchSize_ = alrtBatchSize > 0 ? (unsigned int)alrtBatchSize : 0;
 
 
   /****************************************************************************
@@ -553,6 +613,7 @@ void SpeciesTreeLikelihood::parseOptions()
    *   optionFile2:size2
    *   optionFile3:size3
    *   ...
+   *   //Finally, genelist.file can be a manifest describing all families (see FamilyManifest.h).
    *****************************************************************************/
   std::string listGeneFile = ApplicationTools::getStringParameter("genelist.file",params_,"none");
   if (listGeneFile=="none" )
@@ -565,14 +626,33 @@ void SpeciesTreeLikelihood::parseOptions()
 
   //Addresses to these option files are expected to be absolute:
   //may be improved, for instance through the use of global variables, as in other files.
-  std::ifstream inListOpt (listGeneFile.c_str());
-  std::string line;
   std::vector<std::string> listOptions;
-  while(getline(inListOpt,line))
+  if (FamilyManifest::isManifest(listGeneFile))
   {
-    listOptions.push_back(line);
+    //All families are described in a single manifest file: we only send its record offsets to the clients.
+    try {
+      FamilyManifest manifest(listGeneFile);
+      listOptions = manifest.buildIndex();
+    }
+    catch (exception& e)
+    {
+      std::cerr << "Error: could not read the gene family manifest "<< listGeneFile <<": "<< e.what() << std::endl;
+      fflush(0);
+      MPI::COMM_WORLD.Abort(1);
+      exit(-1);
+    }
+  }
+  else
+  {
+    std::ifstream inListOpt (listGeneFile.c_str());
+    std::string line;
+    while(getline(inListOpt,line))
+    {
+      listOptions.push_back(line);
+    }
   }
   cleanVectorOfOptions(listOptions, true);
+  applyFamilyCostProfile(listOptions);
   std::cout <<"Using "<<listOptions.size()<<" gene families."<<std::endl;
   std::cout <<"Using " <<size_<<" nodes"<<std::endl;
   if (listOptions.size()==0)
@@ -588,13 +668,163 @@ void SpeciesTreeLikelihood::parseOptions()
     exit(-1);
   }
   //We compute and send the number of genes per client.
-  generateListOfOptionsPerClient(listOptions, size_, listOfOptionsPerClient_, numbersOfGenesPerClient_);
+  //Memory budget of the clients, in MB
+  double memoryBudget = ApplicationTools::getDoubleParameter("client.memory.budget", params_, 0.0, "", true, false) * 1024.0 * 1024.0;
+  generateListOfOptionsPerClient(listOptions, size_, listOfOptionsPerClient_, numbersOfGenesPerClient_, predictedLoadsPerClient_, memoryBudget);
 
   suffix_ = ApplicationTools::getStringParameter("output.file.suffix", params_, "", "", false, false);
   return;
 }
 
 
+/*******************************************************************************/
+// Replaces the weights of the gene families by the costs measured in a previous
+// run (family.cost.file, as written to output.family.cost.file), and adds their
+// resident and loaded memory if the file has them.
+// Families absent from the file, e.g. new ones, get the average cost (and memory)
+// per unit of weight of the others, or their average cost if there is no weight.
+/*******************************************************************************/
+void SpeciesTreeLikelihood::applyFamilyCostProfile(std::vector<std::string> & listOptions)
+{
+  std::string costFile = ApplicationTools::getStringParameter("family.cost.file", params_, "none", "", true, false);
+  if (costFile == "none" || listOptions.empty())
+    return;
+  if (!FileTools::fileExists(costFile))
+  {
+    std::cout << "Error: family cost file "<< costFile <<" not found."<<std::endl;
+    MPI::COMM_WORLD.Abort(1);
+    exit(-1);
+  }
+  std::map<std::string, double> costs;
+  std::map<std::string, std::pair<double, double> > memories;
+  std::ifstream in (costFile.c_str());
+  std::string line;
+  while (getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    StringTokenizer st (line, "\t");
+    if (st.numberOfRemainingTokens() < 2)
+      continue;
+    std::string family = TextTools::removeWhiteSpaces(st.nextToken());
+    costs[family] = TextTools::toDouble(st.nextToken());
+    if (st.numberOfRemainingTokens() >= 2)
+    {
+      double resident = TextTools::toDouble(st.nextToken());
+      memories[family] = std::pair<double, double> (resident, TextTools::toDouble(st.nextToken()));
+    }
+  }
+  in.close();
+
+  bool weighted = TextTools::hasSubstring(listOptions[0], ":");
+  std::vector<std::string> entries (listOptions.size());
+  std::vector<double> weights (listOptions.size(), 1.0);
+  std::vector<bool> measured (listOptions.size(), false);
+  std::vector<double> measuredCosts (listOptions.size(), 0.0);
+  std::vector< std::pair<double, double> > measuredMemories (listOptions.size(), std::pair<double, double> (-1.0, -1.0));
+  double knownCost = 0.0;
+  double knownWeight = 0.0;
+  unsigned int known = 0;
+  std::pair<double, double> knownMemory (0.0, 0.0);
+  double knownMemoryWeight = 0.0;
+  for (unsigned int i = 0 ; i < listOptions.size() ; i++)
+  {
+    StringTokenizer st (listOptions[i], ":", true);
+    entries[i] = st.getToken(0);
+    if (weighted)
+      weights[i] = TextTools::toDouble(st.getToken(1));
+    std::string family = entries[i];
+    //Manifest entries are name@offset
+    if (FamilyManifest::isManifestEntry(family))
+      family = family.substr(0, family.rfind('@'));
+    std::map<std::string, double>::const_iterator it = costs.find(family);
+    if (it != costs.end())
+    {
+      measured[i] = true;
+      measuredCosts[i] = it->second;
+      knownCost += it->second;
+      knownWeight += weights[i];
+      known++;
+    }
+    std::map<std::string, std::pair<double, double> >::const_iterator memory = memories.find(family);
+    if (memory != memories.end())
+    {
+      measuredMemories[i] = memory->second;
+      knownMemory.first += memory->second.first;
+      knownMemory.second += memory->second.second;
+      knownMemoryWeight += weights[i];
+    }
+  }
+  if (known == 0)
+  {
+    std::cout <<"WARNING: none of the gene families is in "<< costFile <<"; the weights of genelist.file are used."<<std::endl;
+    return;
+  }
+  double costPerWeight = (knownWeight > 0.0) ? knownCost / knownWeight : knownCost / known;
+  for (unsigned int i = 0 ; i < listOptions.size() ; i++)
+  {
+    double cost = measured[i] ? measuredCosts[i] : costPerWeight * weights[i];
+    listOptions[i] = entries[i] + ":" + TextTools::toString(cost, 12);
+    if (knownMemoryWeight > 0.0)
+    {
+      std::pair<double, double> memory = measuredMemories[i];
+      if (memory.first < 0.0)
+        memory = std::pair<double, double> (knownMemory.first * weights[i] / knownMemoryWeight, knownMemory.second * weights[i] / knownMemoryWeight);
+      listOptions[i] = listOptions[i] + ":" + TextTools::toString(memory.first, 12) + ":" + TextTools::toString(memory.second, 12);
+    }
+  }
+  std::cout <<"Using the costs measured in "<< costFile <<" for "<< known <<" of "<< listOptions.size() <<" gene families."<<std::endl;
+  return;
+}
+
+
+/*******************************************************************************/
+// Gathers the measured cost and memory of each family at the end of the run,
+// writes them to output.family.cost.file for the next runs, and compares the
+// predicted and realized shares of the load of each client.
+/*******************************************************************************/
+void SpeciesTreeLikelihood::reportFamilyCosts()
+{
+  std::vector<std::string> families;
+  std::vector<double> costs;
+  std::vector< std::vector<std::string> > allFamilies;
+  std::vector< std::vector<double> > allCosts;
+  gathersFamilyCostsFromClients(world_, server_, server_, families, costs, allFamilies, allCosts);
+
+  std::string file = ApplicationTools::getStringParameter("output.family.cost.file", params_, "FamilyCosts.txt", "", false, false);
+  file = file + suffix_;
+  std::ofstream out (file.c_str(), std::ios::out);
+  out << "#Family\tSeconds\tResidentBytes\tLoadedBytes"<<std::endl;
+  std::vector<double> realizedLoads (allCosts.size(), 0.0);
+  for (unsigned int i = 0 ; i < allCosts.size() ; i++)
+  {
+    //Three values per family: seconds, resident and loaded bytes
+    for (unsigned int j = 0 ; j < allFamilies[i].size() ; j++)
+    {
+      out << allFamilies[i][j] << "\t" << allCosts[i][3 * j] << "\t" << (unsigned long)allCosts[i][3 * j + 1] << "\t" << (unsigned long)allCosts[i][3 * j + 2] <<std::endl;
+      realizedLoads[i] += allCosts[i][3 * j];
+    }
+  }
+  out.close();
+
+  double totalPredicted = VectorTools::sum(predictedLoadsPerClient_);
+  double totalRealized = VectorTools::sum(realizedLoads);
+  if (totalPredicted <= 0.0 || totalRealized <= 0.0 || realizedLoads.size() < 2)
+    return;
+  std::cout <<"\n\t\tPredicted and realized loads of the clients (share of the total, realized time):"<<std::endl;
+  double maxRealized = 0.0;
+  for (unsigned int i = 1 ; i < realizedLoads.size() ; i++)
+  {
+    double predicted = (i < predictedLoadsPerClient_.size()) ? predictedLoadsPerClient_[i] : 0.0;
+    std::cout <<"Client of rank "<< i <<": predicted "<< 100.0 * predicted / totalPredicted <<"%, realized "
+              << 100.0 * realizedLoads[i] / totalRealized <<"% ("<< realizedLoads[i] <<" s)"<<std::endl;
+    maxRealized = std::max(maxRealized, realizedLoads[i]);
+  }
+  std::cout <<"Most loaded client / average client: "<< maxRealized * (realizedLoads.size() - 1) / totalRealized
+            <<". Family costs written to "<< file <<"."<<std::endl;
+}
+
+
 /*******************************************************************************/
 void SpeciesTreeLikelihood::MLSearch()
 {
@@ -615,11 +845,238 @@ void SpeciesTreeLikelihood::MLSearch()
   {
     MLSearchButNotOptimizeTopology();
 	  //    noMoreSPR=true;
+  }
+  //The search has gone to its end if it has not been stopped by the time limit.
+  bool finished = (currentStep_ == 5);
+  unsigned int stoppedAtStep = currentStep_;
+  if (!optimizeSpeciesTreeTopology_)
     currentStep_ = 4;
+
+  /****************************************************************************
+   * With several searches, only the results of the best one are output.
+   * We tell the clients whether this one is the best so far.
+   *****************************************************************************/
+  bool keepResults = finished;
+  for (unsigned int i = 0 ; i < startLogLs_.size() ; i++)
+  {
+    if (startFinished_[i] && startLogLs_[i] <= bestlogL_)
+      keepResults = false;
+  }
+  if (numberOfStarts_ == 1)
+    keepResults = true;
+  startLogLs_.push_back(bestlogL_);
+  startSpeciesTrees_.push_back(TreeTemplateTools::treeToParenthesis(*bestTree_, false));
+  startFinished_.push_back(finished);
+  {
+    ScopedTimer timer(PROFILE_MPI_BROADCAST);
+    broadcast(world_, keepResults, server_);
+  }
+  if (!finished)
+  {
+    /****************************************************************************
+     * Run not finished yet: the best species tree of all searches is saved
+     * for the next run.
+     *****************************************************************************/
+    std::cout <<"\n\n\t\t\tNo time to finish the run. "<<std::endl;
+    if (optimizeSpeciesTreeTopology_)
+    {
+      size_t best = 0;
+      for (size_t i = 1 ; i < startLogLs_.size() ; i++)
+      {
+        if (startLogLs_[i] < startLogLs_[best])
+          best = i;
+      }
+      std::cout <<"\t\tSaving the best species tree for the next run."<<std::endl;
+      std::string tempSpTree = ApplicationTools::getStringParameter("output.temporary.tree.file", params_, "CurrentSpeciesTree.tree", "", false, false);
+      tempSpTree = tempSpTree + suffix_;
+      std::ofstream out (tempSpTree.c_str(), std::ios::out);
+      out << startSpeciesTrees_[best] <<std::endl;
+      out.close();
+      //The tree of an earlier search is searched again from the first step.
+      unsigned int step = (best + 1 == startLogLs_.size()) ? stoppedAtStep : 0;
+      std::cout<<"\n\n\t\t\tAdd:\ninit.species.tree=user\nspecies.tree.file="<<tempSpTree<<"\ncurrent.step="<<step<<"\nto your options.\n"<<std::endl;
+    }
+  }
+  if (!keepResults)
+  {
+    if (finished)
+      std::cout << "\n\n\t\t\tThis search did not find a better species tree than the previous ones.\n\n"<< std::endl;
+    return;
+  }
+
+  if (optimizeSpeciesTreeTopology_)
+    outputNNIAndRootLks(NNILks_, rootLks_, params_, suffix_);
+
+  /****************************************************************************
+   * Run finished, outputting end results.
+   *****************************************************************************/
+  if (finished)
+  {
+    if (optimizeSpeciesTreeTopology_ && alrtComputation_ == "nni")
+      outputALRTTree(bestlogL_);
+    outputEndResults();
+  }
+  if (alrtComputation_ == "batch")
+  {
+    computeALRTsInBatches();
   }
 }
 
 
+/*******************************************************************************/
+bool SpeciesTreeLikelihood::startNextSearch()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  bool anotherSearch = ( startFinished_.back() && startLogLs_.size() < numberOfStarts_
+                         && ApplicationTools::getTime() < timeLimit_ );
+  {
+    ScopedTimer timer(PROFILE_MPI_BROADCAST);
+    broadcast(world_, anotherSearch, server_);
+  }
+  if (!anotherSearch)
+    return false;
+  unsigned int start = startLogLs_.size();
+  std::cout << "\n\n\t\t\tSpecies tree search "<< start + 1 << " out of "<< numberOfStarts_ <<".\n\n"<< std::endl;
+  setStartingSpeciesTree(start);
+
+  //Everything learnt during the previous search is forgotten.
+  stop_ = false;
+  rearrange_ = !optimizeSpeciesTreeTopology_;
+  currentStep_ = 0;
+  index_ = 0;
+  bestIndex_ = 0;
+  numIterationsWithoutImprovement_ = 0;
+  treesToLogLk_.clear();
+  for (unsigned int i = 0 ; i < NNILks_.size() ; i++)
+  {
+    NNILks_[i] = NumConstants::VERY_BIG();
+    rootLks_[i] = NumConstants::VERY_BIG();
+  }
+  resetVector(num0Lineages_);
+  resetVector(num1Lineages_);
+  resetVector(num2Lineages_);
+  resetVector(num12Lineages_);
+  resetVector(num22Lineages_);
+  if (reconciliationModel_ == "DL") {
+    for (unsigned int i = 0 ; i < lossExpectedNumbers_.size() ; i++)
+    {
+      lossExpectedNumbers_[i] = 0.1;
+      duplicationExpectedNumbers_[i] = 0.11;
+    }
+    computeDuplicationAndLossRatesForTheSpeciesTreeInitially(branchExpectedNumbersOptimization_,
+                                                             num0Lineages_,
+                                                             num1Lineages_,
+                                                             num2Lineages_,
+                                                             lossExpectedNumbers_,
+                                                             duplicationExpectedNumbers_,
+                                                             genomeMissing_,
+                                                             *tree_);
+    backupDuplicationExpectedNumbers_ = duplicationExpectedNumbers_;
+    backupLossExpectedNumbers_ = lossExpectedNumbers_;
+  }
+  else if (reconciliationModel_ == "COAL") {
+    for (unsigned int i = 0 ; i < coalBls_.size() ; i++)
+    {
+      coalBls_[i] = 1.0;
+    }
+    std::string temp = "no";
+    computeCoalBls (temp,
+                    num12Lineages_,
+                    num22Lineages_,
+                    coalBls_) ;
+  }
+  if (bestTree_) delete bestTree_;
+  if (currentTree_) delete currentTree_;
+  bestTree_ = tree_->clone();
+  currentTree_ = tree_->clone();
+  currentSpeciesTree_ = TreeTemplateTools::treeToParenthesis(*tree_, true);
+  ApplicationTools::displayMessage("Starting Species Tree: ");
+  std::cout << currentSpeciesTree_ <<std::endl;
+
+  computeStartingLikelihood();
+  return true;
+}
+
+
+/*******************************************************************************/
+void SpeciesTreeLikelihood::setStartingSpeciesTree(unsigned int start)
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  std::vector<std::string> spNames = tree_->getLeavesNames();
+  delete tree_;
+  tree_ = 0;
+  //The first search starts from init.species.tree, the next ones
+  //from multistart.species.tree.files, and then from random trees.
+  if (start - 1 < startSpeciesTreeFiles_.size())
+  {
+    ApplicationTools::displayResult("Species Tree file", startSpeciesTreeFiles_[start - 1]);
+    Newick newick(true);
+    tree_ = dynamic_cast < TreeTemplate < Node > * > (newick.read(startSpeciesTreeFiles_[start - 1]));
+    std::vector <std::string> allSpNames = tree_->getLeavesNames();
+    std::vector <std::string> spToDrop;
+    VectorTools::diff(allSpNames, spNames, spToDrop);
+    dropLeaves(*tree_, spToDrop);
+    if (tree_->getNumberOfLeaves() != spNames.size())
+      throw Exception("SpeciesTreeLikelihood::setStartingSpeciesTree. The species tree in " + startSpeciesTreeFiles_[start - 1] + " does not contain all species of the first starting tree.");
+    if (!tree_->isRooted())
+    {
+      std::cout << "The tree is not rooted, midpoint-rooting it!\n";
+      TreeTemplateTools::midRoot(*tree_, TreeTemplateTools::MIDROOT_SUM_OF_SQUARES, true);
+    }
+  }
+  else
+  {
+    tree_ = TreeTemplateTools::getRandomTree(spNames);
+    tree_->setBranchLengths(1.0);
+    TreeTemplateTools::midRoot(*tree_, TreeTemplateTools::MIDROOT_SUM_OF_SQUARES, true);
+  }
+  if (fixedOutgroupSpecies_) {
+    bool wellRooted = false;
+    while (! wellRooted) {
+      wellRooted = true;
+      try  {
+        rootTreeWithOutgroup (*tree_, outgroupSpecies_);
+      }
+      catch (TreeException e) {
+        if (start - 1 < startSpeciesTreeFiles_.size())
+          throw Exception("SpeciesTreeLikelihood::setStartingSpeciesTree. The species tree in " + startSpeciesTreeFiles_[start - 1] + " cannot be rooted by the given list of outgroup species.");
+        std::cout << "Random tree is not well rooted, re-drawing the tree." << std::endl;
+        wellRooted = false;
+        delete tree_;
+        tree_ = TreeTemplateTools::getRandomTree(spNames);
+      }
+    }
+  }
+  breadthFirstreNumber (*tree_);
+  assignArbitraryBranchLengths(*tree_);
+}
+
+
+/*******************************************************************************/
+void SpeciesTreeLikelihood::outputStartResults()
+{
+  WHEREAMI( __FILE__ , __LINE__ );
+  if (numberOfStarts_ == 1)
+    return;
+  std::string file = ApplicationTools::getStringParameter("output.multistart.file", params_, "MultiStart.results", "", false, false);
+  file = file + suffix_;
+  std::ofstream out (file.c_str(), std::ios::out);
+  out << "Search\tLogLk\tFinished\tSpecies tree"<<std::endl;
+  std::cout <<"\n\n\t\tResults of the "<< startLogLs_.size() <<" species tree searches: "<<std::endl;
+  size_t best = 0;
+  for (unsigned int i = 0 ; i < startLogLs_.size() ; i++)
+  {
+    if (startFinished_[i] && (!startFinished_[best] || startLogLs_[i] < startLogLs_[best]))
+      best = i;
+    out << i + 1 << "\t" << TextTools::toString(- startLogLs_[i], 15) << "\t" << (startFinished_[i] ? "yes" : "no") << "\t" << startSpeciesTrees_[i] <<std::endl;
+    std::cout << "Search "<< i + 1 << ": logLk "<< - startLogLs_[i] << (startFinished_[i] ? "" : " (not finished)") <<std::endl;
+    std::cout << startSpeciesTrees_[i] <<std::endl;
+  }
+  out.close();
+  std::cout <<"\n\t\tBest species tree found by search "<< best + 1 <<"; its results have been output."<<std::endl;
+}
+
+
 
 /*******************************************************************************/
 void SpeciesTreeLikelihood::MLSearchAndOptimizeTopology()
@@ -667,7 +1124,8 @@ void SpeciesTreeLikelihood::MLSearchAndOptimizeTopology()
                                           rearrange_, numIterationsWithoutImprovement_,
                                           server_, branchExpectedNumbersOptimization_,
                                           genomeMissing_, sprLimit_, false, currentStep_,
-                                          fixedOutgroupSpecies_, outgroupSpecies_);
+                                          fixedOutgroupSpecies_, outgroupSpecies_,
+                                          sprConflictOrdering_, sprCutoffFraction_);
 
 
       if (ApplicationTools::getTime() < timeLimit_)
@@ -767,7 +1225,8 @@ void SpeciesTreeLikelihood::MLSearchAndOptimizeTopology()
                                           rearrange_, numIterationsWithoutImprovement_,
                                           server_, branchExpectedNumbersOptimization_,
                                           genomeMissing_, sprLimit_, true, currentStep_,
-                                          fixedOutgroupSpecies_, outgroupSpecies_);
+                                          fixedOutgroupSpecies_, outgroupSpecies_,
+                                          sprConflictOrdering_, sprCutoffFraction_);
 
 
       if (ApplicationTools::getTime() < timeLimit_)
@@ -1025,38 +1484,8 @@ void SpeciesTreeLikelihood::MLSearchAndOptimizeTopology()
    * - it would be nice to make client option files for the next run to not recompute starting gene trees. Not for now, though.
    ****************************************************************************
    *****************************************************************************/
+  //The outputs, and the species tree saved for the next run, are written by MLSearch.
   WHEREAMI( __FILE__ , __LINE__ );
-  outputNNIAndRootLks(NNILks_, rootLks_, params_, suffix_);
-
-
-  if (ApplicationTools::getTime() >= timeLimit_)
-  {
-
-    /****************************************************************************
-     * Run not finished yet, outputting information for next run.
-     *****************************************************************************/
-    if (rearrange_)
-      broadcast(world_, rearrange_, server_);
-    std::cout <<"\n\n\t\t\tNo time to finish the run. "<<std::endl;
-    std::cout <<"\t\tSaving the current species tree for the next run."<<std::endl;
-    std::string tempSpTree = ApplicationTools::getStringParameter("output.temporary.tree.file", params_, "CurrentSpeciesTree.tree", "", false, false);
-    tempSpTree = tempSpTree + suffix_;
-    std::ofstream out (tempSpTree.c_str(), std::ios::out);
-    out << TreeTemplateTools::treeToParenthesis(*bestTree_, false)<<std::endl;
-    out.close();
-    std::cout<<"\n\n\t\t\tAdd:\ninit.species.tree=user\nspecies.tree.file="<<tempSpTree<<"\ncurrent.step="<<currentStep_<<"\nto your options.\n"<<std::endl;
-  }
-  else
-  {
-
-    /****************************************************************************
-     * Run finished, outputting end results.
-     *****************************************************************************/
-    outputALRTTree();
-
-
-    outputEndResults();
-  }
 }
 
 
@@ -1155,30 +1584,91 @@ void SpeciesTreeLikelihood::MLSearchButNotOptimizeTopology()
    ****************************************************************************
    *****************************************************************************/
 
-  if (ApplicationTools::getTime() >= timeLimit_)
-  {
+  //End results are output by MLSearch.
+}
 
-    /****************************************************************************
-     * Run not finished yet, outputting information for next run.
-     *****************************************************************************/
-    if (rearrange_)
-      broadcast(world_, rearrange_, server_);
-    std::cout <<"\n\n\t\t\tNo time to finish the run. "<<std::endl;
+
+/*******************************************************************************/
+void SpeciesTreeLikelihood::computeALRTsInBatches () {
+  WHEREAMI( __FILE__ , __LINE__ );
+  //The clients expect this stage after the end of the search; we tell them whether we have time for it.
+  bool computeALRTs = (ApplicationTools::getTime() < timeLimit_);
+  {
+    ScopedTimer timer(PROFILE_MPI_BROADCAST);
+    broadcast(world_, computeALRTs, server_);
   }
-  else
+  if (!computeALRTs)
   {
+    std::cout <<"\n\n\t\t\tNo time to compute aLRTs. "<<std::endl;
+    return;
+  }
+  std::cout << "\n\n\t\t\tComputing aLRTs of the species tree branches.\n\n"<< std::endl;
+
+  //All trees are evaluated with the expected numbers of the best species tree,
+  //and with the gene trees the clients have found for it, which are not rearranged.
+  bool rearrange = false;
+  std::string bestSpeciesTree = TreeTemplateTools::treeToParenthesis(*bestTree_, true);
+  broadcastsAllInformationButStop(world_, server_, rearrange,
+                                  lossExpectedNumbers_,
+                                  duplicationExpectedNumbers_,
+                                  coalBls_, bestSpeciesTree,
+                                  currentStep_, reconciliationModel_);
+
+  //The best tree comes first, as the reference of the likelihood ratios,
+  //followed by the two NNI alternatives of the branch above each internal node.
+  //Node ids are kept by makeNNI, so expected numbers still apply to the same branches.
+  std::vector<std::string> trees (1, bestSpeciesTree);
+  std::vector<int> branchIds (1, -1);
+  std::vector<Node*> nodes = bestTree_->getNodes();
+  for (unsigned int i = 0 ; i < nodes.size() ; i++)
+  {
+    if ( nodes[i]->isLeaf() || !nodes[i]->hasFather() )
+      continue;
+    for (unsigned int j = 0 ; j < nodes[i]->getNumberOfSons() ; j++)
+    {
+      TreeTemplate<Node> * alternative = bestTree_->clone();
+      makeNNI(*alternative, nodes[i]->getSon(j)->getId());
+      trees.push_back(TreeTemplateTools::treeToParenthesis(*alternative, true));
+      branchIds.push_back(nodes[i]->getId());
+      delete alternative;
+    }
+  }
+  std::cout << "Number of species trees to evaluate: "<< trees.size() <<std::endl;
 
-    /****************************************************************************
-     * Run finished, outputting end results.
-     *****************************************************************************/
-    outputEndResults();
+  unsigned int batchSize = (alrtBatchSize_ > 0) ? alrtBatchSize_ : trees.size();
+  std::vector<double> logLs;
+  for (unsigned int start = 0 ; start < trees.size() ; start += batchSize)
+  {
+    unsigned int end = std::min( start + batchSize, (unsigned int) trees.size() );
+    std::vector<std::string> batch (trees.begin() + start, trees.begin() + end);
+    broadcastsALRTBatch(world_, server_, batch);
+    std::vector<double> batchLogLs (batch.size(), 0.0);
+    gathersALRTBatchLikelihoods(world_, server_, rank_, batchLogLs);
+    logLs.insert(logLs.end(), batchLogLs.begin(), batchLogLs.end());
+    std::cout << "Species trees evaluated: "<< end << "/" << trees.size() <<std::endl;
+  }
+  std::vector<std::string> lastBatch;
+  broadcastsALRTBatch(world_, server_, lastBatch);
 
+  for (unsigned int i = 0 ; i < NNILks_.size() ; i++)
+  {
+    NNILks_[i] = NumConstants::VERY_BIG();
   }
+  for (unsigned int k = 1 ; k < logLs.size() ; k++)
+  {
+    INFO_LOG("aLRT stage: branch above node "<< branchIds[k] << ", NNI alternative logLk: "<< - logLs[k]);
+    if (logLs[k] < NNILks_[branchIds[k]])
+    {
+      NNILks_[branchIds[k]] = logLs[k];
+    }
+  }
+  INFO_LOG("aLRT stage: best species tree logLk with fixed gene trees: "<< - logLs[0]);
+  outputALRTTree(logLs[0]);
 }
 
 
 /*******************************************************************************/
-void SpeciesTreeLikelihood::outputALRTTree () {
+void SpeciesTreeLikelihood::outputALRTTree (double referenceLogL) {
   WHEREAMI( __FILE__ , __LINE__ );
     //COMPUTING ALRTs
     //In Anisimova and Gascuel, the relevant distribution is a mixture of chi^2_1 and chi^2_0.
@@ -1189,7 +1679,7 @@ void SpeciesTreeLikelihood::outputALRTTree () {
       if ((! bestTree_->getNode(i)->isLeaf()) && (bestTree_->getNode(i)->hasFather()))
       {
         // double proba=(1/2)*(RandomTools::pChisq(2*(NNILks_[i] - bestlogL_), 1)+1); //If one wants to use the mixture.
-        double proba=RandomTools::pChisq(2*(NNILks_[i] - bestlogL_), 1);
+        double proba=RandomTools::pChisq(2*(NNILks_[i] - referenceLogL), 1);
         //Bonferroni correction
         proba = 1-3*(1-proba);
         if (proba<0)
@@ -1197,7 +1687,7 @@ void SpeciesTreeLikelihood::outputALRTTree () {
           std::cout <<"Negative aLRT!"<<std::endl;
           proba = 0;
         }
-        //std::cout <<"Branch "<<i<<" second best Lk: "<< NNILks_[i]<< ";Lk difference: "<< NNILks_[i] - bestlogL_ <<"; aLRT: "<<proba<<std::endl;
+        //std::cout <<"Branch "<<i<<" second best Lk: "<< NNILks_[i]<< ";Lk difference: "<< NNILks_[i] - referenceLogL <<"; aLRT: "<<proba<<std::endl;
         bestTree_->getNode(i)->setBranchProperty("ALRT", Number<double>(proba));
       }
       else
@@ -1312,20 +1802,27 @@ void SpeciesTreeLikelihood::outputEndResults () {
  *******************************************************************************/
 void SpeciesTreeLikelihood::buildMRPSpeciesTree() {
   WHEREAMI( __FILE__ , __LINE__ );
-  string trees1PerSpecies;
-  std::vector < string> allTrees1PerSpecies;
-  mrpCommunicationsServerClient (world_, server_, rank_, trees1PerSpecies, allTrees1PerSpecies);
-  stringstream ss (stringstream::in | stringstream::out);
-  //we transform the vector of strings into a long string
-  for (unsigned int i = 0 ; i < allTrees1PerSpecies.size() ; i++) {
-    ss << allTrees1PerSpecies[i];
+  std::vector<unsigned long> splitFrequencies;
+  std::vector < std::vector<unsigned long> > allSplitFrequencies;
+  mrpCommunicationsServerClient (world_, server_, rank_, splitFrequencies, allSplitFrequencies);
+  //Clients index species as computeLeafIndices does on the species tree.
+  std::map<std::string, size_t> leafIndices = computeLeafIndices(*tree_);
+  std::vector<std::string> leafNames (leafIndices.size());
+  for (std::map<std::string, size_t>::const_iterator it = leafIndices.begin() ; it != leafIndices.end() ; ++it)
+    leafNames[it->second] = it->first;
+  SplitFrequencies frequencies;
+  for (unsigned int i = 0 ; i < allSplitFrequencies.size() ; i++) {
+    mergeSplitFrequencies(allSplitFrequencies[i], leafNames.size(), frequencies);
   }
-  std::vector< Tree * > trees;
-  Newick newick;
-  newick.read(ss, trees);
-  std::cout <<"Number of gene trees used for MRP construction of the initial species tree: "<< trees.size() <<std::endl;
+  //Each tree is counted once with an empty split.
+  unsigned long numberOfTrees = 0;
+  for (SplitFrequencies::const_iterator it = frequencies.begin() ; it != frequencies.end() ; ++it) {
+    if (it->first.second == Split(it->first.second.size(), 0))
+      numberOfTrees += it->second;
+  }
+  std::cout <<"Number of gene trees used for MRP construction of the initial species tree: "<< numberOfTrees <<std::endl;
   unsigned int numSpecies = TreeTemplateTools::getNumberOfLeaves(*(tree_->getRootNode() ) );
-  tree_ = dynamic_cast <TreeTemplate<Node> *> (MRP(trees) );
+  tree_ = dynamic_cast <TreeTemplate<Node> *> (MRP(frequencies, leafNames) );
 
   if (TreeTemplateTools::getNumberOfLeaves(*(tree_->getRootNode() ) ) != numSpecies) {
     std::cout <<"Error: cannot use MRP method for building starting species tree: some species are missing in the single-copy gene trees."<<std::endl;
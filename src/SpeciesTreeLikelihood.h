@@ -67,6 +67,7 @@ knowledge of the CeCILL license and that you accept its terms.
 #include "ReconciliationTools.h"
 #include "COALTools.h"
 #include "SpeciesTreeExploration.h"
+#include "FamilyManifest.h"
 //#include "GenericTreeExplorationAlgorithms.h"
 
 namespace mpi = boost::mpi;
@@ -92,6 +93,8 @@ namespace bpp
         unsigned int assignedNumberOfGenes_;
         std::vector<std::string> assignedFilenames_;
         std::vector< std::vector<std::string> > listOfOptionsPerClient_;
+        //Predicted load of each process (0 for the server), in units of the family weights
+        std::vector<double> predictedLoadsPerClient_;
         //Vectors of expected numbers of events per branch
         std::vector<double> duplicationExpectedNumbers_;
         std::vector<double> lossExpectedNumbers_;
@@ -144,6 +147,10 @@ namespace bpp
         unsigned int numIterationsWithoutImprovement_;
         //How far can we regraft subtrees when doing a spr
         int sprLimit_;
+        //If true, SPRs prune first the subtrees whose branches show most conflict with gene trees
+        bool sprConflictOrdering_;
+        //Fraction of the ordered subtrees after which a pass of SPRs stops if it has not improved the tree
+        double sprCutoffFraction_;
         //string giving the kind of optimization to perform
         std::string branchExpectedNumbersOptimization_;
         //Map giving the expected percentage of genes in genomes missing 
@@ -154,7 +161,18 @@ namespace bpp
         //vectors to keep NNI and root likelihoods, for making aLRTs.
         std::vector <double > NNILks_;
         std::vector <double > rootLks_;
+        //How aLRTs are computed: "nni" (from the search), "batch" (dedicated stage) or "no"
+        std::string alrtComputation_;
+        //Number of alternative species trees sent per message in the aLRT stage (0: all)
+        unsigned int alrtBatchSize_;
         std::map<std::string, double> treesToLogLk_;
+        //Number of species tree searches run one after the other, and their starting tree files
+        unsigned int numberOfStarts_;
+        std::vector<std::string> startSpeciesTreeFiles_;
+        //Best logLk and best species tree of each search, and whether it went to its end
+        std::vector<double> startLogLs_;
+        std::vector<std::string> startSpeciesTrees_;
+        std::vector<bool> startFinished_;
         //Time limit: the program has to stop before this limit (in hours)
         int timeLimit_;
         //When the program stops, it knows at what step of the algorithm it is
@@ -175,7 +193,7 @@ namespace bpp
         AbstractParametrizable(""), world_(world), server_(server), 
 		size_(size), rank_(0), params_(params),
 		numbersOfGenesPerClient_(0), assignedNumberOfGenes_(0),
-		assignedFilenames_(), listOfOptionsPerClient_(),
+		assignedFilenames_(), listOfOptionsPerClient_(), predictedLoadsPerClient_(),
         duplicationExpectedNumbers_(),
         lossExpectedNumbers_(), 
         backupDuplicationExpectedNumbers_(),
@@ -197,10 +215,13 @@ namespace bpp
         rearrange_(0), 
         numIterationsWithoutImprovement_(0), 
 		sprLimit_(0),
+        sprConflictOrdering_(false),
+        sprCutoffFraction_(1.0),
         branchExpectedNumbersOptimization_(""), 
         genomeMissing_(), 
         speciesTreeNodeNumber_(0), NNILks_(),
-        rootLks_(), treesToLogLk_ (), timeLimit_(0), currentStep_(0),
+        rootLks_(), alrtComputation_("nni"), alrtBatchSize_(0), treesToLogLk_ (),
+        numberOfStarts_(1), startSpeciesTreeFiles_(), startLogLs_(), startSpeciesTrees_(), startFinished_(), timeLimit_(0), currentStep_(0),
         suffix_(""), reconciliationModel_("DL")
 		{
  /*     tree_ = 0;
@@ -281,6 +302,7 @@ namespace bpp
 		size_(stl.size_), rank_(stl.rank_), params_(stl.params_),
 		numbersOfGenesPerClient_(stl.numbersOfGenesPerClient_), assignedNumberOfGenes_(stl.assignedNumberOfGenes_),
 		assignedFilenames_(stl.assignedFilenames_), listOfOptionsPerClient_(stl.listOfOptionsPerClient_),
+		predictedLoadsPerClient_(stl.predictedLoadsPerClient_),
         duplicationExpectedNumbers_(stl.duplicationExpectedNumbers_),
         lossExpectedNumbers_(stl.lossExpectedNumbers_), 
         backupDuplicationExpectedNumbers_(stl.backupDuplicationExpectedNumbers_),
@@ -302,10 +324,15 @@ namespace bpp
         rearrange_(stl.rearrange_), 
         numIterationsWithoutImprovement_(stl.numIterationsWithoutImprovement_), 
 		sprLimit_(stl.sprLimit_),
+        sprConflictOrdering_(stl.sprConflictOrdering_),
+        sprCutoffFraction_(stl.sprCutoffFraction_),
         branchExpectedNumbersOptimization_(stl.branchExpectedNumbersOptimization_), 
         genomeMissing_(stl.genomeMissing_), 
         speciesTreeNodeNumber_(stl.speciesTreeNodeNumber_), NNILks_(stl.NNILks_),
-        rootLks_(stl.rootLks_), treesToLogLk_(stl.treesToLogLk_), timeLimit_(stl.timeLimit_), currentStep_(stl.currentStep_),
+        rootLks_(stl.rootLks_), alrtComputation_(stl.alrtComputation_), alrtBatchSize_(stl.alrtBatchSize_),
+        treesToLogLk_(stl.treesToLogLk_),
+        numberOfStarts_(stl.numberOfStarts_), startSpeciesTreeFiles_(stl.startSpeciesTreeFiles_),
+        startLogLs_(stl.startLogLs_), startSpeciesTrees_(stl.startSpeciesTrees_), startFinished_(stl.startFinished_), timeLimit_(stl.timeLimit_), currentStep_(stl.currentStep_),
         suffix_(stl.suffix_), reconciliationModel_(stl.reconciliationModel_)
         {}
   
@@ -340,12 +367,21 @@ namespace bpp
             backupCoalBls_ = stl.backupCoalBls_;
             rearrange_ = stl.rearrange_;
             numIterationsWithoutImprovement_ = stl.numIterationsWithoutImprovement_;
+            sprConflictOrdering_ = stl.sprConflictOrdering_;
+            sprCutoffFraction_ = stl.sprCutoffFraction_;
             branchExpectedNumbersOptimization_ = stl.branchExpectedNumbersOptimization_;
             genomeMissing_ = stl.genomeMissing_;
             speciesTreeNodeNumber_ = stl.speciesTreeNodeNumber_;
             NNILks_ = stl.NNILks_;
             rootLks_ = stl.rootLks_;
+            alrtComputation_ = stl.alrtComputation_;
+            alrtBatchSize_ = stl.alrtBatchSize_;
             treesToLogLk_ = stl.treesToLogLk_;
+            numberOfStarts_ = stl.numberOfStarts_;
+            startSpeciesTreeFiles_ = stl.startSpeciesTreeFiles_;
+            startLogLs_ = stl.startLogLs_;
+            startSpeciesTrees_ = stl.startSpeciesTrees_;
+            startFinished_ = stl.startFinished_;
             timeLimit_ = stl.timeLimit_;
             currentStep_ = stl.currentStep_;
             suffix_ = stl.suffix_;
@@ -398,17 +434,39 @@ namespace bpp
   //Initializes various fields in the species tree
   void initialize();
   
+  //Computes the likelihood of the starting species tree tree_
+  void computeStartingLikelihood();
+  
   //Does a ML search for the best species tree
   void MLSearch();
   
+  //Starts the next species tree search from a new starting tree, if any is left
+  bool startNextSearch();
+  
+  //Reads or draws the starting species tree of search number start
+  void setStartingSpeciesTree(unsigned int start);
+  
+  //Outputs the results of all species tree searches
+  void outputStartResults();
+  
+  //Replaces the weights of the gene families by the costs measured in a previous run, if any
+  void applyFamilyCostProfile(std::vector<std::string> & listOptions);
+  
+  //Gathers and outputs the measured costs of the families, and compares predicted and realized loads
+  void reportFamilyCosts();
+  
   // ... while optimizing the species tree topology
   void MLSearchAndOptimizeTopology();
 
   // ... without optimizing the species tree topology
   void MLSearchButNotOptimizeTopology();
   
-  //Outputs the ALRT tree
-  void outputALRTTree() ;
+  //Computes the likelihoods of both NNI alternatives of all internal branches
+  //of the best species tree in batched rounds, then outputs the ALRT tree
+  void computeALRTsInBatches();
+
+  //Outputs the ALRT tree, the Lks of NNI alternatives being compared to referenceLogL
+  void outputALRTTree(double referenceLogL) ;
 
   //Outputs information at the end of the run
   void outputEndResults() ;
@@ -0,0 +1,85 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include "SpeciesTreeSnapshot.h"
+#include "ReconciliationTools.h"
+
+using namespace bpp;
+
+
+/******************************************************************************/
+
+SpeciesTreeSnapshot::SpeciesTreeSnapshot(const TreeTemplate<Node> & tree, unsigned int version) :
+  tree_(tree.clone()), spId_(), version_(version), references_(0)
+{
+  spId_ = computeSpeciesNamesToIdsMap(*tree_);
+}
+
+/******************************************************************************/
+
+SpeciesTreeSnapshot::SpeciesTreeSnapshot(const TreeTemplate<Node> & tree, const std::map <std::string, int> & spId, unsigned int version) :
+  tree_(tree.clone()), spId_(spId), version_(version), references_(0)
+{}
+
+/******************************************************************************/
+
+SpeciesTreeSnapshot::~SpeciesTreeSnapshot()
+{
+  delete tree_;
+}
+
+/******************************************************************************/
+
+SpeciesTreeSnapshot * SpeciesTreeSnapshot::acquire(SpeciesTreeSnapshot * snapshot)
+{
+  if (snapshot)
+    snapshot->references_++;
+  return snapshot;
+}
+
+/******************************************************************************/
+
+void SpeciesTreeSnapshot::release(SpeciesTreeSnapshot * snapshot)
+{
+  if (snapshot && --(snapshot->references_) == 0)
+    delete snapshot;
+}
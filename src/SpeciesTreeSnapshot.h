@@ -0,0 +1,116 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* This file contains the species tree snapshot shared by all gene family likelihood objects of a client.*/
+
+#ifndef _SPECIESTREESNAPSHOT_H_
+#define _SPECIESTREESNAPSHOT_H_
+
+#include <string>
+#include <map>
+
+#include <Bpp/Phyl/TreeTemplate.h>
+#include <Bpp/Phyl/Node.h>
+
+
+/**
+ * @brief A reference-counted, versioned species tree, with its species name to id map.
+ *
+ * A client builds one snapshot per species tree it receives from the server,
+ * and all its gene family likelihood objects point to it: rebinding a family to a new
+ * species tree is a pointer swap instead of a deep copy of the tree and of the map.
+ *
+ * The snapshot is not to be modified once built. The only exceptions are the
+ * LOSSES and DUPLICATIONS branch properties, which reconciliation functions reset to 0,
+ * and the breadth-first renumbering done before writing reconciled trees,
+ * which leaves the ids of a tree received from the server unchanged.
+ */
+class SpeciesTreeSnapshot
+{
+  bpp::TreeTemplate<bpp::Node> * tree_;
+  std::map <std::string, int> spId_;
+  unsigned int version_;
+  unsigned int references_;
+
+public:
+  /**
+   * @brief Builds a snapshot from a copy of tree; the species name to id map is computed from the tree.
+   */
+  SpeciesTreeSnapshot(const bpp::TreeTemplate<bpp::Node> & tree, unsigned int version = 0);
+
+  /**
+   * @brief Builds a snapshot from a copy of tree and a given species name to id map.
+   */
+  SpeciesTreeSnapshot(const bpp::TreeTemplate<bpp::Node> & tree, const std::map <std::string, int> & spId, unsigned int version = 0);
+
+  ~SpeciesTreeSnapshot();
+
+private:
+  SpeciesTreeSnapshot(const SpeciesTreeSnapshot &);
+  SpeciesTreeSnapshot & operator=(const SpeciesTreeSnapshot &);
+
+public:
+  /**
+   * @brief Adds a reference to a snapshot (which may be 0).
+   * @return snapshot.
+   */
+  static SpeciesTreeSnapshot * acquire(SpeciesTreeSnapshot * snapshot);
+
+  /**
+   * @brief Removes a reference to a snapshot (which may be 0), and deletes it if it was the last one.
+   */
+  static void release(SpeciesTreeSnapshot * snapshot);
+
+  /**
+   * @brief The tree is not const because reconciliation functions take non-const trees.
+   */
+  bpp::TreeTemplate<bpp::Node> & getTree() const { return *tree_; }
+
+  const std::map <std::string, int> & getSpId() const { return spId_; }
+
+  unsigned int getVersion() const { return version_; }
+
+  unsigned int getNumberOfReferences() const { return references_; }
+};
+
+
+#endif  //_SPECIESTREESNAPSHOT_H_
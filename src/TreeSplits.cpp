@@ -0,0 +1,342 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+#include <algorithm>
+#include <climits>
+#include <sstream>
+#include <iomanip>
+
+#include "TreeSplits.h"
+
+using namespace bpp;
+
+
+static const size_t BITS_PER_WORD = sizeof(unsigned long) * CHAR_BIT;
+
+static size_t numberOfWords(size_t numberOfLeaves)
+{
+  return (numberOfLeaves + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+/******************************************************************************/
+
+std::map<std::string, size_t> computeLeafIndices(const TreeTemplate<Node> & tree)
+{
+  std::vector<std::string> names = tree.getLeavesNames();
+  std::sort(names.begin(), names.end());
+  std::map<std::string, size_t> leafIndices;
+  for (size_t i = 0 ; i < names.size() ; i++)
+    leafIndices[names[i]] = i;
+  return leafIndices;
+}
+
+/******************************************************************************/
+
+static size_t computeSplitsBelow(const Node * node, const std::map<std::string, size_t> & leafIndices, size_t words,
+                                 std::vector<const Node *> & nodes, std::vector<Split> & splits)
+{
+  Split split(words, 0);
+  if (node->isLeaf())
+  {
+    size_t index = leafIndices.find(node->getName())->second;
+    split[index / BITS_PER_WORD] |= (1UL << (index % BITS_PER_WORD));
+  }
+  else
+  {
+    for (size_t i = 0 ; i < node->getNumberOfSons() ; i++)
+    {
+      size_t son = computeSplitsBelow(node->getSon(i), leafIndices, words, nodes, splits);
+      for (size_t w = 0 ; w < words ; w++)
+        split[w] |= splits[son][w];
+    }
+  }
+  nodes.push_back(node);
+  splits.push_back(split);
+  return splits.size() - 1;
+}
+
+/******************************************************************************/
+
+Split computeSplit(const Node & node, const std::map<std::string, size_t> & leafIndices)
+{
+  std::vector<const Node *> nodes;
+  std::vector<Split> splits;
+  computeSplitsBelow(&node, leafIndices, numberOfWords(leafIndices.size()), nodes, splits);
+  return splits.back();
+}
+
+/******************************************************************************/
+
+void computeSplits(const TreeTemplate<Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                   std::vector<const Node *> & nodes, std::vector<Split> & splits)
+{
+  nodes.clear();
+  splits.clear();
+  nodes.reserve(tree.getNumberOfNodes());
+  splits.reserve(tree.getNumberOfNodes());
+  computeSplitsBelow(tree.getRootNode(), leafIndices, numberOfWords(leafIndices.size()), nodes, splits);
+}
+
+/******************************************************************************/
+
+bool splitHasLeaf(const Split & split, size_t leaf)
+{
+  return (split[leaf / BITS_PER_WORD] >> (leaf % BITS_PER_WORD)) & 1UL;
+}
+
+/******************************************************************************/
+
+Split complementSplit(const Split & split, size_t numberOfLeaves)
+{
+  Split complement(split.size(), 0);
+  for (size_t w = 0 ; w < split.size() ; w++)
+    complement[w] = ~split[w];
+  if (numberOfLeaves % BITS_PER_WORD != 0 && !complement.empty())
+    complement.back() &= (1UL << (numberOfLeaves % BITS_PER_WORD)) - 1;
+  return complement;
+}
+
+/******************************************************************************/
+
+Node * findNodeWithSplit(TreeTemplate<Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                         const Split & split)
+{
+  Split complement = complementSplit(split, leafIndices.size());
+  std::vector<const Node *> nodes;
+  std::vector<Split> splits;
+  computeSplits(tree, leafIndices, nodes, splits);
+  //The root is the last node, and is skipped.
+  for (size_t i = 0 ; i + 1 < nodes.size() ; i++)
+  {
+    if (splits[i] == split || splits[i] == complement)
+      return const_cast<Node *>(nodes[i]);
+  }
+  return 0;
+}
+
+/******************************************************************************/
+
+static std::string splitsToKey(size_t numberOfLeaves, const std::vector<Split> & splits)
+{
+  std::ostringstream key;
+  key << numberOfLeaves << ";" << std::hex << std::setfill('0');
+  for (size_t i = 0 ; i < splits.size() ; i++)
+  {
+    for (size_t w = 0 ; w < splits[i].size() ; w++)
+      key << std::setw(BITS_PER_WORD / 4) << splits[i][w];
+    key << ";";
+  }
+  return key.str();
+}
+
+static size_t countLeaves(const Split & split)
+{
+  size_t count = 0;
+  for (size_t w = 0 ; w < split.size() ; w++)
+  {
+    for (unsigned long word = split[w] ; word != 0 ; word &= word - 1)
+      count++;
+  }
+  return count;
+}
+
+/******************************************************************************/
+
+std::string computeTopologyKey(const TreeTemplate<Node> & tree)
+{
+  std::map<std::string, size_t> leafIndices = computeLeafIndices(tree);
+  std::vector<const Node *> nodes;
+  std::vector<Split> splits;
+  computeSplits(tree, leafIndices, nodes, splits);
+  //Leaves and the root have the same splits in all trees with these leaves: only clades remain.
+  std::vector<Split> clades;
+  for (size_t i = 0 ; i + 1 < nodes.size() ; i++)
+  {
+    if (!nodes[i]->isLeaf())
+      clades.push_back(splits[i]);
+  }
+  std::sort(clades.begin(), clades.end());
+  return splitsToKey(leafIndices.size(), clades);
+}
+
+/******************************************************************************/
+
+std::string computeUnrootedTopologyKey(const TreeTemplate<Node> & tree)
+{
+  std::map<std::string, size_t> leafIndices = computeLeafIndices(tree);
+  size_t numberOfLeaves = leafIndices.size();
+  std::vector<const Node *> nodes;
+  std::vector<Split> splits;
+  computeSplits(tree, leafIndices, nodes, splits);
+  //Each branch is represented by the side of its split that does not contain leaf 0;
+  //the two sons of a root give the same branch, hence the unique.
+  std::vector<Split> branches;
+  for (size_t i = 0 ; i + 1 < nodes.size() ; i++)
+  {
+    Split split = (splits[i][0] & 1UL) ? complementSplit(splits[i], numberOfLeaves) : splits[i];
+    size_t size = countLeaves(split);
+    if (size > 1 && size + 1 < numberOfLeaves)
+      branches.push_back(split);
+  }
+  std::sort(branches.begin(), branches.end());
+  branches.erase(std::unique(branches.begin(), branches.end()), branches.end());
+  return splitsToKey(numberOfLeaves, branches);
+}
+
+/******************************************************************************/
+
+//Non-trivial branches of the tree restricted to the leaves of present, the root split being
+//last in splits. As in computeUnrootedTopologyKey, each branch is taken on the side without
+//the first present leaf.
+static std::vector<Split> computePresentBranches(const std::vector<Split> & splits, const Split & present)
+{
+  size_t numberOfPresentLeaves = countLeaves(present);
+  size_t firstWord = 0;
+  while (present[firstWord] == 0)
+    firstWord++;
+  unsigned long firstBit = present[firstWord] & (~present[firstWord] + 1);
+  std::vector<Split> branches;
+  for (size_t i = 0 ; i + 1 < splits.size() ; i++)
+  {
+    Split split = splits[i];
+    bool hasFirstLeaf = (split[firstWord] & firstBit) != 0;
+    for (size_t w = 0 ; w < split.size() ; w++)
+      split[w] = hasFirstLeaf ? present[w] & ~split[w] : present[w] & split[w];
+    size_t size = countLeaves(split);
+    if (size > 1 && size + 1 < numberOfPresentLeaves)
+      branches.push_back(split);
+  }
+  std::sort(branches.begin(), branches.end());
+  branches.erase(std::unique(branches.begin(), branches.end()), branches.end());
+  return branches;
+}
+
+/******************************************************************************/
+
+void addSplitFrequencies(const TreeTemplate<Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                         SplitFrequencies & frequencies)
+{
+  std::vector<const Node *> nodes;
+  std::vector<Split> splits;
+  computeSplits(tree, leafIndices, nodes, splits);
+  const Split & present = splits.back();
+  std::vector<Split> branches = computePresentBranches(splits, present);
+  frequencies[std::make_pair(present, Split(present.size(), 0))]++;
+  for (size_t i = 0 ; i < branches.size() ; i++)
+    frequencies[std::make_pair(present, branches[i])]++;
+}
+
+/******************************************************************************/
+
+std::vector<unsigned long> encodeSplitFrequencies(const SplitFrequencies & frequencies)
+{
+  std::vector<unsigned long> table;
+  for (SplitFrequencies::const_iterator it = frequencies.begin() ; it != frequencies.end() ; ++it)
+  {
+    table.insert(table.end(), it->first.first.begin(), it->first.first.end());
+    table.insert(table.end(), it->first.second.begin(), it->first.second.end());
+    table.push_back(it->second);
+  }
+  return table;
+}
+
+/******************************************************************************/
+
+void mergeSplitFrequencies(const std::vector<unsigned long> & table, size_t numberOfLeaves,
+                           SplitFrequencies & frequencies)
+{
+  size_t words = numberOfWords(numberOfLeaves);
+  for (size_t i = 0 ; i + 2 * words < table.size() ; i += 2 * words + 1)
+  {
+    Split present(table.begin() + i, table.begin() + i + words);
+    Split split(table.begin() + i + words, table.begin() + i + 2 * words);
+    frequencies[std::make_pair(present, split)] += table[i + 2 * words];
+  }
+}
+
+/******************************************************************************/
+
+bool isInducedTopology(const TreeTemplate<Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                       const TreeTemplate<Node> & reference, const std::map<std::string, size_t> & referenceLeafIndices,
+                       const Node * & outgroup)
+{
+  size_t numberOfLeaves = 0;
+  for (std::map<std::string, size_t>::const_iterator it = referenceLeafIndices.begin() ; it != referenceLeafIndices.end() ; ++it)
+    numberOfLeaves = std::max(numberOfLeaves, it->second + 1);
+  size_t words = numberOfWords(numberOfLeaves);
+  std::vector<const Node *> nodes, referenceNodes;
+  std::vector<Split> splits, referenceSplits;
+  computeSplitsBelow(tree.getRootNode(), leafIndices, words, nodes, splits);
+  computeSplitsBelow(reference.getRootNode(), referenceLeafIndices, words, referenceNodes, referenceSplits);
+  const Split & present = splits.back();
+  if (countLeaves(present) != tree.getNumberOfLeaves())
+    return false;
+  if (computePresentBranches(splits, present) != computePresentBranches(referenceSplits, present))
+    return false;
+  //The induced root separates the largest clade of reference that does not contain
+  //all present leaves from the other present leaves: all smaller clades are inside it.
+  Split clade(words, 0);
+  size_t cladeSize = 0;
+  for (size_t i = 0 ; i < referenceSplits.size() ; i++)
+  {
+    Split split = referenceSplits[i];
+    for (size_t w = 0 ; w < words ; w++)
+      split[w] &= present[w];
+    size_t size = countLeaves(split);
+    if (size > cladeSize && split != present)
+    {
+      clade = split;
+      cladeSize = size;
+    }
+  }
+  Split complement(words, 0);
+  for (size_t w = 0 ; w < words ; w++)
+    complement[w] = present[w] & ~clade[w];
+  outgroup = 0;
+  for (size_t i = 0 ; i + 1 < nodes.size() && !outgroup ; i++)
+  {
+    if (splits[i] == clade || splits[i] == complement)
+      outgroup = nodes[i];
+  }
+  return outgroup != 0;
+}
+
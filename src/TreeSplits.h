@@ -0,0 +1,154 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* This file contains functions to represent the splits of a tree as bitsets of leaves,
+ * to compare topologies without building and comparing strings. */
+
+#ifndef _TREESPLITS_H_
+#define _TREESPLITS_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include <Bpp/Phyl/TreeTemplate.h>
+#include <Bpp/Phyl/Node.h>
+
+
+/**
+ * A split is the set of leaves below a node, as a bitset: leaf i is in the split
+ * if bit i is set, leaf indices being given by computeLeafIndices.
+ */
+typedef std::vector<unsigned long> Split;
+
+/**
+ * Gives each leaf an index, in the alphabetical order of leaf names,
+ * so that all trees with the same leaves use the same indices.
+ */
+std::map<std::string, size_t> computeLeafIndices(const bpp::TreeTemplate<bpp::Node> & tree);
+
+/**
+ * Computes the split of the subtree below node.
+ */
+Split computeSplit(const bpp::Node & node, const std::map<std::string, size_t> & leafIndices);
+
+/**
+ * Computes the splits of all nodes of the tree in one postorder traversal:
+ * splits[i] is the split of nodes[i], and the root comes last.
+ */
+void computeSplits(const bpp::TreeTemplate<bpp::Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                   std::vector<const bpp::Node *> & nodes, std::vector<Split> & splits);
+
+/**
+ * @return true if leaf is in split.
+ */
+bool splitHasLeaf(const Split & split, size_t leaf);
+
+/**
+ * @return the leaves of numberOfLeaves that are not in split.
+ */
+Split complementSplit(const Split & split, size_t numberOfLeaves);
+
+/**
+ * Finds a node, other than the root, whose split is split or its complement,
+ * i.e. a node above which a root would separate the same leaves as split.
+ * @return 0 if there is no such node.
+ */
+bpp::Node * findNodeWithSplit(bpp::TreeTemplate<bpp::Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                              const Split & split);
+
+/**
+ * Key identifying the rooted topology of a tree: two trees with the same leaves have
+ * the same key if and only if they have the same clades, whatever the order of sons
+ * and the branch lengths.
+ */
+std::string computeTopologyKey(const bpp::TreeTemplate<bpp::Node> & tree);
+
+/**
+ * Key identifying the unrooted topology of a tree: two trees with the same leaves have
+ * the same key if and only if they have the same non-trivial splits, whatever their root.
+ */
+std::string computeUnrootedTopologyKey(const bpp::TreeTemplate<bpp::Node> & tree);
+
+/**
+ * Split-frequency table of a set of trees whose leaves are a subset of the leaves
+ * indexed by leafIndices: the key is a pair (leaves present in the tree, split),
+ * and the value is the number of trees with that split.
+ * Each split is oriented so that it does not contain the first leaf present in its tree.
+ * The leaves of each tree are also recorded once with an empty split,
+ * so that leaves of trees without non-trivial splits are not lost.
+ */
+typedef std::map< std::pair<Split, Split>, unsigned long > SplitFrequencies;
+
+/**
+ * Adds the non-trivial unrooted splits of tree to frequencies.
+ */
+void addSplitFrequencies(const bpp::TreeTemplate<bpp::Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                         SplitFrequencies & frequencies);
+
+/**
+ * Flattens frequencies into a vector that can be sent with MPI:
+ * for each entry, the words of the present leaves, the words of the split, then the count.
+ */
+std::vector<unsigned long> encodeSplitFrequencies(const SplitFrequencies & frequencies);
+
+/**
+ * Adds the counts of a table flattened by encodeSplitFrequencies to frequencies.
+ */
+void mergeSplitFrequencies(const std::vector<unsigned long> & table, size_t numberOfLeaves,
+                           SplitFrequencies & frequencies);
+
+/**
+ * Tells if the unrooted topology of tree is the one that reference induces on the leaves of tree.
+ * Leaves of tree are given indices by leafIndices, and leaves of reference by referenceLeafIndices,
+ * in the same range (e.g. genes get the index of their species); two leaves of tree
+ * must not have the same index.
+ * If so, outgroup is set to a node of tree above which a root gives the rooted topology
+ * induced by reference.
+ */
+bool isInducedTopology(const bpp::TreeTemplate<bpp::Node> & tree, const std::map<std::string, size_t> & leafIndices,
+                       const bpp::TreeTemplate<bpp::Node> & reference, const std::map<std::string, size_t> & referenceLeafIndices,
+                       const bpp::Node * & outgroup);
+
+
+#endif  //_TREESPLITS_H_
@@ -0,0 +1,472 @@
+/*
+Copyright or © or Copr. Centre National de la Recherche Scientifique
+contributor : Bastien Boussau (2009-2013)
+
+bastien.boussau@univ-lyon1.fr
+
+This software is a bioinformatics computer program whose purpose is to
+simultaneously build gene and species trees when gene families have
+undergone duplications and losses. It can analyze thousands of gene
+families in dozens of genomes simultaneously, and was presented in
+an article in Genome Research. Trees and parameters are estimated
+in the maximum likelihood framework, by maximizing theprobability
+of alignments given the species tree, the gene trees and the parameters
+of duplication and loss.
+
+This software is governed by the CeCILL license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL license and that you accept its terms.
+*/
+
+/* Benchmarks of the main computational kernels of PHYLDOG, and end-to-end runs on the data sets shipped with the sources.
+ * Every benchmark uses a fixed random seed, and results are printed as one CSV line per benchmark:
+ * benchmark,size,repetitions,total_seconds,seconds_per_call,value
+ * where value is a checksum of the computation (log-likelihood, tree length...) that should not change between releases
+ * unless the results of the algorithm change.
+ * Run with "mpirun -np 2 phyldog_bench param=options" for the end-to-end runs, or use the "bench" target.
+ */
+
+// From the STL:
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <boost/mpi.hpp>
+#include <boost/serialization/string.hpp>
+namespace mpi = boost::mpi;
+
+#include <Bpp/App/ApplicationTools.h>
+#include <Bpp/Io/FileTools.h>
+#include <Bpp/Numeric/Random/RandomTools.h>
+#include <Bpp/Text/TextTools.h>
+#include <Bpp/Text/StringTokenizer.h>
+#include <Bpp/Utils/AttributesTools.h>
+#include <Bpp/Phyl/TreeTemplateTools.h>
+
+#include "../src/SpeciesTreeLikelihood.h"
+#include "../src/ClientComputingGeneLikelihoods.h"
+#include "../src/LikelihoodEvaluator.h"
+#include "../src/Profiler.h"
+#include "../src/Logger.h"
+
+
+using namespace bpp;
+using namespace std;
+
+/******************************************************************************/
+
+void help()
+{
+  (*ApplicationTools::message << "__________________________________________________________________________").endLine();
+  (*ApplicationTools::message << "phyldog_bench parameter1_name=parameter1_value parameter2_name=parameter2_value").endLine();
+  (*ApplicationTools::message << "      ... param=option_file").endLine();
+  (*ApplicationTools::message).endLine();
+  (*ApplicationTools::message << "  bench.seed=42                 random seed used by all benchmarks").endLine();
+  (*ApplicationTools::message << "  bench.sizes=10,20,50,100      numbers of species of the synthetic trees").endLine();
+  (*ApplicationTools::message << "  bench.repetitions=20          number of calls per benchmark").endLine();
+  (*ApplicationTools::message << "  bench.family=file             gene family option file, for the sequence likelihood and BioNJ benchmarks").endLine();
+  (*ApplicationTools::message << "  bench.end_to_end=f1,f2        general option files of complete PHYLDOG runs (needs 2 processes or more)").endLine();
+  (*ApplicationTools::message << "  bench.output=file             file where the CSV lines are appended").endLine();
+  (*ApplicationTools::message << "__________________________________________________________________________").endLine();
+}
+
+/******************************************************************************/
+
+static ofstream benchOutput;
+static const char * BENCH_HEADER = "benchmark,size,repetitions,total_seconds,seconds_per_call,value";
+
+void report(const string & benchmark, size_t size, unsigned int repetitions, double seconds, double value)
+{
+  ostringstream line;
+  line << benchmark << "," << size << "," << repetitions << ","
+       << fixed << setprecision(6) << seconds << ","
+       << scientific << setprecision(6) << seconds / repetitions << ","
+       << fixed << setprecision(6) << value;
+  cout << line.str() << endl;
+  if (benchOutput.is_open())
+    benchOutput << line.str() << endl;
+}
+
+/******************************************************************************/
+
+vector<unsigned int> getSizes(map<string, string> & params)
+{
+  vector<unsigned int> sizes;
+  StringTokenizer st(ApplicationTools::getStringParameter("bench.sizes", params, "10,20,50,100", "", true, false), ",");
+  while (st.hasMoreToken())
+    sizes.push_back(TextTools::toInt(st.nextToken()));
+  return sizes;
+}
+
+/******************************************************************************/
+// Synthetic data: a random species tree with "size" species, and a random gene tree
+// with two genes per species, numbered as PHYLDOG expects.
+/******************************************************************************/
+
+TreeTemplate<Node> * buildSpeciesTree(size_t size)
+{
+  vector<string> spNames;
+  for (size_t i = 0 ; i < size ; i++)
+    spNames.push_back("sp" + TextTools::toString(i));
+  TreeTemplate<Node> * spTree = TreeTemplateTools::getRandomTree(spNames);
+  breadthFirstreNumber(*spTree);
+  return spTree;
+}
+
+TreeTemplate<Node> * buildGeneTree(size_t size, map<string, string> & seqSp)
+{
+  vector<string> seqNames;
+  for (size_t i = 0 ; i < 2 * size ; i++) {
+    string name = "g" + TextTools::toString(i);
+    seqNames.push_back(name);
+    seqSp[name] = "sp" + TextTools::toString(i % size);
+  }
+  TreeTemplate<Node> * geneTree = TreeTemplateTools::getRandomTree(seqNames);
+  geneTree->resetNodesId();
+  return geneTree;
+}
+
+/******************************************************************************/
+
+void benchDLReconciliation(size_t size, unsigned int repetitions)
+{
+  TreeTemplate<Node> * spTree = buildSpeciesTree(size);
+  map<string, string> seqSp;
+  TreeTemplate<Node> * geneTree = buildGeneTree(size, seqSp);
+  map<string, int> spId = computeSpeciesNamesToIdsMap(*spTree);
+  size_t numNodes = spTree->getNumberOfNodes();
+  vector<double> lossRates(numNodes, 0.1);
+  vector<double> duplicationRates(numNodes, 0.05);
+  vector<int> num0Lineages(numNodes, 0), num1Lineages(numNodes, 0), num2Lineages(numNodes, 0);
+  set<int> nodesToTryInNNISearch;
+  int MLindex = -1;
+  double logL = 0;
+  double startingTime = Profiler::getWallTime();
+  for (unsigned int i = 0 ; i < repetitions ; i++) {
+    logL = findMLReconciliationDR(spTree, geneTree, seqSp, spId, lossRates, duplicationRates, MLindex,
+                                  num0Lineages, num1Lineages, num2Lineages, nodesToTryInNNISearch);
+  }
+  report("dl_reconciliation", size, repetitions, Profiler::getWallTime() - startingTime, logL);
+  delete geneTree;
+  delete spTree;
+}
+
+/******************************************************************************/
+
+void benchCoalReconciliation(size_t size, unsigned int repetitions)
+{
+  TreeTemplate<Node> * spTree = buildSpeciesTree(size);
+  map<string, string> seqSp;
+  TreeTemplate<Node> * geneTree = buildGeneTree(size, seqSp);
+  map<string, int> spId = computeSpeciesNamesToIdsMap(*spTree);
+  size_t numNodes = spTree->getNumberOfNodes();
+  vector<double> coalBl(numNodes, 1.0);
+  //coalCounts: vector of genetreenbnodes vectors of 3 (3 directions) vectors of sptreenbnodes vectors of 2 ints
+  vector< vector< vector< vector<unsigned int> > > > coalCounts(geneTree->getNumberOfNodes(),
+      vector< vector< vector<unsigned int> > >(3, vector< vector<unsigned int> >(numNodes, vector<unsigned int>(2, 0))));
+  set<int> nodesToTryInNNISearch;
+  int MLindex = -1;
+  double logL = 0;
+  double startingTime = Profiler::getWallTime();
+  for (unsigned int i = 0 ; i < repetitions ; i++) {
+    logL = findMLCoalReconciliationDR(spTree, geneTree, seqSp, spId, coalBl, MLindex,
+                                      coalCounts, nodesToTryInNNISearch);
+  }
+  report("coal_reconciliation", size, repetitions, Profiler::getWallTime() - startingTime, logL);
+  delete geneTree;
+  delete spTree;
+}
+
+/******************************************************************************/
+
+void benchBranchProbability(unsigned int repetitions)
+{
+  //Fixed table of arguments, so that all runs compute the same values
+  const unsigned int numberOfArguments = 1000;
+  vector<double> duplications, losses;
+  vector<int> lineages;
+  for (unsigned int i = 0 ; i < numberOfArguments ; i++) {
+    duplications.push_back(RandomTools::giveRandomNumberBetweenZeroAndEntry(0.5));
+    losses.push_back(RandomTools::giveRandomNumberBetweenZeroAndEntry(0.5));
+    lineages.push_back(RandomTools::giveIntRandomNumberBetweenZeroAndEntry<int>(10));
+  }
+  unsigned int calls = repetitions * 100 * numberOfArguments;
+  double sum = 0;
+  double startingTime = Profiler::getWallTime();
+  for (unsigned int i = 0 ; i < calls ; i++) {
+    unsigned int j = i % numberOfArguments;
+    sum += computeBranchProbability(duplications[j], losses[j], lineages[j]);
+  }
+  report("branch_probability", numberOfArguments, calls, Profiler::getWallTime() - startingTime, sum / calls);
+}
+
+/******************************************************************************/
+// Random SPRs within distance 3 of the pruned node, as in the species tree search,
+// and the clones made for each candidate.
+/******************************************************************************/
+
+void benchSPRsAndClones(size_t size, unsigned int repetitions)
+{
+  TreeTemplate<Node> * tree = buildSpeciesTree(size);
+  unsigned int numberOfSPRs = repetitions * 100;
+  double sprTime = 0, cloneTime = 0;
+  double numberOfNodes = 0;
+  for (unsigned int i = 0 ; i < numberOfSPRs ; i++) {
+    int nodeForSPR;
+    vector<int> nodeIdsToRegraft;
+    do {
+      nodeForSPR = RandomTools::giveIntRandomNumberBetweenZeroAndEntry<int>(tree->getNumberOfNodes());
+      nodeIdsToRegraft.clear();
+      if (tree->getNode(nodeForSPR)->hasFather())
+        buildVectorOfRegraftingNodesLimitedDistance(*tree, nodeForSPR, 3, nodeIdsToRegraft);
+    } while (nodeIdsToRegraft.empty());
+    int newBrother = nodeIdsToRegraft[RandomTools::giveIntRandomNumberBetweenZeroAndEntry<int>(nodeIdsToRegraft.size())];
+
+    double startingTime = Profiler::getWallTime();
+    TreeTemplate<Node> * candidate = tree->clone();
+    cloneTime += Profiler::getWallTime() - startingTime;
+
+    startingTime = Profiler::getWallTime();
+    makeSPR(*candidate, nodeForSPR, newBrother, false);
+    sprTime += Profiler::getWallTime() - startingTime;
+
+    numberOfNodes += candidate->getNumberOfNodes();
+    delete tree;
+    tree = candidate;
+  }
+  report("spr", size, numberOfSPRs, sprTime, TreeTemplateTools::getTotalLength(*tree->getRootNode()));
+  report("tree_clone", size, numberOfSPRs, cloneTime, numberOfNodes / numberOfSPRs);
+  delete tree;
+}
+
+/******************************************************************************/
+// Full evaluation (initialize) and partial evaluations of SPR candidates
+// (setAlternativeTree), with each likelihood library.
+/******************************************************************************/
+
+void benchLikelihoodEvaluator(map<string, string> familyParams, const string & method, unsigned int repetitions)
+{
+  familyParams["likelihood.evaluator"] = method;
+  LikelihoodEvaluator levaluator(familyParams);
+
+  double startingTime = Profiler::getWallTime();
+  levaluator.initialize();
+  size_t size = levaluator.getTree()->getNumberOfLeaves();
+  report("likelihood_full_" + method, size, 1, Profiler::getWallTime() - startingTime, levaluator.getLogLikelihood());
+
+  TreeTemplate<Node> * tree = levaluator.getTree()->clone();
+  tree->newOutGroup(tree->getLeaves()[0]);
+  tree->resetNodesId();
+  double sum = 0;
+  double evaluationTime = 0;
+  for (unsigned int i = 0 ; i < repetitions ; i++) {
+    int nodeForSPR;
+    vector<int> nodeIdsToRegraft;
+    do {
+      nodeForSPR = RandomTools::giveIntRandomNumberBetweenZeroAndEntry<int>(tree->getNumberOfNodes());
+      nodeIdsToRegraft.clear();
+      if (tree->getNode(nodeForSPR)->hasFather())
+        buildVectorOfRegraftingNodesLimitedDistance(*tree, nodeForSPR, 3, nodeIdsToRegraft);
+    } while (nodeIdsToRegraft.empty());
+    int newBrother = nodeIdsToRegraft[RandomTools::giveIntRandomNumberBetweenZeroAndEntry<int>(nodeIdsToRegraft.size())];
+    TreeTemplate<Node> * candidate = tree->clone();
+    makeSPR(*candidate, nodeForSPR, newBrother, false);
+
+    startingTime = Profiler::getWallTime();
+    levaluator.setAlternativeTree(candidate);
+    evaluationTime += Profiler::getWallTime() - startingTime;
+    sum += levaluator.getAlternativeLogLikelihood();
+    delete candidate;
+  }
+  report("likelihood_spr_" + method, size, repetitions, evaluationTime, sum / repetitions);
+  delete tree;
+}
+
+/******************************************************************************/
+
+void benchBioNJ(map<string, string> familyParams, unsigned int repetitions)
+{
+  bool cont = false;
+  Alphabet * alphabet = getAlphabetFromOptions(familyParams, cont);
+  VectorSiteContainer * sites = 0;
+  SubstitutionModel * model = 0;
+  DiscreteDistribution * rDist = 0;
+  if (cont)
+    sites = getSequencesFromOptions(familyParams, alphabet, cont);
+  if (cont)
+    model = getModelFromOptions(familyParams, alphabet, sites, cont);
+  if (cont)
+    rDist = getRateDistributionFromOptions(familyParams, model, cont);
+  if (!cont)
+    throw Exception("phyldog_bench: unable to load the family given with bench.family.");
+
+  double length = 0;
+  double startingTime = Profiler::getWallTime();
+  for (unsigned int i = 0 ; i < repetitions ; i++) {
+    TreeTemplate<Node> * tree = buildBioNJTree(familyParams, sites, model, rDist, alphabet);
+    length = TreeTemplateTools::getTotalLength(*tree->getRootNode());
+    delete tree;
+  }
+  report("bionj", sites->getNumberOfSequences(), repetitions, Profiler::getWallTime() - startingTime, length);
+  delete rDist;
+  delete model;
+  delete sites;
+  delete alphabet;
+}
+
+/******************************************************************************/
+// A complete run of PHYLDOG, as done by the phyldog executable, on all processes.
+// Standard outputs are sent to one file per process next to the option file.
+/******************************************************************************/
+
+void benchEndToEnd(const mpi::communicator & world, const string & optionFile, long seed)
+{
+  unsigned int server = 0;
+  unsigned int rank = world.rank();
+  unsigned int size = world.size();
+  map<string, string> params = AttributesTools::getAttributesMapFromFile(optionFile, "=");
+  AttributesTools::resolveVariables(params);
+  RandomTools::setSeed(seed);
+
+  ofstream filestr((optionFile + "." + TextTools::toString(rank) + ".out").c_str());
+  streambuf * backup = cout.rdbuf();
+  streambuf * backupcerr = cerr.rdbuf();
+  cout.rdbuf(filestr.rdbuf());
+  cerr.rdbuf(filestr.rdbuf());
+
+  world.barrier();
+  double startingTime = Profiler::getWallTime();
+  double logL = 0;
+  size_t numberOfFamilies = 0;
+  if (rank == server) {
+    SpeciesTreeLikelihood spTL = SpeciesTreeLikelihood(world, server, size, params);
+    spTL.initialize();
+    spTL.MLSearch();
+    logL = spTL.getValue();
+  }
+  else {
+    ClientComputingGeneLikelihoods client = ClientComputingGeneLikelihoods(world, server, rank, params);
+    client.MLSearch();
+  }
+  world.barrier();
+  double seconds = Profiler::getWallTime() - startingTime;
+
+  Logger::flush();
+  cerr.rdbuf(backupcerr);
+  cout.rdbuf(backup);
+  filestr.close();
+
+  if (rank == server) {
+    ifstream genelist(ApplicationTools::getStringParameter("genelist.file", params, "none", "", true, false).c_str());
+    string line;
+    while (getline(genelist, line))
+      if (!TextTools::isEmpty(line))
+        numberOfFamilies++;
+    string name = FileTools::getFileName(optionFile);
+    report("end_to_end_" + name, numberOfFamilies, 1, seconds, logL);
+  }
+}
+
+/******************************************************************************/
+
+int main(int args, char ** argv)
+{
+  if (args == 1)
+  {
+    help();
+    return 0;
+  }
+
+  mpi::environment env(args, argv);
+  mpi::communicator world;
+
+  try
+  {
+    map<string, string> params = AttributesTools::parseOptions(args, argv);
+    long seed = ApplicationTools::getIntParameter("bench.seed", params, 42, "", true, false);
+    unsigned int repetitions = ApplicationTools::getIntParameter("bench.repetitions", params, 20, "", true, false);
+    vector<unsigned int> sizes = getSizes(params);
+    string family = ApplicationTools::getStringParameter("bench.family", params, "none", "", true, false);
+    string endToEnd = ApplicationTools::getStringParameter("bench.end_to_end", params, "none", "", true, false);
+    string output = ApplicationTools::getStringParameter("bench.output", params, "none", "", true, false);
+
+    if (world.rank() == 0)
+    {
+      bool newOutput = (output != "none" && !FileTools::fileExists(output));
+      if (output != "none")
+        benchOutput.open(output.c_str(), ios::out | ios::app);
+      cout << BENCH_HEADER << endl;
+      if (newOutput)
+        benchOutput << BENCH_HEADER << endl;
+
+      //Micro-benchmarks, on the first process only
+      for (size_t i = 0 ; i < sizes.size() ; i++) {
+        RandomTools::setSeed(seed);
+        benchDLReconciliation(sizes[i], repetitions);
+        RandomTools::setSeed(seed);
+        benchCoalReconciliation(sizes[i], repetitions);
+        RandomTools::setSeed(seed);
+        benchSPRsAndClones(sizes[i], repetitions);
+      }
+      RandomTools::setSeed(seed);
+      benchBranchProbability(repetitions);
+
+      if (family != "none") {
+        map<string, string> familyParams = AttributesTools::getAttributesMapFromFile(family, "=");
+        AttributesTools::resolveVariables(familyParams);
+        RandomTools::setSeed(seed);
+        benchLikelihoodEvaluator(familyParams, "PLL", repetitions);
+        RandomTools::setSeed(seed);
+        benchLikelihoodEvaluator(familyParams, "BPP", repetitions);
+        benchBioNJ(familyParams, repetitions);
+      }
+    }
+    world.barrier();
+
+    //End-to-end runs, on all processes
+    if (endToEnd != "none") {
+      if (world.size() < 2) {
+        if (world.rank() == 0)
+          cout << "End-to-end benchmarks skipped: they need 2 processes or more (mpirun -np 2 phyldog_bench ...)." << endl;
+      }
+      else {
+        StringTokenizer st(endToEnd, ",");
+        while (st.hasMoreToken())
+          benchEndToEnd(world, st.nextToken(), seed);
+      }
+    }
+    if (benchOutput.is_open())
+      benchOutput.close();
+  }
+  catch (exception& e)
+  {
+    cout << e.what() << endl;
+    MPI::COMM_WORLD.Abort(1);
+    return 1;
+  }
+
+  return 0;
+}